@@ -5,15 +5,356 @@
 #include <utility>
 #include <array>
 #include <iterator>
+#include <tuple>
+#include <type_traits>
+#include <algorithm>
+#include <memory>
 #include "util.h"
+#include "simd.h"
+#include "instrument.h"
 
 namespace iterutils {
 
 template<typename Tag, typename ...Iterators>
 class alternated_iterator {};
 
+namespace detail {
+
+template<typename Iterator, typename = void>
+struct has_iterator_difference : public std::false_type {};
+template<typename Iterator>
+struct has_iterator_difference<Iterator, std::void_t<decltype(std::declval<Iterator>() - std::declval<Iterator>())>>
+: public std::true_type {};
+
+// index of the first iterator that can be subtracted, which is used to measure
+// distances. Iterators of infinite ranges (ie: repeat_iterator) may not be
+template<typename ...Iterators>
+constexpr std::size_t first_measurable_iterator() {
+	constexpr bool measurable[] = {has_iterator_difference<Iterators>::value...};
+	for (std::size_t i = 0; i < sizeof...(Iterators); ++i) {
+		if (measurable[i])
+			return i;
+	}
+	return 0;
+}
+
+// position of subrange I in the end iterator. The ones before the shortest subrange
+// are visited laps+1 times and the others laps times, so that arithmetic on the end
+// iterator works. Only the shortest subrange reaches its end when lengths differ
+template<std::size_t I, typename Iterable>
+auto alternated_end_position(Iterable& iterable, std::pair<std::size_t, std::size_t> shortest) {
+	using category = typename std::iterator_traits<decltype(std::begin(iterable))>::iterator_category;
+	const std::size_t visits = shortest.first + (I < shortest.second ? 1 : 0);
+	if constexpr (is_infinite<Iterable>::value)
+		return std::end(iterable);
+	else if constexpr (std::is_base_of_v<std::random_access_iterator_tag, category>)
+		return std::begin(iterable) + visits;
+	else if constexpr (std::is_base_of_v<std::bidirectional_iterator_tag, category>)
+		return std::prev(std::end(iterable), std::size(iterable) - visits);
+	else
+		return std::end(iterable);
+}
+// whether the end position of some subrange is found by walking back from its end,
+// which takes one step per element it has beyond the shortest subrange
+template<typename ...Iterables>
+constexpr bool alternated_walks_end_v = (... or (
+	!is_infinite<std::remove_reference_t<Iterables>>::value and
+	std::is_base_of_v<std::bidirectional_iterator_tag, typename std::iterator_traits<typename std::remove_reference_t<Iterables>::iterator>::iterator_category> and
+	!std::is_base_of_v<std::random_access_iterator_tag, typename std::iterator_traits<typename std::remove_reference_t<Iterables>::iterator>::iterator_category>
+));
+
+template<typename ...Iterables, std::size_t ...I>
+detail::specialize_iterator_from_iterables<alternated_iterator, Iterables...>
+alternated_end_impl(std::pair<std::size_t, std::size_t> shortest, std::index_sequence<I...>, Iterables&... iterables) {
+	return {alternated_end_position<I>(iterables, shortest)..., shortest.second};
+}
+
+// Interleaving K contiguous arithmetic ranges of 2, 4 or 8 byte elements: the elements
+// are moved as raw lanes, so shuffles apply to integers and floating point alike
+template<std::size_t K, typename T, bool = std::is_arithmetic_v<T>>
+struct interleave_lanes : public std::false_type {};
+template<std::size_t K, typename T>
+struct interleave_lanes<K, T, true> : public std::bool_constant<
+	(K == 2 and (sizeof(T) == 2 or sizeof(T) == 4 or sizeof(T) == 8)) or
+	((K == 3 or K == 4) and (sizeof(T) == 4 or sizeof(T) == 8))
+> {};
+template<std::size_t K, typename T>
+constexpr bool interleave_lanes_v = interleave_lanes<K, T>::value;
+
+#if ITERUTILS_X86_SIMD
+template<std::size_t Bytes>
+inline __m128i unpacklo_lanes(__m128i a, __m128i b) {
+	if constexpr (Bytes == 2)
+		return _mm_unpacklo_epi16(a, b);
+	else if constexpr (Bytes == 4)
+		return _mm_unpacklo_epi32(a, b);
+	else
+		return _mm_unpacklo_epi64(a, b);
+}
+template<std::size_t Bytes>
+inline __m128i unpackhi_lanes(__m128i a, __m128i b) {
+	if constexpr (Bytes == 2)
+		return _mm_unpackhi_epi16(a, b);
+	else if constexpr (Bytes == 4)
+		return _mm_unpackhi_epi32(a, b);
+	else
+		return _mm_unpackhi_epi64(a, b);
+}
+template<std::size_t Bytes>
+ITERUTILS_TARGET("avx2")
+inline __m256i unpacklo_lanes(__m256i a, __m256i b) {
+	if constexpr (Bytes == 2)
+		return _mm256_unpacklo_epi16(a, b);
+	else if constexpr (Bytes == 4)
+		return _mm256_unpacklo_epi32(a, b);
+	else
+		return _mm256_unpacklo_epi64(a, b);
+}
+template<std::size_t Bytes>
+ITERUTILS_TARGET("avx2")
+inline __m256i unpackhi_lanes(__m256i a, __m256i b) {
+	if constexpr (Bytes == 2)
+		return _mm256_unpackhi_epi16(a, b);
+	else if constexpr (Bytes == 4)
+		return _mm256_unpackhi_epi32(a, b);
+	else
+		return _mm256_unpackhi_epi64(a, b);
+}
+inline __m128i load_lanes(const void* p) { return _mm_loadu_si128(static_cast<const __m128i*>(p)); }
+inline void store_lanes(void* p, __m128i v) { _mm_storeu_si128(static_cast<__m128i*>(p), v); }
+
+// Kernels write out[k*K + i] = src[i][k] (interleave) or out[i][k] = src[k*K + i]
+// (deinterleave) for as many whole vectors as fit in n rounds, and return the number
+// of rounds they did
+template<std::size_t K, typename T>
+ITERUTILS_TARGET("sse4.2")
+std::size_t interleave_sse(const std::array<const T*, K>& src, std::size_t n, T* out) {
+	constexpr std::size_t lanes = 16 / sizeof(T);
+	std::size_t k = 0;
+	for (; k + lanes <= n; k += lanes) {
+		T* o = out + k*K;
+		if constexpr (K == 2) {
+			const __m128i a = load_lanes(src[0] + k), b = load_lanes(src[1] + k);
+			store_lanes(o, unpacklo_lanes<sizeof(T)>(a, b));
+			store_lanes(o + lanes, unpackhi_lanes<sizeof(T)>(a, b));
+		}
+		else if constexpr (K == 3 and sizeof(T) == 4) {
+			const __m128 a = _mm_castsi128_ps(load_lanes(src[0] + k));
+			const __m128 b = _mm_castsi128_ps(load_lanes(src[1] + k));
+			const __m128 c = _mm_castsi128_ps(load_lanes(src[2] + k));
+			// a0 b0 a1 b1 and a2 b2 a3 b3, the c lanes are blended in
+			const __m128 x = _mm_unpacklo_ps(a, b), y = _mm_unpackhi_ps(a, b);
+			const __m128 o0 = _mm_blend_ps(_mm_shuffle_ps(x, x, _MM_SHUFFLE(2, 2, 1, 0)), _mm_shuffle_ps(c, c, _MM_SHUFFLE(0, 0, 0, 0)), 0x4);
+			const __m128 o1 = _mm_blend_ps(_mm_shuffle_ps(x, y, _MM_SHUFFLE(1, 0, 3, 3)), _mm_shuffle_ps(c, c, _MM_SHUFFLE(1, 1, 1, 1)), 0x2);
+			const __m128 o2 = _mm_blend_ps(_mm_shuffle_ps(y, y, _MM_SHUFFLE(3, 3, 2, 2)), _mm_shuffle_ps(c, c, _MM_SHUFFLE(3, 2, 2, 2)), 0x9);
+			store_lanes(o, _mm_castps_si128(o0));
+			store_lanes(o + 4, _mm_castps_si128(o1));
+			store_lanes(o + 8, _mm_castps_si128(o2));
+		}
+		else if constexpr (K == 3) {
+			const __m128d a = _mm_castsi128_pd(load_lanes(src[0] + k));
+			const __m128d b = _mm_castsi128_pd(load_lanes(src[1] + k));
+			const __m128d c = _mm_castsi128_pd(load_lanes(src[2] + k));
+			store_lanes(o, _mm_castpd_si128(_mm_unpacklo_pd(a, b)));
+			store_lanes(o + 2, _mm_castpd_si128(_mm_shuffle_pd(c, a, 0x2)));
+			store_lanes(o + 4, _mm_castpd_si128(_mm_unpackhi_pd(b, c)));
+		}
+		else if constexpr (sizeof(T) == 4) {
+			__m128 a = _mm_castsi128_ps(load_lanes(src[0] + k));
+			__m128 b = _mm_castsi128_ps(load_lanes(src[1] + k));
+			__m128 c = _mm_castsi128_ps(load_lanes(src[2] + k));
+			__m128 d = _mm_castsi128_ps(load_lanes(src[3] + k));
+			_MM_TRANSPOSE4_PS(a, b, c, d);
+			store_lanes(o, _mm_castps_si128(a));
+			store_lanes(o + 4, _mm_castps_si128(b));
+			store_lanes(o + 8, _mm_castps_si128(c));
+			store_lanes(o + 12, _mm_castps_si128(d));
+		}
+		else {
+			const __m128i a = load_lanes(src[0] + k), b = load_lanes(src[1] + k);
+			const __m128i c = load_lanes(src[2] + k), d = load_lanes(src[3] + k);
+			store_lanes(o, _mm_unpacklo_epi64(a, b));
+			store_lanes(o + 2, _mm_unpacklo_epi64(c, d));
+			store_lanes(o + 4, _mm_unpackhi_epi64(a, b));
+			store_lanes(o + 6, _mm_unpackhi_epi64(c, d));
+		}
+	}
+	return k;
+}
+template<std::size_t K, typename T>
+ITERUTILS_TARGET("sse4.2")
+std::size_t deinterleave_sse(const T* src, std::size_t n, const std::array<T*, K>& out) {
+	constexpr std::size_t lanes = 16 / sizeof(T);
+	std::size_t k = 0;
+	for (; k + lanes <= n; k += lanes) {
+		const T* s = src + k*K;
+		if constexpr (K == 2 and sizeof(T) == 2) {
+			// even lanes to the low half and odd lanes to the high half
+			const __m128i split = _mm_setr_epi8(0, 1, 4, 5, 8, 9, 12, 13, 2, 3, 6, 7, 10, 11, 14, 15);
+			const __m128i v0 = _mm_shuffle_epi8(load_lanes(s), split), v1 = _mm_shuffle_epi8(load_lanes(s + lanes), split);
+			store_lanes(out[0] + k, _mm_unpacklo_epi64(v0, v1));
+			store_lanes(out[1] + k, _mm_unpackhi_epi64(v0, v1));
+		}
+		else if constexpr (K == 2 and sizeof(T) == 4) {
+			const __m128 v0 = _mm_castsi128_ps(load_lanes(s)), v1 = _mm_castsi128_ps(load_lanes(s + 4));
+			store_lanes(out[0] + k, _mm_castps_si128(_mm_shuffle_ps(v0, v1, _MM_SHUFFLE(2, 0, 2, 0))));
+			store_lanes(out[1] + k, _mm_castps_si128(_mm_shuffle_ps(v0, v1, _MM_SHUFFLE(3, 1, 3, 1))));
+		}
+		else if constexpr (K == 2) {
+			const __m128i v0 = load_lanes(s), v1 = load_lanes(s + 2);
+			store_lanes(out[0] + k, _mm_unpacklo_epi64(v0, v1));
+			store_lanes(out[1] + k, _mm_unpackhi_epi64(v0, v1));
+		}
+		else if constexpr (K == 3 and sizeof(T) == 4) {
+			// every vector holds lanes of all three outputs, blends gather them
+			// out of order and shuffles put them back in order
+			const __m128 v0 = _mm_castsi128_ps(load_lanes(s));
+			const __m128 v1 = _mm_castsi128_ps(load_lanes(s + 4));
+			const __m128 v2 = _mm_castsi128_ps(load_lanes(s + 8));
+			const __m128 a = _mm_blend_ps(_mm_blend_ps(v0, v1, 0x4), v2, 0x2);
+			const __m128 b = _mm_blend_ps(_mm_blend_ps(v0, v1, 0x9), v2, 0x4);
+			const __m128 c = _mm_blend_ps(_mm_blend_ps(v0, v1, 0x2), v2, 0x9);
+			store_lanes(out[0] + k, _mm_castps_si128(_mm_shuffle_ps(a, a, _MM_SHUFFLE(1, 2, 3, 0))));
+			store_lanes(out[1] + k, _mm_castps_si128(_mm_shuffle_ps(b, b, _MM_SHUFFLE(2, 3, 0, 1))));
+			store_lanes(out[2] + k, _mm_castps_si128(_mm_shuffle_ps(c, c, _MM_SHUFFLE(3, 0, 1, 2))));
+		}
+		else if constexpr (K == 3) {
+			const __m128d v0 = _mm_castsi128_pd(load_lanes(s));
+			const __m128d v1 = _mm_castsi128_pd(load_lanes(s + 2));
+			const __m128d v2 = _mm_castsi128_pd(load_lanes(s + 4));
+			store_lanes(out[0] + k, _mm_castpd_si128(_mm_shuffle_pd(v0, v1, 0x2)));
+			store_lanes(out[1] + k, _mm_castpd_si128(_mm_shuffle_pd(v0, v2, 0x1)));
+			store_lanes(out[2] + k, _mm_castpd_si128(_mm_shuffle_pd(v1, v2, 0x2)));
+		}
+		else if constexpr (sizeof(T) == 4) {
+			__m128 a = _mm_castsi128_ps(load_lanes(s));
+			__m128 b = _mm_castsi128_ps(load_lanes(s + 4));
+			__m128 c = _mm_castsi128_ps(load_lanes(s + 8));
+			__m128 d = _mm_castsi128_ps(load_lanes(s + 12));
+			_MM_TRANSPOSE4_PS(a, b, c, d);
+			store_lanes(out[0] + k, _mm_castps_si128(a));
+			store_lanes(out[1] + k, _mm_castps_si128(b));
+			store_lanes(out[2] + k, _mm_castps_si128(c));
+			store_lanes(out[3] + k, _mm_castps_si128(d));
+		}
+		else {
+			const __m128i v0 = load_lanes(s), v1 = load_lanes(s + 2), v2 = load_lanes(s + 4), v3 = load_lanes(s + 6);
+			store_lanes(out[0] + k, _mm_unpacklo_epi64(v0, v2));
+			store_lanes(out[1] + k, _mm_unpackhi_epi64(v0, v2));
+			store_lanes(out[2] + k, _mm_unpacklo_epi64(v1, v3));
+			store_lanes(out[3] + k, _mm_unpackhi_epi64(v1, v3));
+		}
+	}
+	return k;
+}
+// two inputs with 256 bit vectors: the unpacks work inside 128 bit halves and a
+// permutation of the halves restores the order
+template<typename T>
+ITERUTILS_TARGET("avx2")
+std::size_t interleave2_avx2(const std::array<const T*, 2>& src, std::size_t n, T* out) {
+	constexpr std::size_t lanes = 32 / sizeof(T);
+	std::size_t k = 0;
+	for (; k + lanes <= n; k += lanes) {
+		const __m256i a = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(src[0] + k));
+		const __m256i b = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(src[1] + k));
+		const __m256i lo = unpacklo_lanes<sizeof(T)>(a, b), hi = unpackhi_lanes<sizeof(T)>(a, b);
+		_mm256_storeu_si256(reinterpret_cast<__m256i*>(out + 2*k), _mm256_permute2x128_si256(lo, hi, 0x20));
+		_mm256_storeu_si256(reinterpret_cast<__m256i*>(out + 2*k + lanes), _mm256_permute2x128_si256(lo, hi, 0x31));
+	}
+	return k;
+}
+template<typename T>
+ITERUTILS_TARGET("avx2")
+std::size_t deinterleave2_avx2(const T* src, std::size_t n, const std::array<T*, 2>& out) {
+	constexpr std::size_t lanes = 32 / sizeof(T);
+	std::size_t k = 0;
+	for (; k + lanes <= n; k += lanes) {
+		const __m256i v0 = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(src + 2*k));
+		const __m256i v1 = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(src + 2*k + lanes));
+		// the first and the second half of both vectors, so that the halves of the
+		// outputs come out of the same 128 bit lanes
+		const __m256i t0 = _mm256_permute2x128_si256(v0, v1, 0x20), t1 = _mm256_permute2x128_si256(v0, v1, 0x31);
+		__m256i a, b;
+		if constexpr (sizeof(T) == 2) {
+			const __m256i split = _mm256_setr_epi8(
+				0, 1, 4, 5, 8, 9, 12, 13, 2, 3, 6, 7, 10, 11, 14, 15,
+				0, 1, 4, 5, 8, 9, 12, 13, 2, 3, 6, 7, 10, 11, 14, 15
+			);
+			const __m256i s0 = _mm256_shuffle_epi8(t0, split), s1 = _mm256_shuffle_epi8(t1, split);
+			a = _mm256_unpacklo_epi64(s0, s1);
+			b = _mm256_unpackhi_epi64(s0, s1);
+		}
+		else if constexpr (sizeof(T) == 4) {
+			a = _mm256_castps_si256(_mm256_shuffle_ps(_mm256_castsi256_ps(t0), _mm256_castsi256_ps(t1), _MM_SHUFFLE(2, 0, 2, 0)));
+			b = _mm256_castps_si256(_mm256_shuffle_ps(_mm256_castsi256_ps(t0), _mm256_castsi256_ps(t1), _MM_SHUFFLE(3, 1, 3, 1)));
+		}
+		else {
+			a = _mm256_unpacklo_epi64(t0, t1);
+			b = _mm256_unpackhi_epi64(t0, t1);
+		}
+		_mm256_storeu_si256(reinterpret_cast<__m256i*>(out[0] + k), a);
+		_mm256_storeu_si256(reinterpret_cast<__m256i*>(out[1] + k), b);
+	}
+	return k;
+}
+#endif
+
+// out[k*K + i] = src[i][k] for k in [0, n)
+template<std::size_t K, typename T>
+void interleave(const std::array<const T*, K>& src, std::size_t n, T* out) {
+	std::size_t k = 0;
+#if ITERUTILS_X86_SIMD
+	if constexpr (interleave_lanes_v<K, T>) {
+		const simd_level level = current_simd_level();
+		if constexpr (K == 2) {
+			if (level == simd_level::avx2 or level == simd_level::avx512)
+				k = interleave2_avx2(src, n, out);
+		}
+		if (level != simd_level::scalar)
+			k += interleave_sse<K>(std::apply([k](auto... s) { return std::array<const T*, K>{(s + k)...}; }, src), n - k, out + k*K);
+	}
+#endif
+	for (; k < n; ++k) {
+		for (std::size_t i = 0; i < K; ++i)
+			out[k*K + i] = src[i][k];
+	}
+}
+// out[i][k] = src[k*K + i] for k in [0, n)
+template<std::size_t K, typename T>
+void deinterleave(const T* src, std::size_t n, const std::array<T*, K>& out) {
+	std::size_t k = 0;
+#if ITERUTILS_X86_SIMD
+	if constexpr (interleave_lanes_v<K, T>) {
+		const simd_level level = current_simd_level();
+		if constexpr (K == 2) {
+			if (level == simd_level::avx2 or level == simd_level::avx512)
+				k = deinterleave2_avx2(src, n, out);
+		}
+		if (level != simd_level::scalar)
+			k += deinterleave_sse<K>(src + k*K, n - k, std::apply([k](auto... o) { return std::array<T*, K>{(o + k)...}; }, out));
+	}
+#endif
+	for (; k < n; ++k) {
+		for (std::size_t i = 0; i < K; ++i)
+			out[i][k] = src[k*K + i];
+	}
+}
+
+// alternations that iterutils::copy runs through interleave and deinterleave: K equal
+// contiguous iterators over lanes, to or from contiguous storage of the same type
+template<typename Contiguous, typename ...Iterators>
+constexpr bool interleavable_v = std::conjunction_v<std::is_same<Iterators, std::tuple_element_t<0, std::tuple<Iterators...>>>...> and
+	is_contiguous_iterator_v<std::tuple_element_t<0, std::tuple<Iterators...>>> and
+	is_contiguous_iterator_v<Contiguous> and
+	std::is_same_v<typename std::iterator_traits<Contiguous>::value_type, typename std::iterator_traits<std::tuple_element_t<0, std::tuple<Iterators...>>>::value_type> and
+	interleave_lanes_v<sizeof...(Iterators), typename std::iterator_traits<Contiguous>::value_type>;
+
+} // namespace detail
+
 template<typename Tag, typename ...Iterators>
 alternated_iterator<Tag, Iterators...>& operator++(alternated_iterator<Tag, Iterators...>& it) {
+	ITERUTILS_COUNT(alternated, increment);
+	ITERUTILS_COUNT(alternated, visit);
 	std::visit([](auto&& item){ ++item; }, it._its[it._index]);
 	it._index = (it._index+1) % sizeof...(Iterators);
 	return it;
@@ -21,11 +362,13 @@ alternated_iterator<Tag, Iterators...>& operator++(alternated_iterator<Tag, Iter
 template<typename Tag, typename ...Iterators>
 alternated_iterator<Tag, Iterators...> operator++(alternated_iterator<Tag, Iterators...>& it, int) {
 	auto copy = it;
-	++copy;
-	return it;
+	++it;
+	return copy;
 }
 template<typename Tag, typename ...Iterators>
 alternated_iterator<Tag, Iterators...>& operator--(alternated_iterator<Tag, Iterators...>& it) {
+	ITERUTILS_COUNT(alternated, increment);
+	ITERUTILS_COUNT(alternated, visit);
 	// decreasing a 0 index would wrap to SIZE_MAX so we wrap to sizeof(Iterators) instead
 	if (it._index == 0)
 		it._index = sizeof...(Iterators)-1;
@@ -37,35 +380,27 @@ alternated_iterator<Tag, Iterators...>& operator--(alternated_iterator<Tag, Iter
 template<typename Tag, typename ...Iterators>
 alternated_iterator<Tag, Iterators...> operator--(alternated_iterator<Tag, Iterators...>& it, int) {
 	auto copy = it;
-	--copy;
-	return it;
+	--it;
+	return copy;
 }
 template<typename Tag, typename ...Iterators>
 alternated_iterator<Tag, Iterators...>&
 operator+=(alternated_iterator<Tag, Iterators...>& it, typename alternated_iterator<Tag, Iterators...>::difference_type n) {
-	while (n) {
-		auto x = (n + sizeof...(Iterators)-1) / sizeof...(Iterators);
-		std::visit([x](auto&& item){ item += x; }, it._its[it._index]);
-		n -= x;
-		it._index = (it._index+1) % sizeof...(Iterators);
-	}
+	ITERUTILS_COUNT(alternated, jump);
+	it._advance(n, std::index_sequence_for<Iterators...>());
 	return it;
 }
 template<typename Tag, typename ...Iterators>
 alternated_iterator<Tag, Iterators...>
 operator+(const alternated_iterator<Tag, Iterators...>& it, typename alternated_iterator<Tag, Iterators...>::difference_type n) {
 	auto copy = it;
-	return copy += it;
+	return copy += n;
 }
 template<typename Tag, typename ...Iterators>
 alternated_iterator<Tag, Iterators...>&
 operator-=(alternated_iterator<Tag, Iterators...>& it, typename alternated_iterator<Tag, Iterators...>::difference_type n) {
-	while (n) {
-		auto x = (n + sizeof...(Iterators)-1) / sizeof...(Iterators);
-		std::visit([x](auto&& item){ item -= x; }, it._its[it._index]);
-		n -= x;
-		it._index = (it._index+1) % sizeof...(Iterators);
-	}
+	ITERUTILS_COUNT(alternated, jump);
+	it._advance(-n, std::index_sequence_for<Iterators...>());
 	return it;
 }
 template<typename Tag, typename ...Iterators>
@@ -87,31 +422,34 @@ public:
 	alternated_iterator(Iterators... iterators, std::size_t index=0)
 	: alternated_iterator(iterators..., std::index_sequence_for<Iterators...>(), index) {
 	}
-	alternated_iterator() = delete;
-	alternated_iterator(const alternated_iterator& other) = delete;
+	alternated_iterator(const alternated_iterator& other) = default;
 
 	friend alternated_iterator& operator++<iterator_category, Iterators...>(alternated_iterator&);
 
 	reference operator*() {
+		ITERUTILS_COUNT(alternated, dereference);
+		ITERUTILS_COUNT(alternated, visit);
 		return std::visit([](auto&& it) -> reference { return *it; }, _its[_index]);
 	}
+	// the current subrange position tells how many laps were made,
+	// so there is no need to compare the other ones
 	bool operator!=(const alternated_iterator& other) const {
+		ITERUTILS_COUNT(alternated, compare);
+		ITERUTILS_COUNT(alternated, visit);
 		return _index != other._index or _its[_index] != other._its[other._index];
 	}
 	bool operator==(const alternated_iterator& other) const {
-		return _logical_eqeq(other, std::index_sequence_for<Iterators...>());
+		return !(*this != other);
 	}
 
 protected:
+	alternated_iterator() = default;
+
 	template<std::size_t ...I>
 	alternated_iterator(Iterators... iterators, std::index_sequence<I...>, std::size_t index=0)
 	: _its{std::variant<Iterators...>(std::in_place_index_t<I>(), iterators)...},
 	_index(index) {
 	}
-	template<std::size_t ...I>
-	bool _logical_eqeq(const alternated_iterator& other, std::index_sequence<I...>) const {
-		return (... && (std::get<I>(_its) == std::get<I>(other._its)));
-	}
 
 	std::array<std::variant<Iterators...>, sizeof...(Iterators)> _its;
 	std::size_t _index;
@@ -179,8 +517,89 @@ public:
 	friend alternated_iterator& operator-=<iterator_category, Iterators...>(alternated_iterator&, difference_type);
 	friend alternated_iterator  operator- <iterator_category, Iterators...>(const alternated_iterator&, difference_type);
 
-	// TODO: add relational operators <, <=, >, >=
-protected:
+	reference operator[](difference_type n) const {
+		return *(*this + n);
+	}
+	difference_type operator-(const alternated_iterator& other) const {
+		ITERUTILS_COUNT(alternated, jump);
+		constexpr std::size_t s = detail::first_measurable_iterator<Iterators...>();
+		// subrange s was visited laps+1 times when it comes before _index and laps times otherwise
+		difference_type laps = std::get<s>(this->_its[s]) - std::get<s>(other._its[s]);
+		laps -= (s < this->_index ? 1 : 0) - (s < other._index ? 1 : 0);
+		return laps * K + static_cast<difference_type>(this->_index) - static_cast<difference_type>(other._index);
+	}
+	bool operator< (const alternated_iterator& other) const { ITERUTILS_COUNT(alternated, compare); return *this - other <  0; }
+	bool operator<=(const alternated_iterator& other) const { ITERUTILS_COUNT(alternated, compare); return *this - other <= 0; }
+	bool operator> (const alternated_iterator& other) const { ITERUTILS_COUNT(alternated, compare); return *this - other >  0; }
+	bool operator>=(const alternated_iterator& other) const { ITERUTILS_COUNT(alternated, compare); return *this - other >= 0; }
+
+	// iterutils::copy out of an alternation of contiguous arithmetic ranges of 2, 3 or 4
+	// inputs into contiguous storage copies whole rounds with SIMD shuffles (see
+	// detail::interleave). The elements before the first round and after the last one
+	// are copied one by one
+	template<typename OutputIterator>
+	friend OutputIterator bulk_copy(const alternated_iterator& first, const alternated_iterator& last, OutputIterator out) {
+		if constexpr (detail::interleavable_v<OutputIterator, Iterators...>) {
+			alternated_iterator it = first;
+			difference_type n = last - first;
+			for (; n > 0 and it._index != 0; --n, ++it, ++out)
+				*out = *it;
+			const difference_type rounds = n / K;
+			if (rounds > 0) {
+				detail::interleave<sizeof...(Iterators)>(_addresses<const value_type>(it, std::index_sequence_for<Iterators...>()), static_cast<std::size_t>(rounds), std::addressof(*out));
+				it += rounds * K;
+				out += rounds * K;
+				n -= rounds * K;
+			}
+			for (; n > 0; --n, ++it, ++out)
+				*out = *it;
+			return out;
+		}
+		else
+			return std::copy(first, last, out);
+	}
+	// and the other way around, iterutils::copy from contiguous storage into an alternation
+	// (ie: alternated_range(left, right).begin()) deinterleaves it
+	template<typename InputIterator, typename = std::enable_if_t<detail::interleavable_v<InputIterator, Iterators...>>>
+	friend alternated_iterator bulk_copy(InputIterator first, InputIterator last, alternated_iterator out) {
+		difference_type n = last - first;
+		for (; n > 0 and out._index != 0; --n, ++first, ++out)
+			*out = *first;
+		const difference_type rounds = n / K;
+		if (rounds > 0) {
+			detail::deinterleave<sizeof...(Iterators)>(std::addressof(*first), static_cast<std::size_t>(rounds), _addresses<value_type>(out, std::index_sequence_for<Iterators...>()));
+			first += rounds * K;
+			out += rounds * K;
+			n -= rounds * K;
+		}
+		for (; n > 0; --n, ++first, ++out)
+			*out = *first;
+		return out;
+	}
+
+private:
+	// position p is the p / K th visit to subrange p % K, so the subranges before p % K
+	// were visited p / K + 1 times and the rest p / K times. O(K)
+	template<std::size_t ...I>
+	void _advance(difference_type n, std::index_sequence<I...>) {
+		const difference_type q = static_cast<difference_type>(this->_index) + n;
+		const difference_type laps = q >= 0 ? q / K : -((K - 1 - q) / K);
+		const std::size_t index = static_cast<std::size_t>(q - laps * K);
+		(..., _advance_one<I>(laps + (I < index ? 1 : 0) - (I < this->_index ? 1 : 0)));
+		this->_index = index;
+	}
+	template<std::size_t I>
+	void _advance_one(difference_type n) {
+		if (n != 0)
+			std::get<I>(this->_its[I]) += n;
+	}
+	// the current element of every subrange, for the bulk copies
+	template<typename Lane, std::size_t ...I>
+	static std::array<Lane*, sizeof...(I)> _addresses(const alternated_iterator& it, std::index_sequence<I...>) {
+		return {std::addressof(*std::get<I>(it._its[I]))...};
+	}
+
+	static constexpr difference_type K = sizeof...(Iterators);
 };
 
 template<typename ...Iterators>
@@ -197,9 +616,13 @@ detail::specialize_iterator_from_iterables<alternated_iterator, Iterables...> al
 template<typename ...Iterables>
 detail::specialize_iterator_from_iterables<alternated_iterator, Iterables...> alternated_end(Iterables&... iterables) {
 	auto shortest = shortest_iterable(iterables...);
-	return {std::end(iterables)..., shortest.second};
+	return detail::alternated_end_impl(shortest, std::index_sequence_for<Iterables...>(), iterables...);
 }
 
+// The end iterator is computed in O(1) from random access subranges. When a subrange is
+// only bidirectional (ie: std::list) finding its end position walks it, so the end is
+// computed once at construction instead, and refresh() computes it again after a
+// subrange changes size
 template<typename ...Iterables>
 class alternated_range {
 public:
@@ -209,17 +632,48 @@ public:
 	using pointer    = std::common_type_t<typename std::remove_reference_t<Iterables>::pointer...>;
 
 	alternated_range(Iterables&&... iterables) : t(std::forward<Iterables>(iterables)...) {
+		refresh();
+	}
+	// the end of a copy points to the subranges of the copy
+	alternated_range(const alternated_range& other) : t(other.t) {
+		refresh();
+	}
+	alternated_range(alternated_range&& other) : t(std::move(other.t)) {
+		refresh();
+	}
+	alternated_range& operator=(const alternated_range& other) {
+		t = other.t;
+		refresh();
+		return *this;
+	}
+	alternated_range& operator=(alternated_range&& other) {
+		t = std::move(other.t);
+		refresh();
+		return *this;
 	}
 	iterator begin() { return std::apply(alternated_begin<std::remove_reference_t<Iterables>...>, t); }
-	iterator end() { return std::apply(alternated_end<std::remove_reference_t<Iterables>...>, t); }
+	iterator end() {
+		if constexpr (detail::alternated_walks_end_v<Iterables...>)
+			return end_;
+		else
+			return std::apply(alternated_end<std::remove_reference_t<Iterables>...>, t);
+	}
+
+	void refresh() {
+		if constexpr (detail::alternated_walks_end_v<Iterables...>)
+			end_ = std::apply(alternated_end<std::remove_reference_t<Iterables>...>, t);
+	}
 
-	std::enable_if_t<!is_infinite<alternated_range>::value,	size_t>
+	// every subrange up to the end of the shortest finite one
+	template<typename R = alternated_range>
+	std::enable_if_t<!is_infinite<R>::value and detail::sized_or_infinite_v<Iterables...>, size_t>
 	size() const {
 		auto shortest = std::apply(shortest_iterable<Iterables...>, t);
 		return shortest.first * sizeof...(Iterables) + shortest.second;
 	}
 private:
 	std::tuple<Iterables...> t;
+	std::conditional_t<detail::alternated_walks_end_v<Iterables...>, iterator, std::tuple<>> end_;
 };
 template<typename ...Iterables>
 alternated_range(Iterables&&...) -> alternated_range<Iterables...>;
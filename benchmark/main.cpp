@@ -0,0 +1,844 @@
+// Measures every adapter against the equivalent hand-written loop.
+// usage: benchmark [filter]
+// only the cases whose adapter name contains filter are run
+
+#include "../zipped_range.h"
+#include "../chained_range.h"
+#include "../strided_range.h"
+#include "../cycle_range.h"
+#include "../ncycle_range.h"
+#include "../alternated_range.h"
+#include "../repeat_range.h"
+#include "../matrix_view.h"
+#include "../transformed_range.h"
+#include "../filtered_range.h"
+#include "../series_range.h"
+#include "../prefetched_range.h"
+#include "../indexed_range.h"
+#include "../merged_range.h"
+#include "../chunked_range.h"
+#include "../sliding_window_range.h"
+#include "../segmented.h"
+
+#include <algorithm>
+#include <array>
+#include <chrono>
+#include <cmath>
+#include <cstdint>
+#include <forward_list>
+#include <iomanip>
+#include <iostream>
+#include <list>
+#include <numeric>
+#include <queue>
+#include <random>
+#include <sstream>
+#include <string>
+#include <type_traits>
+#include <vector>
+
+using namespace iterutils;
+
+namespace {
+
+template<std::size_t Bytes>
+struct element {
+	std::uint32_t value;
+	std::array<char, Bytes - sizeof(std::uint32_t)> padding;
+};
+template<>
+struct element<4> {
+	std::uint32_t value;
+};
+
+// results are written here so that the measured loops are not optimized away
+volatile std::uint64_t sink;
+
+std::string filter;
+
+// best time of a few rounds, in ns per call of f. Every round lasts at least 10ms
+template<typename F>
+double time_ns(F&& f) {
+	using clock = std::chrono::steady_clock;
+	const auto min_round = std::chrono::milliseconds(10);
+	std::size_t calls = 1;
+	double best = 0;
+	for (int round = 0; round < 4; ++round) {
+		clock::duration elapsed;
+		while (true) {
+			auto start = clock::now();
+			for (std::size_t i = 0; i < calls; ++i)
+				sink = f();
+			elapsed = clock::now() - start;
+			// the first round calibrates the number of calls
+			if (round > 0 or elapsed >= min_round)
+				break;
+			calls *= 2;
+		}
+		double ns = std::chrono::duration<double, std::nano>(elapsed).count() / calls;
+		if (round == 0 or ns < best)
+			best = ns;
+	}
+	return best;
+}
+
+std::string format_bytes(std::size_t bytes) {
+	std::ostringstream out;
+	if (bytes >= (1 << 20))
+		out << (bytes >> 20) << " MiB";
+	else
+		out << (bytes >> 10) << " KiB";
+	return out.str();
+}
+
+void print_header() {
+	std::cout << std::left
+		<< std::setw(14) << "adapter"
+		<< std::setw(15) << "category"
+		<< std::setw(9)  << "element"
+		<< std::setw(13) << "working set"
+		<< std::right
+		<< std::setw(15) << "baseline ns/el"
+		<< std::setw(15) << "adapter ns/el"
+		<< std::setw(14) << "adapter GB/s"
+		<< std::setw(8)  << "ratio"
+		<< std::endl;
+}
+
+// elements is the number of elements visited per call and bytes the number of bytes they span
+template<typename Baseline, typename Adapter>
+void run(const char* name, const char* category, std::size_t element_size, std::size_t working_set,
+	std::size_t elements, std::size_t bytes, Baseline&& baseline, Adapter&& adapter) {
+	if (std::string(name).find(filter) == std::string::npos)
+		return;
+	double baseline_ns = time_ns(baseline);
+	double adapter_ns = time_ns(adapter);
+	std::cout << std::left
+		<< std::setw(14) << name
+		<< std::setw(15) << category
+		<< std::setw(9)  << (std::to_string(element_size) + " B")
+		<< std::setw(13) << format_bytes(working_set)
+		<< std::right << std::fixed
+		<< std::setw(15) << std::setprecision(3) << baseline_ns / elements
+		<< std::setw(15) << std::setprecision(3) << adapter_ns / elements
+		<< std::setw(14) << std::setprecision(2) << bytes / adapter_ns
+		<< std::setw(8)  << std::setprecision(2) << adapter_ns / baseline_ns
+		<< std::endl;
+}
+
+template<typename Container>
+constexpr bool is_vector_v = std::is_same_v<Container, std::vector<typename Container::value_type>>;
+
+template<typename Container>
+const char* category_name() {
+	using tag = typename std::iterator_traits<typename Container::iterator>::iterator_category;
+	if constexpr (std::is_same_v<tag, std::random_access_iterator_tag>)
+		return "random_access";
+	else if constexpr (std::is_same_v<tag, std::bidirectional_iterator_tag>)
+		return "bidirectional";
+	else
+		return "forward";
+}
+
+template<typename Container>
+Container make_container(std::size_t n) {
+	using T = typename Container::value_type;
+	std::vector<T> values(n);
+	for (std::size_t i = 0; i < n; ++i)
+		values[i].value = static_cast<std::uint32_t>(i % 1021);
+	return Container(values.begin(), values.end());
+}
+
+template<typename T>
+bool by_value(const T& x, const T& y) {
+	return x.value < y.value;
+}
+
+// hand-written traversals: index loops over vectors and iterator loops otherwise
+template<typename Container, typename F>
+void raw_for_each(Container& c, F&& f) {
+	if constexpr (is_vector_v<Container>) {
+		for (std::size_t i = 0; i < c.size(); ++i)
+			f(c[i]);
+	}
+	else {
+		for (auto it = c.begin(); it != c.end(); ++it)
+			f(*it);
+	}
+}
+template<typename Container, typename F>
+void raw_for_each(Container& a, Container& b, F&& f) {
+	if constexpr (is_vector_v<Container>) {
+		const std::size_t n = std::min(a.size(), b.size());
+		for (std::size_t i = 0; i < n; ++i)
+			f(a[i], b[i]);
+	}
+	else {
+		for (auto i = a.begin(), j = b.begin(); i != a.end() and j != b.end(); ++i, ++j)
+			f(*i, *j);
+	}
+}
+
+// the working set is split between the containers of every case
+template<typename Container>
+void bench_adapters(std::size_t working_set) {
+	using T = typename Container::value_type;
+	const char* category = category_name<Container>();
+	const std::size_t n = working_set / sizeof(T);
+	Container a = make_container<Container>(n / 2), b = make_container<Container>(n / 2), c = make_container<Container>(n);
+
+	// zipped_range and alternated_range need the size of their ranges
+	constexpr bool sized = !std::is_same_v<Container, std::forward_list<T>>;
+
+	if constexpr (sized) {
+		run("zipped", category, sizeof(T), working_set, n / 2, n * sizeof(T),
+			[&] {
+				std::uint64_t sum = 0;
+				raw_for_each(a, b, [&](const T& x, const T& y) { sum += x.value * y.value; });
+				return sum;
+			},
+			[&] {
+				std::uint64_t sum = 0;
+				for (auto [x, y] : zipped_range(a, b))
+					sum += x.value * y.value;
+				return sum;
+			}
+		);
+		// the same loop against the end iterator and against the sentinel
+		run("zipped sent", category, sizeof(T), working_set, n / 2, n * sizeof(T),
+			[&] {
+				std::uint64_t sum = 0;
+				for (auto [x, y] : zipped_range(a, b))
+					sum += x.value * y.value;
+				return sum;
+			},
+			[&] {
+				std::uint64_t sum = 0;
+				for (auto [x, y] : sentinel_range(zipped_range(a, b)))
+					sum += x.value * y.value;
+				return sum;
+			}
+		);
+	}
+	run("chained", category, sizeof(T), working_set, n, n * sizeof(T),
+		[&] {
+			std::uint64_t sum = 0;
+			raw_for_each(a, [&](const T& x) { sum += x.value; });
+			raw_for_each(b, [&](const T& x) { sum += x.value; });
+			return sum;
+		},
+		[&] {
+			std::uint64_t sum = 0;
+			for (const T& x : chained_range(a, b))
+				sum += x.value;
+			return sum;
+		}
+	);
+	run("chained sent", category, sizeof(T), working_set, n, n * sizeof(T),
+		[&] {
+			std::uint64_t sum = 0;
+			for (const T& x : chained_range(a, b))
+				sum += x.value;
+			return sum;
+		},
+		[&] {
+			std::uint64_t sum = 0;
+			for (const T& x : sentinel_range(chained_range(a, b)))
+				sum += x.value;
+			return sum;
+		}
+	);
+	// a zip processed in blocks of rows, against block boundaries computed by hand
+	if constexpr (sized) {
+		constexpr std::size_t block = 4096;
+		run("chunked", category, sizeof(T), working_set, n / 2, n * sizeof(T),
+			[&] {
+				std::uint64_t sum = 0;
+				if constexpr (is_vector_v<Container>) {
+					for (std::size_t first = 0; first < a.size(); first += block) {
+						const std::size_t last = std::min(first + block, a.size());
+						for (std::size_t i = first; i < last; ++i)
+							sum += a[i].value * b[i].value;
+					}
+				}
+				else
+					raw_for_each(a, b, [&](const T& x, const T& y) { sum += x.value * y.value; });
+				return sum;
+			},
+			[&] {
+				std::uint64_t sum = 0;
+				for (auto rows : chunked_range(zipped_range(a, b), block)) {
+					for (auto [x, y] : rows)
+						sum += x.value * y.value;
+				}
+				return sum;
+			}
+		);
+	}
+	// sums of windows of 8 elements. The width is read at runtime by both loops, a
+	// constant would let the compiler unroll the hand-written one
+	{
+		volatile std::size_t runtime_width = 8;
+		const std::size_t width = runtime_width;
+		run("sliding", category, sizeof(T), working_set, n, n * width * sizeof(T),
+			[&] {
+				std::uint64_t sum = 0;
+				if constexpr (is_vector_v<Container>) {
+					for (std::size_t i = 0; i + width <= c.size(); ++i) {
+						for (std::size_t j = i; j < i + width; ++j)
+							sum += c[j].value;
+					}
+				}
+				else {
+					auto last = std::next(c.begin(), width);
+					for (auto first = c.begin(); ; ++first, ++last) {
+						for (auto it = first; it != last; ++it)
+							sum += it->value;
+						if (last == c.end())
+							break;
+					}
+				}
+				return sum;
+			},
+			[&] {
+				std::uint64_t sum = 0;
+				for (auto window : sliding_window_range(c, width)) {
+					for (const T& x : window)
+						sum += x.value;
+				}
+				return sum;
+			}
+		);
+	}
+	// collecting an adapter into a vector: appending reallocates along the way, to
+	// allocates once and copies whole subranges
+	run("to<vector>", category, sizeof(T), working_set, n, n * sizeof(T),
+		[&] {
+			std::vector<T> collected;
+			for (const T& x : chained_range(a, b))
+				collected.push_back(x);
+			return std::uint64_t(collected.back().value);
+		},
+		[&] {
+			auto collected = to<std::vector<T>>(chained_range(a, b));
+			return std::uint64_t(collected.back().value);
+		}
+	);
+	if constexpr (sized) {
+		run("alternated", category, sizeof(T), working_set, n, n * sizeof(T),
+			[&] {
+				std::uint64_t sum = 0;
+				raw_for_each(a, b, [&](const T& x, const T& y) { sum += x.value; sum += y.value; });
+				return sum;
+			},
+			[&] {
+				std::uint64_t sum = 0;
+				for (const T& x : alternated_range(a, b))
+					sum += x.value;
+				return sum;
+			}
+		);
+	}
+	// transform -> filter -> zip against the single loop it should compile to
+	if constexpr (sized) {
+		run("pipeline", category, sizeof(T), working_set, n / 2, n * sizeof(T),
+			[&] {
+				std::uint64_t sum = 0;
+				if constexpr (is_vector_v<Container>) {
+					for (std::size_t i = 0, j = 0; i < a.size() and j < b.size(); ++i) {
+						const std::uint32_t x = a[i].value * 3;
+						if (x % 2 == 0)
+							sum += x * b[j++].value;
+					}
+				}
+				else {
+					auto j = b.begin();
+					for (auto i = a.begin(); i != a.end() and j != b.end(); ++i) {
+						const std::uint32_t x = i->value * 3;
+						if (x % 2 == 0)
+							sum += x * (j++)->value;
+					}
+				}
+				return sum;
+			},
+			[&] {
+				std::uint64_t sum = 0;
+				auto tripled = transformed_range(a, [](const T& x) { return x.value * 3; });
+				for (auto [x, y] : zipped_range(filtered_range(tripled, [](std::uint32_t x) { return x % 2 == 0; }), b))
+					sum += x * y.value;
+				return sum;
+			}
+		);
+	}
+	// a chain of chains is flattened, so this should match "chained"
+	run("chained^2", category, sizeof(T), working_set, n, n * sizeof(T),
+		[&] {
+			std::uint64_t sum = 0;
+			raw_for_each(a, [&](const T& x) { sum += x.value; });
+			raw_for_each(b, [&](const T& x) { sum += x.value; });
+			return sum;
+		},
+		[&] {
+			std::uint64_t sum = 0;
+			for (const T& x : chained_range(chained_range(a), chained_range(b)))
+				sum += x.value;
+			return sum;
+		}
+	);
+	// binary searches over sorted subranges, which jump and copy iterators at every step.
+	// A compact chained iterator copies a pointer, a position and an index instead of
+	// the begins and ends of every subrange
+	if constexpr (is_vector_v<Container>) {
+		std::vector<T> low(n / 4), high(n / 4);
+		for (std::size_t i = 0; i < n / 4; ++i) {
+			low[i].value = static_cast<std::uint32_t>(i);
+			high[i].value = static_cast<std::uint32_t>(n / 4 + i);
+		}
+		const std::size_t queries = n / 64;
+		const auto key = [](std::size_t value) {
+			T key{};
+			key.value = static_cast<std::uint32_t>(value);
+			return key;
+		};
+		run("compact srch", category, sizeof(T), working_set, queries, queries * sizeof(T),
+			[&] {
+				auto chain = chained_range(low, high);
+				std::uint64_t sum = 0;
+				for (std::size_t q = 0; q < queries; ++q)
+					sum += (*std::lower_bound(chain.begin(), chain.end(), key(q * 32), by_value<T>)).value;
+				return sum;
+			},
+			[&] {
+				auto chain = compact_chained_range(low, high);
+				std::uint64_t sum = 0;
+				for (std::size_t q = 0; q < queries; ++q)
+					sum += (*std::lower_bound(chain.begin(), chain.end(), key(q * 32), by_value<T>)).value;
+				return sum;
+			}
+		);
+	}
+	// two laps, so each lap reads half of the working set
+	run("ncycle", category, sizeof(T), working_set, n, n * sizeof(T),
+		[&] {
+			std::uint64_t sum = 0;
+			for (int lap = 0; lap < 2; ++lap)
+				raw_for_each(a, [&](const T& x) { sum += x.value; });
+			return sum;
+		},
+		[&] {
+			std::uint64_t sum = 0;
+			for (const T& x : ncycle_range(a, 2))
+				sum += x.value;
+			return sum;
+		}
+	);
+	run("ncycle sent", category, sizeof(T), working_set, n, n * sizeof(T),
+		[&] {
+			std::uint64_t sum = 0;
+			for (const T& x : ncycle_range(a, 2))
+				sum += x.value;
+			return sum;
+		},
+		[&] {
+			std::uint64_t sum = 0;
+			for (const T& x : sentinel_range(ncycle_range(a, 2)))
+				sum += x.value;
+			return sum;
+		}
+	);
+	run("cycle", category, sizeof(T), working_set, n, n * sizeof(T),
+		[&] {
+			std::uint64_t sum = 0;
+			for (int lap = 0; lap < 2; ++lap)
+				raw_for_each(a, [&](const T& x) { sum += x.value; });
+			return sum;
+		},
+		[&] {
+			std::uint64_t sum = 0;
+			auto cycle = cycle_range(a);
+			auto it = cycle.begin();
+			for (std::size_t i = 0; i < 2 * (n / 2); ++i, ++it)
+				sum += (*it).value;
+			return sum;
+		}
+	);
+
+	if constexpr (is_vector_v<Container>) {
+		constexpr std::size_t stride = 4;
+		run("strided", category, sizeof(T), working_set, n / stride, n / stride * sizeof(T),
+			[&] {
+				std::uint64_t sum = 0;
+				for (std::size_t i = 0; i < c.size(); i += stride)
+					sum += c[i].value;
+				return sum;
+			},
+			[&] {
+				std::uint64_t sum = 0;
+				for (const T& x : strided_range(c, 0, stride))
+					sum += x.value;
+				return sum;
+			}
+		);
+		// nested strided ranges are fused into one, so this should match "strided"
+		run("strided^2", category, sizeof(T), working_set, n / stride, n / stride * sizeof(T),
+			[&] {
+				std::uint64_t sum = 0;
+				for (std::size_t i = 0; i < c.size(); i += stride)
+					sum += c[i].value;
+				return sum;
+			},
+			[&] {
+				std::uint64_t sum = 0;
+				for (const T& x : strided_range(strided_range(c, 0, 2), 0, stride / 2))
+					sum += x.value;
+				return sum;
+			}
+		);
+		// visits every position of the interleaved sequence in a scattered order
+		constexpr std::size_t jump = 7919;
+		run("alternated[]", category, sizeof(T), working_set, n, n * sizeof(T),
+			[&] {
+				std::uint64_t sum = 0;
+				for (std::size_t i = 0, k = 0; i < n; ++i, k = (k + jump) % n)
+					sum += (k % 2 == 0 ? a : b)[k / 2].value;
+				return sum;
+			},
+			[&] {
+				std::uint64_t sum = 0;
+				auto interleaved = alternated_range(a, b);
+				auto first = interleaved.begin();
+				for (std::size_t i = 0, k = 0; i < n; ++i, k = (k + jump) % n)
+					sum += first[k].value;
+				return sum;
+			}
+		);
+		// square matrices stored in a and b. A column-major scan and a transpose
+		// through tiles against the plain loops, which miss once rows exceed the cache
+		const std::size_t side = static_cast<std::size_t>(std::sqrt(double(n / 2)));
+		auto ma = matrix_view(a, side, side), mb = matrix_view(b, side, side);
+		run("column scan", category, sizeof(T), working_set, side * side, side * side * sizeof(T),
+			[&] {
+				std::uint64_t sum = 0;
+				for (std::size_t col = 0; col < side; ++col) {
+					for (std::size_t row = 0; row < side; ++row)
+						sum += a[row * side + col].value;
+				}
+				return sum;
+			},
+			[&] {
+				std::uint64_t sum = 0;
+				for (auto tile : ma.tiles()) {
+					for (std::size_t col = 0; col < tile.cols(); ++col) {
+						for (const T& x : tile.column(col))
+							sum += x.value;
+					}
+				}
+				return sum;
+			}
+		);
+		run("transpose", category, sizeof(T), working_set, side * side, 2 * side * side * sizeof(T),
+			[&] {
+				for (std::size_t row = 0; row < side; ++row) {
+					for (std::size_t col = 0; col < side; ++col)
+						b[col * side + row] = a[row * side + col];
+				}
+				return std::uint64_t(b[side + 1].value);
+			},
+			[&] {
+				transpose(ma, mb);
+				return std::uint64_t(b[side + 1].value);
+			}
+		);
+		const T fill = c[n / 3];
+		run("repeat", category, sizeof(T), working_set, n, n * sizeof(T),
+			[&] {
+				for (std::size_t i = 0; i < c.size(); ++i)
+					c[i] = fill;
+				return std::uint64_t(c[n / 2].value);
+			},
+			[&] {
+				auto repeated = repeat_range(T(fill));
+				auto it = repeated.begin();
+				for (T& x : c) {
+					x = *it;
+					++it;
+				}
+				return std::uint64_t(c[n / 2].value);
+			}
+		);
+		// a counted repeat copied into the vector is a broadcast
+		run("repeat_n", category, sizeof(T), working_set, n, n * sizeof(T),
+			[&] {
+				for (std::size_t i = 0; i < c.size(); ++i)
+					c[i] = fill;
+				return std::uint64_t(c[n / 2].value);
+			},
+			[&] {
+				auto repeated = repeat_n_range(fill, c.size());
+				iterutils::copy(repeated.begin(), repeated.end(), c.begin());
+				return std::uint64_t(c[n / 2].value);
+			}
+		);
+		// software prefetching: a sequential scan is already covered by the hardware
+		// prefetchers, a stride of a page and a line defeats them
+		run("prefetch seq", category, sizeof(T), working_set, n, n * sizeof(T),
+			[&] {
+				std::uint64_t sum = 0;
+				for (const T& x : c)
+					sum += x.value;
+				return sum;
+			},
+			[&] {
+				std::uint64_t sum = 0;
+				for (const T& x : prefetched_range(c))
+					sum += x.value;
+				return sum;
+			}
+		);
+		constexpr std::size_t page_stride = (4096 + 64) / sizeof(T);
+		run("prefetch str", category, sizeof(T), working_set, n / page_stride, n / page_stride * sizeof(T),
+			[&] {
+				std::uint64_t sum = 0;
+				for (const T& x : strided_range(c, 0, page_stride))
+					sum += x.value;
+				return sum;
+			},
+			[&] {
+				std::uint64_t sum = 0;
+				for (const T& x : prefetched_range(strided_range(c, 0, page_stride)))
+					sum += x.value;
+				return sum;
+			}
+		);
+		run("prefetch chn", category, sizeof(T), working_set, n, n * sizeof(T),
+			[&] {
+				std::uint64_t sum = 0;
+				for (const T& x : chained_range(a, b))
+					sum += x.value;
+				return sum;
+			},
+			[&] {
+				std::uint64_t sum = 0;
+				for (const T& x : prefetched_range(chained_range(a, b)))
+					sum += x.value;
+				return sum;
+			}
+		);
+	}
+}
+
+// arithmetic progressions written into a float buffer. The baseline is the
+// accumulating loop that series_range replaces
+void bench_series(std::size_t working_set) {
+	const std::size_t n = working_set / sizeof(float);
+	std::vector<float> out(n);
+	const float start = 0.5f, step = 0.25f;
+	run("series", "random_access", sizeof(float), working_set, n, n * sizeof(float),
+		[&] {
+			float x = start;
+			for (std::size_t i = 0; i < n; ++i, x += step)
+				out[i] = x;
+			return std::uint64_t(out[n / 2]);
+		},
+		[&] {
+			series_range<float>(start, start + n * step, step).copy_to(out.data());
+			return std::uint64_t(out[n / 2]);
+		}
+	);
+}
+
+// float data read through uint32 indices. The working set is split between the data,
+// the indices and the output
+void bench_indexed(std::size_t working_set) {
+	const std::size_t n = working_set / (3 * sizeof(float));
+	std::vector<float> data(n), out(n);
+	for (std::size_t i = 0; i < n; ++i)
+		data[i] = static_cast<float>(i % 1021);
+	// a permutation, and a selection vector that keeps runs of 75 rows out of every 100
+	std::vector<std::uint32_t> permutation(n), selection;
+	std::iota(permutation.begin(), permutation.end(), 0);
+	std::shuffle(permutation.begin(), permutation.end(), std::mt19937(42));
+	for (std::uint32_t i = 0; i < n; ++i) {
+		if (i % 100 < 75)
+			selection.push_back(i);
+	}
+	run("indexed", "random_access", sizeof(float), working_set, n, 3 * n * sizeof(float),
+		[&] {
+			for (std::size_t i = 0; i < n; ++i)
+				out[i] = data[permutation[i]];
+			return std::uint64_t(out[n / 2]);
+		},
+		[&] {
+			indexed_range(data, permutation).gather(0, n, out.data());
+			return std::uint64_t(out[n / 2]);
+		}
+	);
+	run("indexed sum", "random_access", sizeof(float), working_set, n, 2 * n * sizeof(float),
+		[&] {
+			float sum = 0;
+			for (std::size_t i = 0; i < n; ++i)
+				sum += data[permutation[i]];
+			return std::uint64_t(sum);
+		},
+		[&] {
+			float sum = 0;
+			for (float x : indexed_range(data, permutation))
+				sum += x;
+			return std::uint64_t(sum);
+		}
+	);
+	const std::size_t selected = selection.size();
+	run("indexed runs", "random_access", sizeof(float), working_set, selected, 3 * selected * sizeof(float),
+		[&] {
+			for (std::size_t i = 0; i < selected; ++i)
+				out[i] = data[selection[i]];
+			return std::uint64_t(out[selected / 2]);
+		},
+		[&] {
+			indexed_range(data, selection).gather(0, selected, out.data(), gather_mode::sorted_runs);
+			return std::uint64_t(out[selected / 2]);
+		}
+	);
+}
+
+// sorted uint32 shards merged by value. The baselines are a two-way merge loop and the
+// usual priority queue of (value, shard) pairs
+void bench_merged(std::size_t working_set) {
+	const std::size_t n = working_set / sizeof(std::uint32_t);
+	auto make_shards = [n](std::size_t count) {
+		std::mt19937 rng(42);
+		std::vector<std::vector<std::uint32_t>> shards(count);
+		for (std::size_t i = 0; i < n; ++i)
+			shards[i % count].push_back(static_cast<std::uint32_t>(rng()));
+		for (auto& shard : shards)
+			std::sort(shard.begin(), shard.end());
+		return shards;
+	};
+	{
+		const auto shards = make_shards(2);
+		const auto& a = shards[0];
+		const auto& b = shards[1];
+		run("merged 2", "random_access", sizeof(std::uint32_t), working_set, n, n * sizeof(std::uint32_t),
+			[&] {
+				std::uint64_t sum = 0, rank = 0;
+				std::size_t i = 0, j = 0;
+				while (i < a.size() and j < b.size())
+					sum += ++rank * (b[j] < a[i] ? b[j++] : a[i++]);
+				while (i < a.size())
+					sum += ++rank * a[i++];
+				while (j < b.size())
+					sum += ++rank * b[j++];
+				return sum;
+			},
+			[&] {
+				std::uint64_t sum = 0, rank = 0;
+				for (std::uint32_t x : merged_range(a, b))
+					sum += ++rank * x;
+				return sum;
+			}
+		);
+	}
+	for (std::size_t count : {8, 64}) {
+		const auto shards = make_shards(count);
+		using entry = std::pair<std::uint32_t, std::size_t>;
+		run(count == 8 ? "merged 8" : "merged 64", "random_access", sizeof(std::uint32_t), working_set, n, n * sizeof(std::uint32_t),
+			[&] {
+				std::priority_queue<entry, std::vector<entry>, std::greater<entry>> queue;
+				std::vector<std::size_t> pos(count, 0);
+				for (std::size_t k = 0; k < count; ++k) {
+					if (!shards[k].empty())
+						queue.emplace(shards[k][0], k);
+				}
+				std::uint64_t sum = 0, rank = 0;
+				while (!queue.empty()) {
+					auto [x, k] = queue.top();
+					queue.pop();
+					sum += ++rank * x;
+					if (++pos[k] < shards[k].size())
+						queue.emplace(shards[k][pos[k]], k);
+				}
+				return sum;
+			},
+			[&] {
+				std::uint64_t sum = 0, rank = 0;
+				for (std::uint32_t x : dynamic_merged_range(shards))
+					sum += ++rank * x;
+				return sum;
+			}
+		);
+	}
+}
+
+// K channels of arithmetic samples interleaved into a buffer and split back, ie: stereo
+// 16 bit audio or xyz float sensor readings. The baselines are the element by element
+// loops, which compilers vectorize when K is a constant. The working set is split between
+// the channels and the buffer
+template<typename T, std::size_t K>
+void bench_interleave(std::size_t working_set) {
+	const std::size_t n = working_set / (2 * K * sizeof(T));
+	std::array<std::vector<T>, K> channels;
+	for (std::size_t i = 0; i < K; ++i) {
+		channels[i].resize(n);
+		for (std::size_t k = 0; k < n; ++k)
+			channels[i][k] = static_cast<T>((k * K + i) % 1021);
+	}
+	std::vector<T> buffer(n * K);
+	auto interleaved = std::apply([](auto&... channel) { return alternated_range(channel...); }, channels);
+	const std::string channel_count = std::to_string(K);
+	run(("interleave " + channel_count).c_str(), "random_access", sizeof(T), working_set, n * K, 2 * n * K * sizeof(T),
+		[&] {
+			for (std::size_t k = 0; k < n; ++k) {
+				for (std::size_t i = 0; i < K; ++i)
+					buffer[k * K + i] = channels[i][k];
+			}
+			return std::uint64_t(buffer[n * K / 2]);
+		},
+		[&] {
+			iterutils::copy(interleaved.begin(), interleaved.end(), buffer.data());
+			return std::uint64_t(buffer[n * K / 2]);
+		}
+	);
+	run(("deinterlv " + channel_count).c_str(), "random_access", sizeof(T), working_set, n * K, 2 * n * K * sizeof(T),
+		[&] {
+			for (std::size_t k = 0; k < n; ++k) {
+				for (std::size_t i = 0; i < K; ++i)
+					channels[i][k] = buffer[k * K + i];
+			}
+			return std::uint64_t(channels[K - 1][n / 2]);
+		},
+		[&] {
+			iterutils::copy(buffer.begin(), buffer.end(), interleaved.begin());
+			return std::uint64_t(channels[K - 1][n / 2]);
+		}
+	);
+}
+
+} // namespace
+
+int main(int argc, char** argv) {
+	if (argc > 1)
+		filter = argv[1];
+
+	// from L1 sized to DRAM sized data
+	const std::size_t working_sets[] = {16 << 10, 256 << 10, 4 << 20, 64 << 20};
+
+	print_header();
+	for (std::size_t working_set : working_sets) {
+		bench_adapters<std::vector<element<4>>>(working_set);
+		bench_adapters<std::vector<element<16>>>(working_set);
+		bench_adapters<std::vector<element<64>>>(working_set);
+		bench_series(working_set);
+		bench_indexed(working_set);
+		bench_merged(working_set);
+		bench_interleave<std::int16_t, 2>(working_set);
+		bench_interleave<float, 2>(working_set);
+		bench_interleave<float, 3>(working_set);
+		bench_interleave<float, 4>(working_set);
+		bench_interleave<double, 2>(working_set);
+	}
+	// node based containers only in the smaller sizes, the allocations dominate otherwise
+	for (std::size_t working_set : {working_sets[0], working_sets[1]}) {
+		bench_adapters<std::list<element<16>>>(working_set);
+		bench_adapters<std::forward_list<element<16>>>(working_set);
+	}
+}
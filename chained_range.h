@@ -4,18 +4,170 @@
 #include <array>
 #include <variant>
 #include <tuple>
+#include <vector>
 #include "util.h"
+#include "segmented.h"
+#include "instrument.h"
 
 namespace iterutils {
 
+namespace detail {
+
+template<typename T>
+struct is_variant : public std::false_type {};
+template<typename ...T>
+struct is_variant<std::variant<T...>> : public std::true_type {};
+template<typename T>
+constexpr bool is_variant_v = is_variant<std::remove_cv_t<std::remove_reference_t<T>>>::value;
+
+// chained iterators keep the position of every subrange in a chain_element. When all the
+// subranges have the same iterator type (ie: chaining vectors) it is that iterator, so
+// nothing has to be visited. Otherwise it is a variant where subrange k holds alternative k
+template<typename FirstIterator, typename ...Iterators>
+struct chain_element_impl {
+	using type = std::conditional_t<
+		std::conjunction_v<std::is_same<FirstIterator, Iterators>...>,
+		FirstIterator,
+		std::variant<FirstIterator, Iterators...>
+	>;
+};
+template<typename ...Iterators>
+using chain_element = typename chain_element_impl<Iterators...>::type;
+
+template<typename Element, std::size_t I, typename Iterator>
+Element make_chain_element(Iterator it) {
+	if constexpr (is_variant_v<Element>)
+		return Element(std::in_place_index_t<I>(), it);
+	else
+		return it;
+}
+template<std::size_t I, typename Element>
+decltype(auto) chain_get(Element& element) {
+	if constexpr (is_variant_v<Element>)
+		return std::get<I>(element);
+	else
+		return (element);
+}
+template<typename F, typename Element>
+decltype(auto) chain_visit(F&& f, Element& element) {
+	if constexpr (is_variant_v<Element>) {
+		ITERUTILS_COUNT(chained, visit);
+		return std::visit(std::forward<F>(f), element);
+	}
+	else
+		return f(element);
+}
+
+// pos_[k], begins_[k] and ends_[k] always hold the same alternative,
+// so two of them can be visited together without instantiating every combination
+template<typename F, typename A, typename B, std::size_t ...I>
+void visit_same_alternative(F&& f, A& a, B& b, std::index_sequence<I...>) {
+	(... || (a.index() == I and (f(std::get<I>(a), std::get<I>(b)), true)));
+}
+template<typename F, typename A, typename B>
+void visit_same_alternative(F&& f, A& a, B& b) {
+	if constexpr (is_variant_v<A>) {
+		ITERUTILS_COUNT(chained, visit);
+		visit_same_alternative(std::forward<F>(f), a, b, std::make_index_sequence<std::variant_size_v<std::remove_cv_t<A>>>());
+	}
+	else
+		f(a, b);
+}
+
+// Positioning shared by chained_iterator, which holds the bounds of its subranges, and
+// compact_chained_iterator, which points to the bounds kept by its range.
+// Subranges before index are finished, pos is the position inside subrange index and
+// subranges after it are still at their begin. The end has index == N and pos at the end
+// of the last subrange
+template<typename Element, std::size_t N>
+struct chain_cursor {
+	using bounds_type = std::array<Element, N>;
+
+	// moves from the end of subrange index to the next non empty one
+	static void settle(const bounds_type& begins, const bounds_type& ends, Element& pos, std::size_t& index) {
+		while (++index < N) {
+			pos = begins[index];
+			if (pos != ends[index])
+				return;
+		}
+	}
+	static void increment(const bounds_type& begins, const bounds_type& ends, Element& pos, std::size_t& index) {
+		chain_visit([](auto& it) { ++it; }, pos);
+		if (pos == ends[index])
+			settle(begins, ends, pos, index);
+	}
+	// steps back from the end or from the begin of a subrange, skipping empty ones
+	static void decrement(const bounds_type& begins, const bounds_type& ends, Element& pos, std::size_t& index) {
+		if (index == N or pos == begins[index]) {
+			do --index; while (begins[index] == ends[index]);
+			pos = ends[index];
+		}
+		chain_visit([](auto& it) { --it; }, pos);
+	}
+	template<typename Difference>
+	static void advance(const bounds_type& begins, const bounds_type& ends, Element& pos, std::size_t& index, Difference n) {
+		if (n >= 0) {
+			while (index < N) {
+				Difference left = 0;
+				visit_same_alternative([&left](auto& pos, const auto& end) { left = end - pos; }, pos, ends[index]);
+				if (n < left) {
+					chain_visit([n](auto& pos) { pos += n; }, pos);
+					return;
+				}
+				n -= left;
+				pos = ends[index];
+				if (++index < N)
+					pos = begins[index];
+			}
+			return;
+		}
+		for (n = -n; n > 0;) {
+			if (index < N) {
+				Difference before = 0;
+				visit_same_alternative([&before](auto& pos, const auto& begin) { before = pos - begin; }, pos, begins[index]);
+				if (n <= before) {
+					chain_visit([n](auto& pos) { pos -= n; }, pos);
+					return;
+				}
+				n -= before;
+			}
+			--index;
+			pos = ends[index];
+		}
+	}
+	// distance from the begin of the first subrange, O(N)
+	template<typename Difference>
+	static Difference position(const bounds_type& begins, const bounds_type& ends, const Element& pos, std::size_t index) {
+		Difference position = 0;
+		for (std::size_t k = 0; k < index; ++k)
+			visit_same_alternative([&position](auto& end, const auto& begin) { position += end - begin; }, ends[k], begins[k]);
+		if (index < N)
+			visit_same_alternative([&position](auto& pos, const auto& begin) { position += pos - begin; }, pos, begins[index]);
+		return position;
+	}
+	// once index tells the end apart, positions are only compared inside a subrange
+	static bool equal(const Element& a, std::size_t i, const Element& b, std::size_t j) {
+		return i == j and (i == N or a == b);
+	}
+	static bool less(const Element& a, std::size_t i, const Element& b, std::size_t j) {
+		return i < j or (i == j and i < N and a < b);
+	}
+};
+
+} // namespace detail
+
+// Marks the end of a chain. Iterators past their last subrange have reached it, so
+// comparing against it reads the subrange index only, and making it costs nothing
+// where chained_end fills the begins and ends of every subrange
+struct chained_sentinel {};
+
 template<typename Tag, typename ...Iterators>
 class chained_iterator {};
 
 template<typename Tag, typename ...Iterators>
 chained_iterator<Tag, Iterators...>& operator++(chained_iterator<Tag, Iterators...>& it) {
-	std::visit([](auto& it) { ++it; }, it.pos_[it.index_]);
-	if (it.index_ < sizeof...(Iterators) and it.pos_[it.index_] == it.ends_[it.index_])
-		++it.index_;
+	ITERUTILS_COUNT(chained, increment);
+	chained_iterator<Tag, Iterators...>::cursor::increment(it.begins_, it.ends_, it.pos_, it.index_);
 	return it;
 }
 template<typename Tag, typename ...Iterators>
@@ -26,9 +178,8 @@ chained_iterator<Tag, Iterators...> operator++(chained_iterator<Tag, Iterators..
 }
 template<typename Tag, typename ...Iterators>
 chained_iterator<Tag, Iterators...>& operator--(chained_iterator<Tag, Iterators...>& it) {
-	if (it.pos_[it.index_] == it.begins_[it.index_])
-		--it.index_;
-	std::visit([](auto& it) { --it; }, it.pos_[it.index_]);
+	ITERUTILS_COUNT(chained, increment);
+	chained_iterator<Tag, Iterators...>::cursor::decrement(it.begins_, it.ends_, it.pos_, it.index_);
 	return it;
 }
 template<typename Tag, typename ...Iterators>
@@ -40,12 +191,9 @@ chained_iterator<Tag, Iterators...> operator--(chained_iterator<Tag, Iterators..
 template<typename Tag, typename ...Iterators>
 chained_iterator<Tag, Iterators...>&
 operator+=(chained_iterator<Tag, Iterators...>& it, typename chained_iterator<Tag, Iterators...>::difference_type n) {
-	while (n > it.ends_[it.index_] - it.pos_[it.index_]) {
-		n -= it.ends_[it.index_] - it.pos_[it.index_];
-		it.pos_[it.index_] = it.ends_[it.index_];
-		++it.index_;
-	}
-	it.pos_[it.index_] += n;
+	ITERUTILS_COUNT(chained, jump);
+	chained_iterator<Tag, Iterators...>::cursor::advance(it.begins_, it.ends_, it.pos_, it.index_, n);
+	return it;
 }
 template<typename Tag, typename ...Iterators>
 chained_iterator<Tag, Iterators...>
@@ -56,12 +204,9 @@ operator+(const chained_iterator<Tag, Iterators...>& it, typename chained_iterat
 template<typename Tag, typename ...Iterators>
 chained_iterator<Tag, Iterators...>&
 operator-=(chained_iterator<Tag, Iterators...>& it, typename chained_iterator<Tag, Iterators...>::difference_type n) {
-	while (n > it.pos_[it.index_] - it.begins_[it.index_]) {
-		n -= it.pos_[it.index_] - it.begins_[it.index_];
-		it.pos_[it.index_] = it.begins_[it.index_];
-		--it.index_;
-	}
-	it.pos_[it.index_] -= n;
+	ITERUTILS_COUNT(chained, jump);
+	chained_iterator<Tag, Iterators...>::cursor::advance(it.begins_, it.ends_, it.pos_, it.index_, -n);
+	return it;
 }
 template<typename Tag, typename ...Iterators>
 chained_iterator<Tag, Iterators...>
@@ -70,6 +215,9 @@ operator-(const chained_iterator<Tag, Iterators...>& it, typename chained_iterat
 	return (copy -= n);
 }
 
+// Subranges before index_ are finished, pos_ is the position inside subrange index_
+// and subranges after it are still at their begin. The end iterator has index_ == N
+// and pos_ at the end of the last subrange
 template<typename ...Iterators>
 class chained_iterator<std::input_iterator_tag, Iterators...> {
 public:
@@ -80,33 +228,48 @@ public:
 	using iterator_category = std::input_iterator_tag;
 
 	template<std::size_t ...I>
-	chained_iterator(std::index_sequence<I...>, Iterators... pos, Iterators... ends, std::size_t index)
-		: pos_{element_type(std::in_place_index_t<I>(), pos)...},
-		ends_{element_type(std::in_place_index_t<I>(), ends)...},
+	chained_iterator(std::index_sequence<I...>, Iterators... begins, Iterators... ends, std::size_t index)
+		: begins_{detail::make_chain_element<element_type, I>(begins)...},
+		ends_{detail::make_chain_element<element_type, I>(ends)...},
+		pos_(index < sizeof...(Iterators) ? begins_[index] : ends_[sizeof...(Iterators)-1]),
 		index_(index) {
+		if (index_ < sizeof...(Iterators) and pos_ == ends_[index_])
+			cursor::settle(begins_, ends_, pos_, index_);
 	}
-	chained_iterator(Iterators... pos, Iterators... ends, std::size_t index=0)
-		: chained_iterator(std::index_sequence_for<Iterators...>(), pos..., ends..., index) {
+	chained_iterator(Iterators... begins, Iterators... ends, std::size_t index=0)
+		: chained_iterator(std::index_sequence_for<Iterators...>(), begins..., ends..., index) {
 	}
-	chained_iterator(const chained_iterator& other) = delete;
-	chained_iterator() = delete;
-
+	chained_iterator(const chained_iterator& other) = default;
 	friend chained_iterator& operator++<iterator_category, Iterators...>(chained_iterator&);
+	template<typename, typename> friend struct segmented_iterator_traits;
+	template<typename...> friend class chained_range;
+	template<typename...> friend class compact_chained_range;
 
 	reference operator*() const {
-		return *std::visit([](auto&& it) { return it; }, pos_[index_]);
+		ITERUTILS_COUNT(chained, dereference);
+		return detail::chain_visit([](auto&& it) -> reference { return *it; }, pos_);
 	}
 	bool operator!=(const chained_iterator& other) const {
-		return pos_[index_] != other.pos_[other.index_];
+		ITERUTILS_COUNT(chained, compare);
+		return !cursor::equal(pos_, index_, other.pos_, other.index_);
 	}
 	bool operator==(const chained_iterator& other) const {
-		return pos_[index_] == other.pos_[other.index_];
+		ITERUTILS_COUNT(chained, compare);
+		return cursor::equal(pos_, index_, other.pos_, other.index_);
 	}
+	friend bool operator==(const chained_iterator& it, chained_sentinel) { ITERUTILS_COUNT(chained, compare); return it.index_ == sizeof...(Iterators); }
+	friend bool operator!=(const chained_iterator& it, chained_sentinel) { ITERUTILS_COUNT(chained, compare); return it.index_ != sizeof...(Iterators); }
+	friend bool operator==(chained_sentinel, const chained_iterator& it) { return it == chained_sentinel(); }
+	friend bool operator!=(chained_sentinel, const chained_iterator& it) { return it != chained_sentinel(); }
 
 protected:
-	using element_type = std::variant<Iterators...>;
-	std::array<element_type, sizeof...(Iterators)> pos_;
+	chained_iterator() = default;
+
+	using element_type = detail::chain_element<Iterators...>;
+	using cursor = detail::chain_cursor<element_type, sizeof...(Iterators)>;
+	std::array<element_type, sizeof...(Iterators)> begins_;
 	std::array<element_type, sizeof...(Iterators)> ends_;
+	element_type pos_;
 	std::size_t index_;
 };
 
@@ -116,8 +279,8 @@ class chained_iterator<std::forward_iterator_tag, Iterators...>
 public:
 	using iterator_category = std::forward_iterator_tag;
 
-	chained_iterator(Iterators... pos, Iterators... ends, std::size_t index=0)
-		: chained_iterator<std::input_iterator_tag, Iterators...>(std::index_sequence_for<Iterators...>(), pos..., ends..., index) {
+	chained_iterator(Iterators... begins, Iterators... ends, std::size_t index=0)
+		: chained_iterator<std::input_iterator_tag, Iterators...>(std::index_sequence_for<Iterators...>(), begins..., ends..., index) {
 	}
 	chained_iterator(const chained_iterator& other) = default;
 	chained_iterator() = default;
@@ -134,14 +297,7 @@ class chained_iterator<std::bidirectional_iterator_tag, Iterators...>
 public:
 	using iterator_category = std::bidirectional_iterator_tag;
 
-	template<std::size_t ...I>
-	chained_iterator(std::index_sequence<I...>, Iterators... pos, Iterators... ends, std::size_t index)
-		: chained_iterator<std::forward_iterator_tag, Iterators...>(pos..., ends..., index),
-		begins_{typename chained_iterator<std::forward_iterator_tag, Iterators...>::element_type(std::in_place_index_t<I>(), pos)...} {
-	}
-	chained_iterator(Iterators... pos, Iterators... ends, std::size_t index=0)
-		: chained_iterator(std::index_sequence_for<Iterators...>(), pos..., ends..., index) {
-	}
+	using chained_iterator<std::forward_iterator_tag, Iterators...>::chained_iterator;
 	chained_iterator(const chained_iterator& other) = default;
 	chained_iterator() = default;
 
@@ -151,17 +307,13 @@ public:
 	// bidirectional iterator operators
 	friend chained_iterator& operator--<iterator_category, Iterators...>(chained_iterator&);
 	friend chained_iterator  operator--<iterator_category, Iterators...>(chained_iterator&, int);
-protected:
-	std::array<
-		typename chained_iterator<std::forward_iterator_tag, Iterators...>::element_type,
-		sizeof...(Iterators)
-	> begins_;
 };
 
 template<typename ...Iterators>
 class chained_iterator<std::random_access_iterator_tag, Iterators...>
 : public chained_iterator<std::bidirectional_iterator_tag, Iterators...> {
 public:
+	using reference = typename chained_iterator<std::bidirectional_iterator_tag, Iterators...>::reference;
 	using difference_type = typename chained_iterator<std::bidirectional_iterator_tag, Iterators...>::difference_type;
 	using iterator_category = std::random_access_iterator_tag;
 
@@ -178,17 +330,34 @@ public:
 	friend chained_iterator& operator-=<iterator_category, Iterators...>(chained_iterator&,       difference_type);
 	friend chained_iterator  operator- <iterator_category, Iterators...>(const chained_iterator&, difference_type);
 
+	difference_type operator-(const chained_iterator& other) const {
+		ITERUTILS_COUNT(chained, jump);
+		return _position() - other._position();
+	}
+	reference operator[](difference_type n) const {
+		return *(*this + n);
+	}
 	bool operator<(const chained_iterator& other) const {
-		return (this->index_ < other.index_) or (this->index_ == other.index_ and this->pos_[this->index_] < other.pos_[other.index_]);
+		ITERUTILS_COUNT(chained, compare);
+		return cursor::less(this->pos_, this->index_, other.pos_, other.index_);
 	}
 	bool operator<=(const chained_iterator& other) const {
-		return (this->index_ < other.index_) or (this->index_ == other.index_ and this->pos_[this->index_] <= other.pos_[other.index_]);
+		ITERUTILS_COUNT(chained, compare);
+		return !cursor::less(other.pos_, other.index_, this->pos_, this->index_);
 	}
 	bool operator>(const chained_iterator& other) const {
-		return (this->index_ > other.index_) or (this->index_ == other.index_ and this->pos_[this->index_] > other.pos_[other.index_]);
+		ITERUTILS_COUNT(chained, compare);
+		return cursor::less(other.pos_, other.index_, this->pos_, this->index_);
 	}
 	bool operator>=(const chained_iterator& other) const {
-		return (this->index_ > other.index_) or (this->index_ == other.index_ and this->pos_[this->index_] >= other.pos_[other.index_]);
+		ITERUTILS_COUNT(chained, compare);
+		return !cursor::less(this->pos_, this->index_, other.pos_, other.index_);
+	}
+private:
+	using typename chained_iterator<std::input_iterator_tag, Iterators...>::cursor;
+
+	difference_type _position() const {
+		return cursor::template position<difference_type>(this->begins_, this->ends_, this->pos_, this->index_);
 	}
 };
 template<typename ...Iterators>
@@ -203,26 +372,124 @@ detail::specialize_iterator_from_iterables<chained_iterator, Iterables...> chain
 }
 template<typename ...Iterables>
 detail::specialize_iterator_from_iterables<chained_iterator, Iterables...> chained_end(Iterables&... iterables) {
-	return {std::end(iterables)..., std::end(iterables)..., sizeof...(Iterables)};
+	return {std::begin(iterables)..., std::end(iterables)..., sizeof...(Iterables)};
 }
 
+template<typename ...Iterables>
+class chained_range;
+
+namespace detail {
+
+// the subranges a chain iterates over, with nested chained_ranges replaced by their own
+// subranges. A chain of chains has a single flat iterator, so it costs as much as one chain
+template<typename Iterable>
+struct chain_leaves {
+	using type = std::tuple<Iterable&>;
+};
+template<typename ...Iterables>
+struct chain_leaves<chained_range<Iterables...>> {
+	using type = decltype(std::tuple_cat(std::declval<typename chain_leaves<std::remove_reference_t<Iterables>>::type>()...));
+};
+template<typename ...Iterables>
+struct chain_leaves<const chained_range<Iterables...>> {
+	using type = decltype(std::tuple_cat(std::declval<typename chain_leaves<const std::remove_reference_t<Iterables>>::type>()...));
+};
+template<typename Iterable>
+using chain_leaves_t = typename chain_leaves<Iterable>::type;
+
+template<typename Leaves>
+struct chain_leaves_have_size;
+template<typename ...Leaves>
+struct chain_leaves_have_size<std::tuple<Leaves...>> : public std::conjunction<has_size<Leaves>...> {};
+template<typename Leaves>
+constexpr bool chain_leaves_have_size_v = chain_leaves_have_size<Leaves>::value;
+
+template<typename T>
+struct is_chained_range : public std::false_type {};
+template<typename ...Iterables>
+struct is_chained_range<chained_range<Iterables...>> : public std::true_type {};
+template<typename T>
+constexpr bool is_chained_range_v = is_chained_range<std::remove_cv_t<T>>::value;
+
+template<typename Leaves>
+struct chained_iterator_of;
+template<typename ...Leaves>
+struct chained_iterator_of<std::tuple<Leaves&...>> {
+	using type = specialize_iterator_from_iterables<chained_iterator, Leaves...>;
+};
+
+} // namespace detail
+
 template<typename ...Iterables>
 class chained_range {
 public:
-	using iterator = detail::specialize_iterator_from_iterables<chained_iterator, Iterables...>;
+	using iterator = typename detail::chained_iterator_of<detail::chain_leaves_t<chained_range>>::type;
 	using value_type = typename iterator::value_type;
 	using reference = typename iterator::reference;
 	using pointer = typename iterator::pointer;
 	chained_range (Iterables&&... iterables) : t(std::forward<Iterables>(iterables)...) {
 	}
-	iterator begin() { return std::apply(chained_begin<std::remove_reference_t<Iterables>...>, t); }
-	iterator end() { return std::apply(chained_end<std::remove_reference_t<Iterables>...>, t); }
+	iterator begin() { return std::apply([](auto&... leaves) { return chained_begin(leaves...); }, _leaves(*this)); }
+	iterator end() { return std::apply([](auto&... leaves) { return chained_end(leaves...); }, _leaves(*this)); }
+	chained_sentinel sentinel() const { return {}; }
 
-	std::enable_if<!is_infinite<chained_range>::value, size_t>
-	size() const { return _size(std::index_sequence_for<Iterables...>()); }
+	// the sum of the sizes of the subranges, when all of them know it
+	template<typename R = chained_range>
+	std::enable_if_t<!is_infinite<R>::value and detail::chain_leaves_have_size_v<detail::chain_leaves_t<R>>, size_t>
+	size() const { return _size(); }
+
+	// cuts fall at subrange boundaries when possible and inside a subrange otherwise.
+	// Only the subrange containing a cut is advanced through
+	friend std::vector<iterator_range<iterator>> split(chained_range& range, std::size_t parts) {
+		const std::array<std::size_t, leaf_count> sizes = range._sizes();
+		std::size_t n = 0;
+		for (std::size_t size : sizes)
+			n += size;
+		std::vector<iterator_range<iterator>> result;
+		result.reserve(parts);
+		iterator first = range.begin();
+		for (std::size_t i = 0, pos = 0; i < parts; ++i) {
+			pos += n / parts + (i < n % parts ? 1 : 0);
+			iterator last = range._iterator_at(pos, sizes);
+			result.emplace_back(first, last);
+			first = last;
+		}
+		return result;
+	}
 private:
-	template<std::size_t ...I>
-	std::size_t _size(std::index_sequence<I...>) const { return (std::size(std::get<I>(t)) + ...); }
+	template<typename...> friend class chained_range;
+	static constexpr std::size_t leaf_count = std::tuple_size_v<detail::chain_leaves_t<chained_range>>;
+
+	template<typename Self>
+	static detail::chain_leaves_t<Self> _leaves(Self& self) {
+		return std::apply([](auto&... iterables) { return std::tuple_cat(_leaves_of(iterables)...); }, self.t);
+	}
+	template<typename Iterable>
+	static detail::chain_leaves_t<Iterable> _leaves_of(Iterable& iterable) {
+		if constexpr (detail::is_chained_range_v<Iterable>)
+			return std::remove_cv_t<Iterable>::_leaves(iterable);
+		else
+			return detail::chain_leaves_t<Iterable>(iterable);
+	}
+
+	std::size_t _size() const { return std::apply([](auto&... leaves) { return (std::size_t(0) + ... + std::size(leaves)); }, _leaves(*this)); }
+	std::array<std::size_t, leaf_count> _sizes() const {
+		return std::apply([](auto&... leaves) { return std::array<std::size_t, leaf_count>{std::size_t(std::size(leaves))...}; }, _leaves(*this));
+	}
+
+	iterator _iterator_at(std::size_t pos, const std::array<std::size_t, leaf_count>& sizes) {
+		// skip the subranges that end at or before pos, including empty ones
+		std::size_t k = 0;
+		while (k < sizes.size() and pos >= sizes[k])
+			pos -= sizes[k++];
+		if (k == sizes.size())
+			return end();
+		iterator it = begin();
+		it.index_ = k;
+		it.pos_ = it.begins_[k];
+		detail::chain_visit([pos](auto& local) { std::advance(local, pos); }, it.pos_);
+		return it;
+	}
 	std::tuple<Iterables...> t;
 };
 template<typename ...Iterables>
@@ -231,6 +498,205 @@ chained_range(Iterables&&...) -> chained_range<Iterables...>;
 template<typename ...T>
 struct is_infinite<chained_range<T...>> : public std::disjunction<is_infinite<T>...> {};
 
+namespace detail {
+
+// the begins and ends of the subranges of a chain, shared by its compact iterators
+template<typename ...Iterators>
+struct chain_bounds {
+	using element_type = chain_element<Iterators...>;
+	std::array<element_type, sizeof...(Iterators)> begins;
+	std::array<element_type, sizeof...(Iterators)> ends;
+};
+
+} // namespace detail
+
+// Chained iterator that points to the bounds of the subranges kept by its
+// compact_chained_range instead of holding its own copy of them. It carries a pointer,
+// its position and the subrange index whatever the number of subranges, so copies stay
+// cheap (postfix operators, std algorithms). It is only valid while its range is alive
+template<typename ...Iterators>
+class compact_chained_iterator {
+public:
+	using value_type        = std::common_type_t<typename std::iterator_traits<Iterators>::value_type...>;
+	using reference         = std::add_lvalue_reference_t<value_type>;
+	using pointer           = std::add_pointer_t<value_type>;
+	using difference_type   = std::common_type_t<typename std::iterator_traits<Iterators>::difference_type...>;
+	using iterator_category = std::common_type_t<typename std::iterator_traits<Iterators>::iterator_category...>;
+	using bounds_type       = detail::chain_bounds<Iterators...>;
+
+	compact_chained_iterator() = default;
+	compact_chained_iterator(const bounds_type* bounds, std::size_t index)
+		: bounds_(bounds), pos_(index < N ? bounds->begins[index] : bounds->ends[N-1]), index_(index) {
+		if (index_ < N and pos_ == bounds_->ends[index_])
+			cursor::settle(bounds_->begins, bounds_->ends, pos_, index_);
+	}
+
+	reference operator*() const {
+		ITERUTILS_COUNT(chained, dereference);
+		return detail::chain_visit([](auto&& it) -> reference { return *it; }, pos_);
+	}
+	reference operator[](difference_type n) const { return *(*this + n); }
+
+	compact_chained_iterator& operator++() {
+		ITERUTILS_COUNT(chained, increment);
+		cursor::increment(bounds_->begins, bounds_->ends, pos_, index_);
+		return *this;
+	}
+	compact_chained_iterator operator++(int) { auto copy = *this; ++(*this); return copy; }
+	compact_chained_iterator& operator--() {
+		ITERUTILS_COUNT(chained, increment);
+		cursor::decrement(bounds_->begins, bounds_->ends, pos_, index_);
+		return *this;
+	}
+	compact_chained_iterator operator--(int) { auto copy = *this; --(*this); return copy; }
+
+	compact_chained_iterator& operator+=(difference_type n) {
+		ITERUTILS_COUNT(chained, jump);
+		cursor::advance(bounds_->begins, bounds_->ends, pos_, index_, n);
+		return *this;
+	}
+	compact_chained_iterator& operator-=(difference_type n) {
+		ITERUTILS_COUNT(chained, jump);
+		cursor::advance(bounds_->begins, bounds_->ends, pos_, index_, -n);
+		return *this;
+	}
+	compact_chained_iterator operator+(difference_type n) const { auto copy = *this; return copy += n; }
+	compact_chained_iterator operator-(difference_type n) const { auto copy = *this; return copy -= n; }
+	friend compact_chained_iterator operator+(difference_type n, const compact_chained_iterator& it) { return it + n; }
+	difference_type operator-(const compact_chained_iterator& other) const {
+		ITERUTILS_COUNT(chained, jump);
+		return cursor::template position<difference_type>(bounds_->begins, bounds_->ends, pos_, index_)
+			- cursor::template position<difference_type>(other.bounds_->begins, other.bounds_->ends, other.pos_, other.index_);
+	}
+
+	bool operator==(const compact_chained_iterator& other) const {
+		ITERUTILS_COUNT(chained, compare);
+		return cursor::equal(pos_, index_, other.pos_, other.index_);
+	}
+	bool operator!=(const compact_chained_iterator& other) const {
+		ITERUTILS_COUNT(chained, compare);
+		return !cursor::equal(pos_, index_, other.pos_, other.index_);
+	}
+	bool operator<(const compact_chained_iterator& other) const {
+		ITERUTILS_COUNT(chained, compare);
+		return cursor::less(pos_, index_, other.pos_, other.index_);
+	}
+	friend bool operator==(const compact_chained_iterator& it, chained_sentinel) { ITERUTILS_COUNT(chained, compare); return it.index_ == N; }
+	friend bool operator!=(const compact_chained_iterator& it, chained_sentinel) { ITERUTILS_COUNT(chained, compare); return it.index_ != N; }
+	friend bool operator==(chained_sentinel, const compact_chained_iterator& it) { return it == chained_sentinel(); }
+	friend bool operator!=(chained_sentinel, const compact_chained_iterator& it) { return it != chained_sentinel(); }
+	bool operator>(const compact_chained_iterator& other) const { return other < *this; }
+	bool operator<=(const compact_chained_iterator& other) const { return !(other < *this); }
+	bool operator>=(const compact_chained_iterator& other) const { return !(*this < other); }
+private:
+	static constexpr std::size_t N = sizeof...(Iterators);
+	using cursor = detail::chain_cursor<typename bounds_type::element_type, N>;
+
+	const bounds_type* bounds_ = nullptr;
+	typename bounds_type::element_type pos_;
+	std::size_t index_ = 0;
+};
+
+namespace detail {
+
+template<typename Iterator>
+struct compact_chained_iterator_of;
+template<typename Tag, typename ...Iterators>
+struct compact_chained_iterator_of<chained_iterator<Tag, Iterators...>> {
+	using type = compact_chained_iterator<Iterators...>;
+};
+
+} // namespace detail
+
+// chained_range whose iterators share the bounds of the subranges stored here. The
+// bounds are read once at construction, so begin() and end() are cheap and only read the
+// range. refresh() reads them again after a subrange reallocates or changes size, which
+// invalidates the iterators taken before
+template<typename ...Iterables>
+class compact_chained_range {
+	using chain_type = chained_range<Iterables...>;
+public:
+	using iterator = typename detail::compact_chained_iterator_of<typename chain_type::iterator>::type;
+	using value_type = typename iterator::value_type;
+	using reference = typename iterator::reference;
+	using pointer = typename iterator::pointer;
+
+	compact_chained_range(Iterables&&... iterables) : chain_(std::forward<Iterables>(iterables)...) {
+		refresh();
+	}
+	// the bounds of a copy point to the subranges of the copy
+	compact_chained_range(const compact_chained_range& other) : chain_(other.chain_) {
+		refresh();
+	}
+	compact_chained_range(compact_chained_range&& other) : chain_(std::move(other.chain_)) {
+		refresh();
+	}
+	compact_chained_range& operator=(const compact_chained_range& other) {
+		chain_ = other.chain_;
+		refresh();
+		return *this;
+	}
+	compact_chained_range& operator=(compact_chained_range&& other) {
+		chain_ = std::move(other.chain_);
+		refresh();
+		return *this;
+	}
+	iterator begin() const { return {&bounds_, 0}; }
+	iterator end() const { return {&bounds_, bounds_.ends.size()}; }
+	chained_sentinel sentinel() const { return {}; }
+
+	void refresh() {
+		const auto first = chain_.begin();
+		bounds_.begins = first.begins_;
+		bounds_.ends = first.ends_;
+	}
+
+	template<typename R = chain_type>
+	auto size() const -> decltype(std::declval<const R&>().size()) { return chain_.size(); }
+private:
+	chain_type chain_;
+	typename iterator::bounds_type bounds_;
+};
+template<typename ...Iterables>
+compact_chained_range(Iterables&&...) -> compact_chained_range<Iterables...>;
+
+template<typename ...T>
+struct is_infinite<compact_chained_range<T...>> : public is_infinite<chained_range<T...>> {};
+
+// every subrange is a segment
+template<typename Tag, typename ...Iterators>
+struct segmented_iterator_traits<chained_iterator<Tag, Iterators...>, std::enable_if_t<!std::is_same_v<Tag, std::input_iterator_tag>>> {
+	static constexpr bool is_segmented = true;
+
+	template<typename F>
+	static chained_iterator<Tag, Iterators...> for_each_segment(const chained_iterator<Tag, Iterators...>& first, const chained_iterator<Tag, Iterators...>& last, F&& f) {
+		chained_iterator<Tag, Iterators...> result = last;
+		const std::size_t stop = std::min(last.index_, sizeof...(Iterators)-1);
+		for (std::size_t k = first.index_; k <= stop; ++k) {
+			if (_visit_segment(k, first, last, f, result, std::index_sequence_for<Iterators...>()))
+				break;
+		}
+		return result;
+	}
+private:
+	template<typename F, std::size_t ...I>
+	static bool _visit_segment(std::size_t k, const chained_iterator<Tag, Iterators...>& first, const chained_iterator<Tag, Iterators...>& last, F& f, chained_iterator<Tag, Iterators...>& result, std::index_sequence<I...>) {
+		return (... || (k == I and _segment<I>(first, last, f, result)));
+	}
+	template<std::size_t I, typename F>
+	static bool _segment(const chained_iterator<Tag, Iterators...>& first, const chained_iterator<Tag, Iterators...>& last, F& f, chained_iterator<Tag, Iterators...>& result) {
+		auto local_first = I == first.index_ ? detail::chain_get<I>(first.pos_) : detail::chain_get<I>(first.begins_[I]);
+		auto local_last = I == last.index_ ? detail::chain_get<I>(last.pos_) : detail::chain_get<I>(first.ends_[I]);
+		auto local = f(local_first, local_last);
+		if (local == local_last)
+			return false;
+		result = first;
+		result.pos_ = detail::make_chain_element<typename chained_iterator<Tag, Iterators...>::element_type, I>(local);
+		result.index_ = I;
+		return true;
+	}
+};
+
 } // namespace iterutils
 
 #endif
@@ -0,0 +1,176 @@
+#ifndef _ITERUTILS_CHUNKED_RANGE_H_
+#define _ITERUTILS_CHUNKED_RANGE_H_
+
+#include <algorithm>
+#include <cstddef>
+#include <iterator>
+#include <type_traits>
+#include <utility>
+#include "util.h"
+#include "instrument.h"
+
+namespace iterutils {
+
+namespace detail {
+
+// moves first up to n positions forward without passing last
+template<typename Iterator>
+Iterator next_at_most(Iterator first, typename std::iterator_traits<Iterator>::difference_type n, const Iterator& last) {
+	for (; n > 0 and first != last; --n)
+		++first;
+	return first;
+}
+
+} // namespace detail
+
+// Iterates over consecutive chunks of n elements of a range as iterator_ranges, the last
+// chunk holds what remains. Chunks are views: nothing is copied and writing through them
+// writes the range.
+// The primary template walks every chunk once to find its end, so it works over forward
+// and infinite ranges
+template<typename Tag, typename Iterator>
+class chunked_iterator {
+public:
+	using value_type        = iterator_range<Iterator>;
+	using reference         = iterator_range<Iterator>;
+	using pointer           = void;
+	using difference_type   = typename std::iterator_traits<Iterator>::difference_type;
+	using iterator_category = std::forward_iterator_tag;
+
+	chunked_iterator() = default;
+	chunked_iterator(Iterator first, Iterator end, difference_type n)
+		: first_(first), last_(detail::next_at_most(first, n, end)), end_(end), n_(n) {
+	}
+
+	reference operator*() const { ITERUTILS_COUNT(chunked, dereference); return {first_, last_}; }
+
+	chunked_iterator& operator++() {
+		ITERUTILS_COUNT(chunked, increment);
+		first_ = last_;
+		last_ = detail::next_at_most(first_, n_, end_);
+		return *this;
+	}
+	chunked_iterator operator++(int) {
+		auto copy = *this;
+		++(*this);
+		return copy;
+	}
+
+	bool operator==(const chunked_iterator& other) const { ITERUTILS_COUNT(chunked, compare); return first_ == other.first_; }
+	bool operator!=(const chunked_iterator& other) const { ITERUTILS_COUNT(chunked, compare); return first_ != other.first_; }
+private:
+	Iterator first_;
+	Iterator last_;
+	Iterator end_;
+	difference_type n_ = 1;
+};
+
+// Over random access ranges the iterator keeps the index of its chunk, so that chunk k is
+// [begin + k*n, begin + min((k+1)*n, size)) and every operation is O(1)
+template<typename Iterator>
+class chunked_iterator<std::random_access_iterator_tag, Iterator> {
+public:
+	using value_type        = iterator_range<Iterator>;
+	using reference         = iterator_range<Iterator>;
+	using pointer           = void;
+	using difference_type   = typename std::iterator_traits<Iterator>::difference_type;
+	using iterator_category = std::random_access_iterator_tag;
+
+	chunked_iterator() = default;
+	chunked_iterator(Iterator begin, difference_type size, difference_type n, difference_type index)
+		: begin_(begin), size_(size), n_(n), index_(index) {
+	}
+
+	reference operator*() const { ITERUTILS_COUNT(chunked, dereference); return _chunk(index_); }
+	reference operator[](difference_type k) const { ITERUTILS_COUNT(chunked, jump); ITERUTILS_COUNT(chunked, dereference); return _chunk(index_ + k); }
+
+	chunked_iterator& operator++() { ITERUTILS_COUNT(chunked, increment); ++index_; return *this; }
+	chunked_iterator& operator--() { ITERUTILS_COUNT(chunked, increment); --index_; return *this; }
+	chunked_iterator operator++(int) { ITERUTILS_COUNT(chunked, increment); auto copy = *this; ++index_; return copy; }
+	chunked_iterator operator--(int) { ITERUTILS_COUNT(chunked, increment); auto copy = *this; --index_; return copy; }
+	chunked_iterator& operator+=(difference_type k) { ITERUTILS_COUNT(chunked, jump); index_ += k; return *this; }
+	chunked_iterator& operator-=(difference_type k) { ITERUTILS_COUNT(chunked, jump); index_ -= k; return *this; }
+	chunked_iterator operator+(difference_type k) const { auto copy = *this; return copy += k; }
+	chunked_iterator operator-(difference_type k) const { auto copy = *this; return copy -= k; }
+	friend chunked_iterator operator+(difference_type k, const chunked_iterator& it) { return it + k; }
+	difference_type operator-(const chunked_iterator& other) const { ITERUTILS_COUNT(chunked, jump); return index_ - other.index_; }
+
+	bool operator==(const chunked_iterator& other) const { ITERUTILS_COUNT(chunked, compare); return index_ == other.index_; }
+	bool operator!=(const chunked_iterator& other) const { ITERUTILS_COUNT(chunked, compare); return index_ != other.index_; }
+	bool operator< (const chunked_iterator& other) const { ITERUTILS_COUNT(chunked, compare); return index_ <  other.index_; }
+	bool operator<=(const chunked_iterator& other) const { ITERUTILS_COUNT(chunked, compare); return index_ <= other.index_; }
+	bool operator> (const chunked_iterator& other) const { ITERUTILS_COUNT(chunked, compare); return index_ >  other.index_; }
+	bool operator>=(const chunked_iterator& other) const { ITERUTILS_COUNT(chunked, compare); return index_ >= other.index_; }
+private:
+	iterator_range<Iterator> _chunk(difference_type k) const {
+		const difference_type first = k * n_;
+		return {begin_ + first, begin_ + std::min(first + n_, size_)};
+	}
+
+	Iterator begin_;
+	difference_type size_ = 0;
+	difference_type n_ = 1;
+	difference_type index_ = 0;
+};
+
+// Chunks of n elements of a range, ie: blocks of rows that fit in a cache level.
+// Random access ranges give random access chunk iterators, any other range (and infinite
+// ones, whose size is unknown) forward iterators
+template<typename Iterable>
+class chunked_range {
+	using base_iterator = decltype(std::begin(std::declval<Iterable&>()));
+	using tag = std::conditional_t<
+		std::is_base_of_v<std::random_access_iterator_tag, typename std::iterator_traits<base_iterator>::iterator_category> and
+		!is_infinite_v<Iterable>,
+		std::random_access_iterator_tag,
+		std::forward_iterator_tag
+	>;
+	static_assert(std::is_base_of_v<std::forward_iterator_tag, typename std::iterator_traits<base_iterator>::iterator_category>,
+		"chunks are views, so the range must be multipass");
+public:
+	using iterator        = chunked_iterator<tag, base_iterator>;
+	using value_type      = typename iterator::value_type;
+	using pointer         = typename iterator::pointer;
+	using reference       = typename iterator::reference;
+	using difference_type = typename iterator::difference_type;
+	using size_type       = std::size_t;
+
+	// n must be positive
+	chunked_range(Iterable&& iterable, std::size_t n) : iterable_(std::forward<Iterable>(iterable)), n_(static_cast<difference_type>(n)) {
+	}
+	iterator begin() {
+		if constexpr (std::is_same_v<tag, std::random_access_iterator_tag>)
+			return {std::begin(iterable_), _size(), n_, 0};
+		else
+			return {std::begin(iterable_), std::end(iterable_), n_};
+	}
+	iterator end() {
+		if constexpr (std::is_same_v<tag, std::random_access_iterator_tag>) {
+			const difference_type size = _size();
+			return {std::begin(iterable_), size, n_, (size + n_ - 1) / n_};
+		}
+		else
+			return {std::end(iterable_), std::end(iterable_), n_};
+	}
+
+	// the number of chunks, when the underlying range knows its size
+	template<typename R = chunked_range>
+	std::enable_if_t<!is_infinite<R>::value and detail::has_size_v<Iterable>, size_t>
+	size() const {
+		const std::size_t n = static_cast<std::size_t>(n_);
+		return (std::size(iterable_) + n - 1) / n;
+	}
+private:
+	difference_type _size() { return std::end(iterable_) - std::begin(iterable_); }
+
+	Iterable iterable_;
+	difference_type n_;
+};
+template<typename Iterable> chunked_range(Iterable&&, std::size_t) -> chunked_range<Iterable>;
+
+template<typename Iterable>
+struct is_infinite<chunked_range<Iterable>> : public is_infinite<std::remove_reference_t<Iterable>> {};
+
+} // namespace iterutils
+
+#endif
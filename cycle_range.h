@@ -2,7 +2,10 @@
 #define _ITERUTILS_CYCLE_RANGE_H_
 
 #include <iterator>
+#include <type_traits>
 #include "util.h"
+#include "segmented.h"
+#include "instrument.h"
 
 namespace iterutils {
 
@@ -12,6 +15,7 @@ class cycle_iterator {};
 template<typename Tag, typename Iterator>
 cycle_iterator<Tag, Iterator>&
 operator++(cycle_iterator<Tag, Iterator>& it) {
+	ITERUTILS_COUNT(cycle, increment);
 	if (++it.it_ == it.end_)
 		it.it_ = it.begin_;
 	return it;
@@ -26,6 +30,7 @@ operator++(cycle_iterator<Tag, Iterator>& it, int) {
 template<typename Tag, typename Iterator>
 cycle_iterator<Tag, Iterator>&
 operator--(cycle_iterator<Tag, Iterator>& it) {
+	ITERUTILS_COUNT(cycle, increment);
 	if (it.it_ == it.begin_)
 		it.it_ = it.end_;
 	--it.it_;
@@ -41,6 +46,9 @@ operator--(cycle_iterator<Tag, Iterator>& it, int) {
 template<typename Tag, typename Iterator>
 cycle_iterator<Tag, Iterator>&
 operator+=(cycle_iterator<Tag, Iterator>& it, typename cycle_iterator<Tag, Iterator>::difference_type n) {
+	ITERUTILS_COUNT(cycle, jump);
+	if (n < 0)
+		return it -= -n;
 	it.it_ = it.begin_ + (n + (it.it_ - it.begin_)) % (it.end_ - it.begin_);
 	return it;
 }
@@ -53,7 +61,10 @@ operator+(const cycle_iterator<Tag, Iterator>& it, typename cycle_iterator<Tag,
 template<typename Tag, typename Iterator>
 cycle_iterator<Tag, Iterator>&
 operator-=(cycle_iterator<Tag, Iterator>& it, typename cycle_iterator<Tag, Iterator>::difference_type n) {
-	it.it_ = it.end_ - 1 -  ((it.end_ - it.it_) + n) % (it.end_ - it.begin_);
+	ITERUTILS_COUNT(cycle, jump);
+	if (n < 0)
+		return it += -n;
+	it.it_ = it.end_ - 1 - ((it.end_ - it.it_) - 1 + n) % (it.end_ - it.begin_);
 	return it;
 }
 template<typename Tag, typename Iterator>
@@ -80,12 +91,13 @@ public:
 	cycle_iterator(Iterator begin, Iterator end) : begin_(begin), end_(end), it_(begin) {}
 	cycle_iterator(Iterator begin, Iterator end, Iterator it) : begin_(begin), end_(end), it_(it) {}
 
-	reference operator*() const { return *it_; }
-	bool operator==(const cycle_iterator& other) const { return it_ == other.it_; }
-	bool operator!=(const cycle_iterator& other) const { return it_ != other.it_; }
+	reference operator*() const { ITERUTILS_COUNT(cycle, dereference); return *it_; }
+	bool operator==(const cycle_iterator& other) const { ITERUTILS_COUNT(cycle, compare); return it_ == other.it_; }
+	bool operator!=(const cycle_iterator& other) const { ITERUTILS_COUNT(cycle, compare); return it_ != other.it_; }
 
 	friend cycle_iterator& operator++<iterator_category, Iterator>(cycle_iterator&);
 	friend cycle_iterator operator++<iterator_category, Iterator>(cycle_iterator&, int);
+	template<typename, typename> friend struct segmented_iterator_traits;
 protected:
 	Iterator begin_;
 	Iterator end_;
@@ -124,10 +136,10 @@ public:
 	friend cycle_iterator& operator-=<iterator_category, Iterator>(cycle_iterator&,       difference_type);
 	friend cycle_iterator  operator- <iterator_category, Iterator>(const cycle_iterator&, difference_type);
 
-	bool operator< (const cycle_iterator& other) const { return this->it_ <  other.it_; }
-	bool operator<=(const cycle_iterator& other) const { return this->it_ <= other.it_; }
-	bool operator> (const cycle_iterator& other) const { return this->it_ >  other.it_; }
-	bool operator>=(const cycle_iterator& other) const { return this->it_ >= other.it_; }
+	bool operator< (const cycle_iterator& other) const { ITERUTILS_COUNT(cycle, compare); return this->it_ <  other.it_; }
+	bool operator<=(const cycle_iterator& other) const { ITERUTILS_COUNT(cycle, compare); return this->it_ <= other.it_; }
+	bool operator> (const cycle_iterator& other) const { ITERUTILS_COUNT(cycle, compare); return this->it_ >  other.it_; }
+	bool operator>=(const cycle_iterator& other) const { ITERUTILS_COUNT(cycle, compare); return this->it_ >= other.it_; }
 };
 
 template<typename Iterator>
@@ -166,6 +178,135 @@ template<typename Iterable> cycle_range(Iterable&&) -> cycle_range<Iterable>;
 template<typename ...T>
 struct is_infinite<cycle_range<T...>> : public std::true_type {};
 
+// Cycle iterator that points to the bounds kept by its compact_cycle_range instead of
+// holding its own copy of them, so it carries a pointer and its position.
+// It is only valid while its range is alive
+template<typename Iterator>
+class compact_cycle_iterator {
+public:
+	using value_type        = typename std::iterator_traits<Iterator>::value_type;
+	using reference         = typename std::iterator_traits<Iterator>::reference;
+	using pointer           = typename std::iterator_traits<Iterator>::pointer;
+	using difference_type   = typename std::iterator_traits<Iterator>::difference_type;
+	using iterator_category = typename std::iterator_traits<Iterator>::iterator_category;
+	using bounds_type       = detail::lap_bounds<Iterator>;
+
+	static_assert(std::is_base_of_v<std::forward_iterator_tag, iterator_category>, "cycling needs a multipass iterator");
+
+	compact_cycle_iterator() = default;
+	compact_cycle_iterator(const bounds_type* bounds, Iterator it) : bounds_(bounds), it_(it) {}
+
+	reference operator*() const { ITERUTILS_COUNT(cycle, dereference); return *it_; }
+	reference operator[](difference_type n) const { return *(*this + n); }
+
+	compact_cycle_iterator& operator++() {
+		ITERUTILS_COUNT(cycle, increment);
+		if (++it_ == bounds_->end)
+			it_ = bounds_->begin;
+		return *this;
+	}
+	compact_cycle_iterator operator++(int) { auto copy = *this; ++(*this); return copy; }
+	compact_cycle_iterator& operator--() {
+		ITERUTILS_COUNT(cycle, increment);
+		if (it_ == bounds_->begin)
+			it_ = bounds_->end;
+		--it_;
+		return *this;
+	}
+	compact_cycle_iterator operator--(int) { auto copy = *this; --(*this); return copy; }
+	compact_cycle_iterator& operator+=(difference_type n) {
+		ITERUTILS_COUNT(cycle, jump);
+		if (n < 0)
+			return *this -= -n;
+		it_ = bounds_->begin + (n + (it_ - bounds_->begin)) % (bounds_->end - bounds_->begin);
+		return *this;
+	}
+	compact_cycle_iterator& operator-=(difference_type n) {
+		ITERUTILS_COUNT(cycle, jump);
+		if (n < 0)
+			return *this += -n;
+		it_ = bounds_->end - 1 - ((bounds_->end - it_) - 1 + n) % (bounds_->end - bounds_->begin);
+		return *this;
+	}
+	compact_cycle_iterator operator+(difference_type n) const { auto copy = *this; return copy += n; }
+	compact_cycle_iterator operator-(difference_type n) const { auto copy = *this; return copy -= n; }
+
+	bool operator==(const compact_cycle_iterator& other) const { ITERUTILS_COUNT(cycle, compare); return it_ == other.it_; }
+	bool operator!=(const compact_cycle_iterator& other) const { ITERUTILS_COUNT(cycle, compare); return it_ != other.it_; }
+	bool operator< (const compact_cycle_iterator& other) const { ITERUTILS_COUNT(cycle, compare); return it_ <  other.it_; }
+	bool operator<=(const compact_cycle_iterator& other) const { ITERUTILS_COUNT(cycle, compare); return it_ <= other.it_; }
+	bool operator> (const compact_cycle_iterator& other) const { ITERUTILS_COUNT(cycle, compare); return it_ >  other.it_; }
+	bool operator>=(const compact_cycle_iterator& other) const { ITERUTILS_COUNT(cycle, compare); return it_ >= other.it_; }
+private:
+	const bounds_type* bounds_ = nullptr;
+	Iterator it_;
+};
+
+// cycle_range whose iterators share the bounds of the range stored here, read at
+// construction. refresh() reads them again after the range reallocates or changes size,
+// which invalidates the iterators taken before
+template<typename Iterable>
+class compact_cycle_range {
+public:
+	using iterator = compact_cycle_iterator<typename std::remove_reference_t<Iterable>::iterator>;
+	using value_type = typename iterator::value_type;
+	using pointer = typename iterator::pointer;
+	using reference = typename iterator::reference;
+
+	compact_cycle_range(Iterable&& iterable) : iterable_(std::forward<Iterable>(iterable)) {
+		refresh();
+	}
+	// the bounds of a copy point to the range of the copy
+	compact_cycle_range(const compact_cycle_range& other) : iterable_(other.iterable_) {
+		refresh();
+	}
+	compact_cycle_range(compact_cycle_range&& other) : iterable_(std::forward<Iterable>(other.iterable_)) {
+		refresh();
+	}
+	compact_cycle_range& operator=(const compact_cycle_range& other) {
+		iterable_ = other.iterable_;
+		refresh();
+		return *this;
+	}
+	compact_cycle_range& operator=(compact_cycle_range&& other) {
+		iterable_ = std::forward<Iterable>(other.iterable_);
+		refresh();
+		return *this;
+	}
+	iterator begin() const { return {&bounds_, bounds_.begin}; }
+	iterator end() const { return {&bounds_, bounds_.end}; }
+
+	void refresh() { bounds_ = {std::begin(iterable_), std::end(iterable_)}; }
+private:
+	Iterable iterable_;
+	typename iterator::bounds_type bounds_;
+};
+template<typename Iterable> compact_cycle_range(Iterable&&) -> compact_cycle_range<Iterable>;
+
+template<typename ...T>
+struct is_infinite<compact_cycle_range<T...>> : public std::true_type {};
+
+// every lap over the underlying range is a segment. Laps are not counted, so
+// we need random access to know whether last lies ahead of first on the current lap
+template<typename Iterator>
+struct segmented_iterator_traits<cycle_iterator<std::random_access_iterator_tag, Iterator>> {
+	static constexpr bool is_segmented = true;
+
+	template<typename F>
+	static cycle_iterator<std::random_access_iterator_tag, Iterator> for_each_segment(const cycle_iterator<std::random_access_iterator_tag, Iterator>& first, const cycle_iterator<std::random_access_iterator_tag, Iterator>& last, F&& f) {
+		// cycle_end is never reached, so we keep lapping until f stops
+		for (Iterator local_first = first.it_; ; local_first = first.begin_) {
+			const bool last_lap = local_first <= last.it_ and last.it_ != first.end_;
+			Iterator local_last = last_lap ? last.it_ : first.end_;
+			Iterator local = f(local_first, local_last);
+			if (local != local_last)
+				return {first.begin_, first.end_, local};
+			if (last_lap)
+				return last;
+		}
+	}
+};
+
 } // namespace iterutils
 
 #endif
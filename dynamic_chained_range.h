@@ -0,0 +1,187 @@
+#ifndef _ITERUTILS_DYNAMIC_CHAINED_RANGE_H_
+#define _ITERUTILS_DYNAMIC_CHAINED_RANGE_H_
+
+#include <algorithm>
+#include <iterator>
+#include <memory>
+#include <vector>
+#include "util.h"
+#include "segmented.h"
+#include "instrument.h"
+
+namespace iterutils {
+
+namespace detail {
+
+// bounds of every segment plus a prefix sum of their sizes:
+// segment k holds the global positions [offsets[k], offsets[k+1])
+template<typename Iterator>
+struct dynamic_chain_index {
+	std::vector<Iterator> begins;
+	std::vector<Iterator> ends;
+	std::vector<std::size_t> offsets;
+};
+
+} // namespace detail
+
+template<typename Iterator>
+class dynamic_chained_iterator {
+public:
+	using value_type        = typename std::iterator_traits<Iterator>::value_type;
+	using reference         = typename std::iterator_traits<Iterator>::reference;
+	using pointer           = typename std::iterator_traits<Iterator>::pointer;
+	using difference_type   = typename std::iterator_traits<Iterator>::difference_type;
+	using iterator_category = std::random_access_iterator_tag;
+
+	static_assert(
+		std::is_base_of_v<std::random_access_iterator_tag, typename std::iterator_traits<Iterator>::iterator_category>,
+		"dynamic_chained_iterator requires random access segments"
+	);
+
+	dynamic_chained_iterator() = default;
+	dynamic_chained_iterator(const detail::dynamic_chain_index<Iterator>* index, std::size_t pos)
+	: index_(index), segment_(0), pos_(pos) {
+		_seek(pos);
+	}
+
+	reference operator*() const { ITERUTILS_COUNT(dynamic_chained, dereference); return *it_; }
+	reference operator[](difference_type n) const { return *(*this + n); }
+
+	dynamic_chained_iterator& operator++() {
+		ITERUTILS_COUNT(dynamic_chained, increment);
+		++it_;
+		if (++pos_ == index_->offsets[segment_+1]) {
+			// skip empty segments
+			do ++segment_; while (segment_ < _segments() and index_->offsets[segment_] == index_->offsets[segment_+1]);
+			if (segment_ < _segments())
+				it_ = index_->begins[segment_];
+		}
+		return *this;
+	}
+	dynamic_chained_iterator operator++(int) {
+		auto copy = *this;
+		++(*this);
+		return copy;
+	}
+	dynamic_chained_iterator& operator--() {
+		ITERUTILS_COUNT(dynamic_chained, increment);
+		if (segment_ == _segments() or pos_ == index_->offsets[segment_])
+			_seek(pos_-1);
+		else {
+			--it_;
+			--pos_;
+		}
+		return *this;
+	}
+	dynamic_chained_iterator operator--(int) {
+		auto copy = *this;
+		--(*this);
+		return copy;
+	}
+	dynamic_chained_iterator& operator+=(difference_type n) {
+		ITERUTILS_COUNT(dynamic_chained, jump);
+		_seek(pos_ + n);
+		return *this;
+	}
+	dynamic_chained_iterator& operator-=(difference_type n) {
+		ITERUTILS_COUNT(dynamic_chained, jump);
+		_seek(pos_ - n);
+		return *this;
+	}
+	dynamic_chained_iterator operator+(difference_type n) const {
+		auto copy = *this;
+		return copy += n;
+	}
+	friend dynamic_chained_iterator operator+(difference_type n, const dynamic_chained_iterator& it) {
+		return it + n;
+	}
+	dynamic_chained_iterator operator-(difference_type n) const {
+		auto copy = *this;
+		return copy -= n;
+	}
+	difference_type operator-(const dynamic_chained_iterator& other) const {
+		ITERUTILS_COUNT(dynamic_chained, jump);
+		return static_cast<difference_type>(pos_) - static_cast<difference_type>(other.pos_);
+	}
+
+	bool operator==(const dynamic_chained_iterator& other) const { ITERUTILS_COUNT(dynamic_chained, compare); return pos_ == other.pos_; }
+	bool operator!=(const dynamic_chained_iterator& other) const { ITERUTILS_COUNT(dynamic_chained, compare); return pos_ != other.pos_; }
+	bool operator< (const dynamic_chained_iterator& other) const { ITERUTILS_COUNT(dynamic_chained, compare); return pos_ <  other.pos_; }
+	bool operator<=(const dynamic_chained_iterator& other) const { ITERUTILS_COUNT(dynamic_chained, compare); return pos_ <= other.pos_; }
+	bool operator> (const dynamic_chained_iterator& other) const { ITERUTILS_COUNT(dynamic_chained, compare); return pos_ >  other.pos_; }
+	bool operator>=(const dynamic_chained_iterator& other) const { ITERUTILS_COUNT(dynamic_chained, compare); return pos_ >= other.pos_; }
+
+	template<typename, typename> friend struct segmented_iterator_traits;
+private:
+	std::size_t _segments() const { return index_->begins.size(); }
+
+	// O(1) when staying in the current segment, O(log K) otherwise
+	void _seek(std::size_t pos) {
+		pos_ = pos;
+		if (segment_ >= _segments() or pos < index_->offsets[segment_] or pos >= index_->offsets[segment_+1]) {
+			// first segment that ends after pos. This also skips empty segments
+			auto segment_end = std::upper_bound(index_->offsets.begin()+1, index_->offsets.end(), pos);
+			segment_ = segment_end - (index_->offsets.begin()+1);
+		}
+		if (segment_ < _segments())
+			it_ = index_->begins[segment_] + (pos - index_->offsets[segment_]);
+	}
+
+	const detail::dynamic_chain_index<Iterator>* index_ = nullptr;
+	std::size_t segment_ = 0;
+	std::size_t pos_ = 0;
+	Iterator it_;
+};
+
+// Concatenates a runtime sequence of random access ranges (ie: a vector of vectors)
+template<typename Iterable>
+class dynamic_chained_range {
+	using segment_reference = decltype(*std::begin(std::declval<std::remove_reference_t<Iterable>&>()));
+	using segment_iterator = decltype(std::begin(std::declval<segment_reference>()));
+public:
+	using iterator   = dynamic_chained_iterator<segment_iterator>;
+	using value_type = typename iterator::value_type;
+	using reference  = typename iterator::reference;
+	using pointer    = typename iterator::pointer;
+
+	dynamic_chained_range(Iterable&& iterable)
+	: iterable_(std::forward<Iterable>(iterable)), index_(std::make_unique<detail::dynamic_chain_index<segment_iterator>>()) {
+		index_->offsets.push_back(0);
+		for (auto&& segment : iterable_) {
+			index_->begins.push_back(std::begin(segment));
+			index_->ends.push_back(std::end(segment));
+			index_->offsets.push_back(index_->offsets.back() + std::size(segment));
+		}
+	}
+	iterator begin() const { return {index_.get(), 0}; }
+	iterator end() const { return {index_.get(), size()}; }
+
+	std::size_t size() const { return index_->offsets.back(); }
+	std::size_t segments() const { return index_->begins.size(); }
+private:
+	Iterable iterable_;
+	std::unique_ptr<detail::dynamic_chain_index<segment_iterator>> index_;
+};
+template<typename Iterable>
+dynamic_chained_range(Iterable&&) -> dynamic_chained_range<Iterable>;
+
+template<typename Iterator>
+struct segmented_iterator_traits<dynamic_chained_iterator<Iterator>> {
+	static constexpr bool is_segmented = true;
+
+	template<typename F>
+	static dynamic_chained_iterator<Iterator> for_each_segment(const dynamic_chained_iterator<Iterator>& first, const dynamic_chained_iterator<Iterator>& last, F&& f) {
+		for (std::size_t k = first.segment_; k < first._segments() and k <= last.segment_; ++k) {
+			Iterator local_first = k == first.segment_ ? first.it_ : first.index_->begins[k];
+			Iterator local_last = k == last.segment_ ? last.it_ : first.index_->ends[k];
+			Iterator local = f(local_first, local_last);
+			if (local != local_last)
+				return {first.index_, first.index_->offsets[k] + static_cast<std::size_t>(local - first.index_->begins[k])};
+		}
+		return last;
+	}
+};
+
+} // namespace iterutils
+
+#endif
@@ -7,10 +7,32 @@
 #include "../alternated_range.h"
 #include "../series_range.h"
 #include "../repeat_range.h"
+#include "../segmented.h"
+#include "../dynamic_chained_range.h"
+#include "../parallel.h"
+#include "../matrix_view.h"
+#include "../mapped_range.h"
+#include "../transformed_range.h"
+#include "../filtered_range.h"
+#include "../generator_range.h"
+#include "../instrument.h"
+#include "../prefetched_range.h"
+#include "../indexed_range.h"
+#include "../merged_range.h"
+#include "../chunked_range.h"
+#include "../sliding_window_range.h"
 
 #include <iostream>
+#include <list>
 #include <vector>
 #include <sstream>
+#include <algorithm>
+#include <numeric>
+#include <cstdint>
+#include <cstdio>
+#include <fstream>
+#include <string>
+#include <stdexcept>
 
 using namespace iterutils;
 
@@ -21,6 +43,38 @@ struct HeavyObject {
 	~HeavyObject() { i = 0; }
 };
 
+#if defined(__cpp_impl_coroutine)
+// see generator_range::promise_type::operator delete
+#if defined(__GNUC__) and !defined(__clang__)
+#pragma GCC diagnostic push
+#pragma GCC diagnostic ignored "-Wmismatched-new-delete"
+#endif
+generator_range<int> countdown(std::allocator_arg_t, frame_pool_allocator<std::byte>, int from) {
+	for (int i = from; i > 0; --i)
+		co_yield i;
+}
+// the countdowns from 1 to n one after the other, as nested generators
+generator_range<int> countdowns(std::allocator_arg_t, frame_pool_allocator<std::byte> alloc, int n) {
+	for (int i = 1; i <= n; ++i)
+		co_yield elements_of(countdown(std::allocator_arg, alloc, i));
+}
+#if defined(__GNUC__) and !defined(__clang__)
+#pragma GCC diagnostic pop
+#endif
+
+generator_range<int> naturals_until_failure(int failure) {
+	for (int i = 0; ; ++i) {
+		if (i == failure)
+			throw std::runtime_error("failed at " + std::to_string(i));
+		co_yield i;
+	}
+}
+generator_range<int> nested_failure(int failure) {
+	co_yield -1;
+	co_yield elements_of(naturals_until_failure(failure));
+}
+#endif
+
 int main() {
 	std::vector<HeavyObject> v1, v2, v3;
 	v1.reserve(5);
@@ -86,5 +140,299 @@ int main() {
 		std::cout << e;
 	}
 	std::cout << std::endl;
-}
 
+	std::cout << "Test 8: Segmented algorithms" << std::endl;
+	auto segmented = chained_range(v1, v2, v3);
+	auto add_i = [](int acc, const HeavyObject& x) { return acc + x.i; };
+	std::cout << "sum(v1..v2..v3) = " << iterutils::accumulate(segmented.begin(), segmented.end(), 0, add_i) << std::endl;
+	auto cycled = ncycle_range(v3, 2);
+	std::cout << "sum(v3..v3) = " << iterutils::accumulate(cycled.begin(), cycled.end(), 0, add_i) << std::endl;
+
+	std::cout << "Test 9: Dynamic chained range" << std::endl;
+	std::vector<std::vector<int>> shards {{1, 3, 5}, {}, {7, 9}, {11}};
+	auto shard_chain = dynamic_chained_range(shards);
+	auto found = std::lower_bound(shard_chain.begin(), shard_chain.end(), 9);
+	std::cout << "position of 9 in " << shard_chain.size() << " elements: " << (found - shard_chain.begin()) << std::endl;
+
+	std::cout << "Test 10: Sorting parallel arrays through zipped_range" << std::endl;
+	std::vector<int> keys {3, 1, 2};
+	std::vector<std::string> names {"three", "one", "two"};
+	auto by_key = zipped_range(keys, names);
+	std::sort(by_key.begin(), by_key.end(), compare_element<0>());
+	for (auto [key, name] : by_key)
+		std::cout << key << "=" << name << ",";
+	std::cout << std::endl;
+
+	std::cout << "Test 11: Parallel reduction over a chained range" << std::endl;
+	int parallel_sum = parallel_transform_reduce(chained_range(v1, v2, v3), 0, std::plus<>(), [](const HeavyObject& x) { return x.i; });
+	std::cout << "sum(v1..v2..v3) = " << parallel_sum << std::endl;
+
+	std::cout << "Test 12: Random access into an alternated range" << std::endl;
+	std::vector<int> evens {0, 2, 4, 6};
+	std::vector<int> odds {1, 3, 5};
+	auto interleaved = alternated_range(evens, odds);
+	const int length = interleaved.size();
+	bool conforming = interleaved.end() - interleaved.begin() == length;
+	for (int i = 0; i <= length; ++i) {
+		auto x = interleaved.begin() + i;
+		for (int j = 0; j <= length; ++j) {
+			auto y = interleaved.end() - (length - j);
+			conforming = conforming and y - x == j - i and (x < y) == (i < j) and (x == y) == (i == j);
+			if (j < length)
+				conforming = conforming and x[j - i] == j;
+		}
+	}
+	std::cout << "alternated(evens,odds)[5] = " << interleaved.begin()[5] << ", arithmetic " << (conforming ? "conforms" : "does not conform") << std::endl;
+
+	std::cout << "Test 13: Matrix view" << std::endl;
+	auto m = matrix_view(v2, 3, 3);
+	sum = 0;
+	for (auto& x : m.diagonal())
+		sum += x.i;
+	std::cout << "Trace of v2 as a 3x3 matrix: " << sum << std::endl;
+	std::cout << "transpose(v2) = " << std::endl;
+	for (std::size_t col = 0; col < m.cols(); ++col) {
+		for (auto& x : m.column(col))
+			std::cout << x.i << " ";
+		std::cout << std::endl;
+	}
+	std::cout << "2x2 tiles of v2: ";
+	for (auto tile : m.tiles(2, 2)) {
+		std::cout << "[";
+		for (auto& x : tile)
+			std::cout << x.i << ",";
+		std::cout << "]";
+	}
+	std::cout << std::endl;
+	float raw[12] = {1, 2, 3, 4, 5, 6, 7, 8, 9, 10, 11, 12};
+	auto pm = matrix_view(static_cast<float*>(raw), 3, 3, 4);
+	std::cout << "last column of a 3x3 block of a float[12] with ld 4: ";
+	for (float x : pm.column(2))
+		std::cout << x << " ";
+	std::cout << "trace: " << std::accumulate(pm.diagonal().begin(), pm.diagonal().end(), 0.0f) << std::endl;
+
+#if __has_include(<sys/mman.h>)
+	std::cout << "Test 14: Zipping memory mapped columns" << std::endl;
+	const std::string prices_path = "iterutils_prices.bin", quantities_path = "iterutils_quantities.bin";
+	{
+		const double prices[] = {1.5, 2.0, 4.25};
+		const int quantities[] = {4, 3, 2};
+		std::ofstream(prices_path, std::ios::binary).write(reinterpret_cast<const char*>(prices), sizeof(prices));
+		std::ofstream(quantities_path, std::ios::binary).write(reinterpret_cast<const char*>(quantities), sizeof(quantities));
+	}
+	{
+		mapped_range<double> prices(prices_path, 0, mapped_range<double>::npos, mapped_access::sequential);
+		mapped_range<int> quantities(quantities_path);
+		double total = 0;
+		for (auto [price, quantity] : zipped_range(prices, quantities))
+			total += price * quantity;
+		std::cout << "total of " << prices.size() << " mapped rows: " << total << std::endl;
+	}
+	std::remove(prices_path.c_str());
+	std::remove(quantities_path.c_str());
+#endif
+
+	std::cout << "Test 15: Transforming, filtering and zipping without temporaries" << std::endl;
+	std::vector<int> amounts {3, -1, 4, -1, 5, -9, 2, 6};
+	std::vector<std::string> labels {"a", "b", "c", "d", "e"};
+	auto doubled = transformed_range(amounts, [](int x) { return 2 * x; });
+	for (auto [amount, label] : zipped_range(filtered_range(doubled, [](int x) { return x > 0; }), labels))
+		std::cout << label << "=" << amount << " ";
+	std::cout << std::endl;
+
+	std::cout << "Test 16: Nested adapters are flattened" << std::endl;
+	std::vector<int> digits {0, 1, 2, 3, 4, 5, 6, 7, 8, 9};
+	std::cout << "strided(strided(digits, 1, 2), 1, 2): ";
+	for (int x : strided_range(strided_range(digits, 1, 2), 1, 2))
+		std::cout << x << " ";
+	std::cout << std::endl << "ncycle(ncycle(evens, 2), 2) has " << ncycle_range(ncycle_range(evens, 2), 2).size() << " elements" << std::endl;
+	std::cout << "chained(chained(evens, odds), evens): ";
+	for (int x : chained_range(chained_range(evens, odds), evens))
+		std::cout << x << " ";
+	std::cout << std::endl;
+
+#if defined(__cpp_impl_coroutine)
+	std::cout << "Test 17: Chaining and zipping coroutine generators" << std::endl;
+	frame_pool pool;
+	for (auto [x, label] : zipped_range(chained_range(countdown(std::allocator_arg, pool, 2), countdown(std::allocator_arg, pool, 3)), labels))
+		std::cout << label << "=" << x << " ";
+	std::cout << std::endl;
+	for (int x : countdowns(std::allocator_arg, pool, 3))
+		std::cout << x << " ";
+	std::cout << std::endl;
+	// leaving the loop destroys the suspended generator
+	for (int x : naturals_until_failure(100)) {
+		if (x == 3)
+			break;
+		std::cout << x << " ";
+	}
+	std::cout << std::endl;
+	try {
+		for (int x : nested_failure(2))
+			std::cout << x << " ";
+	}
+	catch (const std::runtime_error& e) {
+		std::cout << e.what();
+	}
+	std::cout << std::endl;
+#endif
+
+	std::cout << "Test 18: Arithmetic series" << std::endl;
+	series_range tenths(0.0, 1.0, 0.1);
+	std::cout << "size " << tenths.size() << ", sum " << tenths.sum() << ", 0.5 at " << tenths.index_of(0.5) << ": ";
+	for (double x : tenths)
+		std::cout << x << " ";
+	std::cout << std::endl;
+	series_range<int> countdown_by_3(20, -1, -3);
+	std::vector<int> progression(countdown_by_3.size());
+	countdown_by_3.copy_to(progression.data());
+	std::cout << "contains 5: " << countdown_by_3.contains(5) << ", contains 6: " << countdown_by_3.contains(6) << ": ";
+	for (int x : progression)
+		std::cout << x << " ";
+	std::cout << std::endl;
+
+	std::cout << "Test 19: Counted repeats" << std::endl;
+	std::vector<int> padded(3 + evens.size() + 3);
+	auto frame = chained_range(repeat_n_range(-1, 3), evens, repeat_n_range(-1, 3));
+	iterutils::copy(frame.begin(), frame.end(), padded.begin());
+	for (int x : padded)
+		std::cout << x << " ";
+	std::cout << std::endl;
+	for (auto [label, x] : zipped_range(labels, repeat_n_range(std::string("?"), 2)))
+		std::cout << label << x << " ";
+	std::cout << std::endl;
+
+	std::cout << "Test 20: Instrumentation (-DITERUTILS_INSTRUMENT=ON)" << std::endl;
+	if (instrument::enabled) {
+		instrument::reset();
+		int total = 0;
+		for (auto [x, y] : zipped_range(alternated_range(evens, odds), digits))
+			total += x * y;
+		for (int x : chained_range(evens, odds))
+			total += x;
+		std::cout << "total " << total << std::endl << instrument::snapshot();
+	}
+	else
+		std::cout << "disabled" << std::endl;
+
+	std::cout << "Test 21: Prefetched ranges" << std::endl;
+	for (int x : prefetched_range(chained_range(evens, odds), 2))
+		std::cout << x << " ";
+	std::cout << std::endl;
+	for (int x : prefetched_range(strided_range(digits, 1, 3)))
+		std::cout << x << " ";
+	std::cout << std::endl;
+
+	std::cout << "Test 22: Indexed ranges" << std::endl;
+	std::vector<std::size_t> reversed {3, 2, 1, 0};
+	for (auto [label, x] : zipped_range(labels, indexed_range(evens, reversed)))
+		std::cout << label << x << " ";
+	std::cout << std::endl;
+	std::vector<double> samples {0.5, 1.5, 2.5, 3.5, 4.5, 5.5, 6.5, 7.5};
+	std::vector<std::uint32_t> kept {0, 1, 2, 5, 7};
+	std::vector<double> gathered(kept.size());
+	indexed_range(samples, kept).gather(0, kept.size(), gathered.data(), gather_mode::sorted_runs);
+	for (double x : gathered)
+		std::cout << x << " ";
+	std::cout << std::endl;
+
+	std::cout << "Test 23: Sizes and collecting ranges" << std::endl;
+	auto everything = chained_range(evens, odds, digits);
+	auto interleaved_digits = alternated_range(odds, digits);
+	std::cout << "chained " << everything.size() << ", alternated " << interleaved_digits.size()
+		<< ", strided " << strided_range(digits, 8, 3).size() << ", ncycle " << ncycle_range(odds, 3).size() << std::endl;
+	for (int x : iterutils::to<std::vector<int>>(interleaved_digits))
+		std::cout << x << " ";
+	std::cout << std::endl;
+
+	std::cout << "Test 24: Compact iterators" << std::endl;
+	std::list<int> tail {10, 11};
+	auto chain = chained_range(evens, odds, digits, tail);
+	auto compact_chain = compact_chained_range(evens, odds, digits, tail);
+	auto laps = ncycle_range(odds, 2);
+	auto compact_laps = compact_ncycle_range(odds, 2);
+	static_assert(sizeof(decltype(compact_chain)::iterator) < sizeof(decltype(chain)::iterator));
+	static_assert(sizeof(decltype(compact_laps)::iterator) < sizeof(decltype(laps)::iterator));
+	static_assert(sizeof(compact_cycle_range<std::vector<int>&>::iterator) < sizeof(cycle_range<std::vector<int>&>::iterator));
+	std::cout << "chained " << sizeof(chain.begin()) << " B, compact " << sizeof(compact_chain.begin()) << " B" << std::endl;
+	std::cout << "ncycle " << sizeof(laps.begin()) << " B, compact " << sizeof(compact_laps.begin()) << " B" << std::endl;
+	std::cout << "cycle " << sizeof(cycle_range(odds).begin()) << " B, compact " << sizeof(compact_cycle_range(odds).begin()) << " B" << std::endl;
+	std::cout << std::equal(chain.begin(), chain.end(), compact_chain.begin(), compact_chain.end()) << std::equal(laps.begin(), laps.end(), compact_laps.begin(), compact_laps.end()) << std::endl;
+	std::vector<int> higher_evens {8, 10, 12};
+	auto sorted_chain = compact_chained_range(evens, higher_evens);
+	std::cout << "lower_bound(10) at " << std::lower_bound(sorted_chain.begin(), sorted_chain.end(), 10) - sorted_chain.begin() << std::endl;
+	// assigned ranges read the bounds of their own subranges, not those of the source
+	auto owned_chain = compact_chained_range(std::vector<int>{1}, std::vector<int>{2});
+	auto owned_laps = compact_ncycle_range(std::vector<int>{1}, 1);
+	auto owned_cycle = compact_cycle_range(std::vector<int>{1});
+	{
+		auto source_chain = compact_chained_range(std::vector<int>{3, 4}, std::vector<int>{5});
+		auto source_laps = compact_ncycle_range(std::vector<int>{6, 7}, 2);
+		auto source_cycle = compact_cycle_range(std::vector<int>{8, 9});
+		owned_chain = source_chain;
+		owned_laps = std::move(source_laps);
+		owned_cycle = source_cycle;
+	}
+	for (int x : owned_chain)
+		std::cout << x << " ";
+	for (int x : owned_laps)
+		std::cout << x << " ";
+	std::cout << *(owned_cycle.begin() + 3) << std::endl;
+
+	std::cout << "Test 25: Merged ranges" << std::endl;
+	for (int x : merged_range(evens, chained_range(odds, higher_evens)))
+		std::cout << x << " ";
+	std::cout << std::endl;
+	std::vector<int> other_keys {0, 2, 9};
+	std::vector<std::string> other_labels {"x", "y", "z"};
+	for (auto [key, label] : merged_range_by(compare_element<0>(), zipped_range(evens, labels), zipped_range(other_keys, other_labels)))
+		std::cout << key << label << " ";
+	std::cout << std::endl;
+	std::vector<std::vector<int>> runs {{5, 9}, {}, {1, 5, 6}, {2}};
+	for (int x : dynamic_merged_range(runs))
+		std::cout << x << " ";
+	std::cout << std::endl;
+
+	std::cout << "Test 26: Chunks and sliding windows" << std::endl;
+	for (auto rows : chunked_range(zipped_range(digits, labels), 2)) {
+		std::cout << "[";
+		for (auto [digit, label] : rows)
+			std::cout << digit << label;
+		std::cout << "] ";
+	}
+	std::cout << std::endl;
+	for (auto window : sliding_window_range(evens, 3))
+		std::cout << std::accumulate(window.begin(), window.end(), 0) << " ";
+	std::cout << std::endl;
+
+	std::cout << "Test 27: Interleaving and deinterleaving channels" << std::endl;
+	std::vector<float> xs {1, 2, 3, 4, 5}, ys {10, 20, 30, 40, 50}, zs {100, 200, 300, 400, 500};
+	auto points = alternated_range(xs, ys, zs);
+	std::vector<float> packed = iterutils::to<std::vector<float>>(points);
+	for (float x : packed)
+		std::cout << x << " ";
+	std::cout << std::endl;
+	std::reverse(packed.begin(), packed.end());
+	iterutils::copy(packed.begin(), packed.end(), points.begin());
+	for (float x : xs)
+		std::cout << x << " ";
+	std::cout << std::endl;
+
+	std::cout << "Test 28: Sentinels" << std::endl;
+	for (int x : sentinel_range(chained_range(evens, odds)))
+		std::cout << x << " ";
+	std::cout << std::endl;
+	for (int x : sentinel_range(ncycle_range(digits, 2)))
+		std::cout << x << " ";
+	std::cout << std::endl;
+	auto zipped_digits = zipped_range(digits, labels);
+	for (auto it = zipped_digits.begin(); it != zipped_digits.sentinel(); ++it) {
+		auto [digit, label] = *it;
+		std::cout << digit << label << " ";
+	}
+	std::cout << std::endl;
+	std::list<int> listed_odds(odds.begin(), odds.end());
+	for (auto [x, y] : sentinel_range(zipped_range(evens, listed_odds)))
+		std::cout << x + y << " ";
+	std::cout << std::endl;
+}
@@ -0,0 +1,158 @@
+#ifndef _ITERUTILS_FILTERED_RANGE_H_
+#define _ITERUTILS_FILTERED_RANGE_H_
+
+#include <functional>
+#include <iterator>
+#include <type_traits>
+#include <utility>
+#include "util.h"
+#include "segmented.h"
+#include "instrument.h"
+
+namespace iterutils {
+
+template<typename Tag, typename Iterator, typename Predicate>
+class filtered_iterator {};
+
+template<typename Tag, typename Iterator, typename Predicate>
+filtered_iterator<Tag, Iterator, Predicate>& operator++(filtered_iterator<Tag, Iterator, Predicate>& it) {
+	ITERUTILS_COUNT(filtered, increment);
+	++it.it_;
+	it._satisfy();
+	return it;
+}
+template<typename Tag, typename Iterator, typename Predicate>
+filtered_iterator<Tag, Iterator, Predicate> operator++(filtered_iterator<Tag, Iterator, Predicate>& it, int) {
+	auto copy = it;
+	++it;
+	return copy;
+}
+// there is always a matching element before a valid position, so
+// going backwards does not need the begin of the underlying range
+template<typename Tag, typename Iterator, typename Predicate>
+filtered_iterator<Tag, Iterator, Predicate>& operator--(filtered_iterator<Tag, Iterator, Predicate>& it) {
+	ITERUTILS_COUNT(filtered, increment);
+	do
+		--it.it_;
+	while (!std::invoke(it.pred_.get(), *it.it_));
+	return it;
+}
+template<typename Tag, typename Iterator, typename Predicate>
+filtered_iterator<Tag, Iterator, Predicate> operator--(filtered_iterator<Tag, Iterator, Predicate>& it, int) {
+	auto copy = it;
+	--it;
+	return copy;
+}
+
+// Skips the elements of the underlying iterator that do not satisfy a predicate.
+// The iterator always rests on a matching element or on the end of the underlying range
+template<typename Iterator, typename Predicate>
+class filtered_iterator<std::input_iterator_tag, Iterator, Predicate> {
+public:
+	using value_type        = typename std::iterator_traits<Iterator>::value_type;
+	using reference         = typename std::iterator_traits<Iterator>::reference;
+	using pointer           = typename std::iterator_traits<Iterator>::pointer;
+	using difference_type   = typename std::iterator_traits<Iterator>::difference_type;
+	using iterator_category = std::input_iterator_tag;
+
+	filtered_iterator() = default;
+	filtered_iterator(Iterator it, Iterator end, Predicate pred) : it_(it), end_(end), pred_(std::move(pred)) {
+		_satisfy();
+	}
+
+	friend filtered_iterator& operator++<iterator_category, Iterator, Predicate>(filtered_iterator&);
+	friend filtered_iterator  operator++<iterator_category, Iterator, Predicate>(filtered_iterator&, int);
+	template<typename, typename> friend struct segmented_iterator_traits;
+
+	reference operator*() const { ITERUTILS_COUNT(filtered, dereference); return *it_; }
+	bool operator==(const filtered_iterator& other) const { ITERUTILS_COUNT(filtered, compare); return it_ == other.it_; }
+	bool operator!=(const filtered_iterator& other) const { ITERUTILS_COUNT(filtered, compare); return it_ != other.it_; }
+
+	// the underlying iterator
+	const Iterator& base() const { return it_; }
+protected:
+	void _satisfy() {
+		while (it_ != end_ and !std::invoke(pred_.get(), *it_))
+			++it_;
+	}
+
+	Iterator it_;
+	Iterator end_;
+	detail::function_box<Predicate> pred_;
+};
+
+template<typename Iterator, typename Predicate>
+class filtered_iterator<std::forward_iterator_tag, Iterator, Predicate>
+: public filtered_iterator<std::input_iterator_tag, Iterator, Predicate> {
+public:
+	using iterator_category = std::forward_iterator_tag;
+
+	using filtered_iterator<std::input_iterator_tag, Iterator, Predicate>::filtered_iterator;
+
+	friend filtered_iterator& operator++<iterator_category, Iterator, Predicate>(filtered_iterator&);
+	friend filtered_iterator  operator++<iterator_category, Iterator, Predicate>(filtered_iterator&, int);
+};
+
+template<typename Iterator, typename Predicate>
+class filtered_iterator<std::bidirectional_iterator_tag, Iterator, Predicate>
+: public filtered_iterator<std::forward_iterator_tag, Iterator, Predicate> {
+public:
+	using iterator_category = std::bidirectional_iterator_tag;
+
+	using filtered_iterator<std::forward_iterator_tag, Iterator, Predicate>::filtered_iterator;
+
+	friend filtered_iterator& operator++<iterator_category, Iterator, Predicate>(filtered_iterator&);
+	friend filtered_iterator  operator++<iterator_category, Iterator, Predicate>(filtered_iterator&, int);
+	friend filtered_iterator& operator--<iterator_category, Iterator, Predicate>(filtered_iterator&);
+	friend filtered_iterator  operator--<iterator_category, Iterator, Predicate>(filtered_iterator&, int);
+};
+
+// the number of skipped elements is unknown, so filtered iterators are at most bidirectional
+template<typename Iterator, typename Predicate>
+filtered_iterator<std::common_type_t<typename std::iterator_traits<Iterator>::iterator_category, std::bidirectional_iterator_tag>, Iterator, Predicate>
+make_filtered_iterator(Iterator it, Iterator end, Predicate pred) {
+	return {it, end, std::move(pred)};
+}
+
+// Lazily keeps the elements of a range that satisfy pred. begin() looks for the
+// first match, so it costs as much as the run of rejected elements it skips
+template<typename Iterable, typename Predicate>
+class filtered_range {
+public:
+	using iterator        = decltype(make_filtered_iterator(std::begin(std::declval<Iterable&>()), std::end(std::declval<Iterable&>()), std::declval<Predicate>()));
+	using value_type      = typename iterator::value_type;
+	using pointer         = typename iterator::pointer;
+	using reference       = typename iterator::reference;
+	using difference_type = typename iterator::difference_type;
+
+	filtered_range(Iterable&& iterable, Predicate pred) : iterable_(std::forward<Iterable>(iterable)), pred_(std::move(pred)) {
+	}
+	iterator begin() { return make_filtered_iterator(std::begin(iterable_), std::end(iterable_), pred_); }
+	iterator end() { return make_filtered_iterator(std::end(iterable_), std::end(iterable_), pred_); }
+private:
+	Iterable iterable_;
+	Predicate pred_;
+};
+template<typename Iterable, typename Predicate> filtered_range(Iterable&&, Predicate) -> filtered_range<Iterable, Predicate>;
+
+template<typename Iterable, typename Predicate>
+struct is_infinite<filtered_range<Iterable, Predicate>> : public is_infinite<std::remove_reference_t<Iterable>> {};
+
+// filtered segmented iterators are segmented too: every segment is filtered on its own
+template<typename Tag, typename Iterator, typename Predicate>
+struct segmented_iterator_traits<filtered_iterator<Tag, Iterator, Predicate>, std::enable_if_t<segmented_iterator_traits<Iterator>::is_segmented>> {
+	static constexpr bool is_segmented = true;
+
+	template<typename F>
+	static filtered_iterator<Tag, Iterator, Predicate> for_each_segment(const filtered_iterator<Tag, Iterator, Predicate>& first, const filtered_iterator<Tag, Iterator, Predicate>& last, F&& f) {
+		const Predicate& pred = first.pred_.get();
+		Iterator local = segmented_iterator_traits<Iterator>::for_each_segment(first.it_, last.it_, [&f, &pred](auto local_first, auto local_last) {
+			return f(make_filtered_iterator(local_first, local_last, pred), make_filtered_iterator(local_last, local_last, pred)).base();
+		});
+		return {local, first.end_, pred};
+	}
+};
+
+} // namespace iterutils
+
+#endif
@@ -0,0 +1,340 @@
+#ifndef _ITERUTILS_GENERATOR_RANGE_H_
+#define _ITERUTILS_GENERATOR_RANGE_H_
+
+// Coroutine generators as ranges. Only available when compiling with coroutine support (C++20)
+
+#if __has_include(<coroutine>) and defined(__cpp_impl_coroutine)
+
+#include <coroutine>
+#include <cstddef>
+#include <exception>
+#include <iterator>
+#include <memory>
+#include <new>
+#include <type_traits>
+#include <utility>
+#include <vector>
+#include "instrument.h"
+
+namespace iterutils {
+
+// Recycles coroutine frames. Released frames are kept in a free list per size and
+// handed out again to the next frame of the same size, so creating many short lived
+// generators only reaches operator new until the pool has warmed up.
+// The pool is not thread safe and must outlive the frames allocated from it
+class frame_pool {
+public:
+	// frame sizes are rounded up to a multiple of this
+	static constexpr std::size_t granularity = 64;
+
+	frame_pool() = default;
+	frame_pool(const frame_pool&) = delete;
+	frame_pool& operator=(const frame_pool&) = delete;
+	~frame_pool() {
+		for (std::vector<void*>& free : free_) {
+			for (void* frame : free)
+				::operator delete(frame);
+		}
+	}
+
+	void* allocate(std::size_t bytes) {
+		const std::size_t k = _bucket(bytes);
+		if (k < free_.size() and !free_[k].empty()) {
+			void* frame = free_[k].back();
+			free_[k].pop_back();
+			return frame;
+		}
+		return ::operator new((k + 1) * granularity);
+	}
+	void deallocate(void* frame, std::size_t bytes) {
+		const std::size_t k = _bucket(bytes);
+		if (k >= free_.size())
+			free_.resize(k + 1);
+		free_[k].push_back(frame);
+	}
+private:
+	static std::size_t _bucket(std::size_t bytes) {
+		return bytes ? (bytes - 1) / granularity : 0;
+	}
+
+	std::vector<std::vector<void*>> free_;
+};
+
+// Standard allocator drawing from a frame_pool, to be passed to generators
+template<typename T>
+class frame_pool_allocator {
+public:
+	using value_type = T;
+
+	frame_pool_allocator(frame_pool& pool) noexcept : pool_(&pool) {
+	}
+	template<typename U>
+	frame_pool_allocator(const frame_pool_allocator<U>& other) noexcept : pool_(other.pool_) {
+	}
+
+	T* allocate(std::size_t n) { return static_cast<T*>(pool_->allocate(n * sizeof(T))); }
+	void deallocate(T* p, std::size_t n) noexcept { pool_->deallocate(p, n * sizeof(T)); }
+
+	friend bool operator==(const frame_pool_allocator& a, const frame_pool_allocator& b) { return a.pool_ == b.pool_; }
+	friend bool operator!=(const frame_pool_allocator& a, const frame_pool_allocator& b) { return a.pool_ != b.pool_; }
+private:
+	template<typename> friend class frame_pool_allocator;
+
+	frame_pool* pool_;
+};
+
+namespace detail {
+
+struct alignas(__STDCPP_DEFAULT_NEW_ALIGNMENT__) frame_block {
+	unsigned char bytes[__STDCPP_DEFAULT_NEW_ALIGNMENT__];
+};
+using frame_deleter = void (*)(void* frame, std::size_t size);
+
+constexpr std::size_t align_up(std::size_t n, std::size_t alignment) {
+	return (n + alignment - 1) / alignment * alignment;
+}
+
+// A frame allocated through Alloc is followed by the function that releases it and
+// by a copy of the allocator, so that operator delete does not need to know Alloc
+template<typename Alloc>
+struct frame_layout {
+	using allocator_type = typename std::allocator_traits<Alloc>::template rebind_alloc<frame_block>;
+
+	static std::size_t deleter_offset(std::size_t size) { return align_up(size, alignof(frame_deleter)); }
+	static std::size_t allocator_offset(std::size_t size) { return align_up(deleter_offset(size) + sizeof(frame_deleter), alignof(allocator_type)); }
+	static std::size_t blocks(std::size_t size) { return (allocator_offset(size) + sizeof(allocator_type) + sizeof(frame_block) - 1) / sizeof(frame_block); }
+
+	static void* allocate(std::size_t size, const Alloc& alloc) {
+		allocator_type block_alloc(alloc);
+		char* frame = reinterpret_cast<char*>(std::allocator_traits<allocator_type>::allocate(block_alloc, blocks(size)));
+		::new (frame + deleter_offset(size)) frame_deleter(&deallocate);
+		::new (frame + allocator_offset(size)) allocator_type(std::move(block_alloc));
+		return frame;
+	}
+	static void deallocate(void* p, std::size_t size) {
+		char* frame = static_cast<char*>(p);
+		allocator_type* stored = std::launder(reinterpret_cast<allocator_type*>(frame + allocator_offset(size)));
+		allocator_type block_alloc(std::move(*stored));
+		stored->~allocator_type();
+		std::allocator_traits<allocator_type>::deallocate(block_alloc, reinterpret_cast<frame_block*>(frame), blocks(size));
+	}
+};
+
+inline void deallocate_frame(void* frame, std::size_t size) {
+	(*std::launder(reinterpret_cast<frame_deleter*>(static_cast<char*>(frame) + align_up(size, alignof(frame_deleter)))))(frame, size);
+}
+
+} // namespace detail
+
+template<typename T>
+class generator_range;
+
+// co_yield elements_of(other_generator()) yields every element of a nested generator.
+// It only refers to the generator, which lives until the end of the co_yield expression
+template<typename T>
+struct elements_of {
+	generator_range<T>&& range;
+};
+template<typename T>
+elements_of(generator_range<T>&&) -> elements_of<T>;
+
+// Single pass range over the values yielded by a coroutine:
+//   generator_range<int> iota(int n) { for (int i = 0; i < n; ++i) co_yield i; }
+// Frames come from operator new unless the coroutine takes (std::allocator_arg_t, Alloc, ...)
+// as its first parameters (after the object for member functions), in which case they come
+// from the allocator. Nested generators (elements_of) are resumed directly by the iterator,
+// and control goes back to their parent by symmetric transfer, so the nesting depth does not
+// add work per element
+template<typename T>
+class generator_range {
+public:
+	using value_type = std::remove_cv_t<std::remove_reference_t<T>>;
+	using reference  = std::conditional_t<std::is_reference_v<T>, T, T&>;
+	using pointer    = std::add_pointer_t<reference>;
+
+	class promise_type;
+	class iterator;
+	using handle_type = std::coroutine_handle<promise_type>;
+
+	generator_range() = default;
+	generator_range(const generator_range&) = delete;
+	generator_range& operator=(const generator_range&) = delete;
+	generator_range(generator_range&& other) noexcept
+	: coro_(std::exchange(other.coro_, nullptr)), started_(std::exchange(other.started_, false)) {
+	}
+	generator_range& operator=(generator_range&& other) noexcept {
+		if (this != &other) {
+			if (coro_)
+				coro_.destroy();
+			coro_ = std::exchange(other.coro_, nullptr);
+			started_ = std::exchange(other.started_, false);
+		}
+		return *this;
+	}
+	~generator_range() {
+		if (coro_)
+			coro_.destroy();
+	}
+
+	// runs the coroutine up to its first value on the first call. Later calls
+	// return an iterator to the current value, so that adapters may call begin()
+	// more than once (ie: chained_range calls it for its begin and end iterators)
+	iterator begin() {
+		if (coro_ and !started_) {
+			started_ = true;
+			coro_.resume();
+			coro_.promise()._rethrow();
+		}
+		return iterator(coro_);
+	}
+	iterator end() { return iterator(); }
+private:
+	explicit generator_range(handle_type coro) : coro_(coro) {
+	}
+
+	handle_type coro_ = nullptr;
+	bool started_ = false;
+};
+
+template<typename T>
+class generator_range<T>::promise_type {
+public:
+	generator_range get_return_object() noexcept { return generator_range(handle_type::from_promise(*this)); }
+	std::suspend_always initial_suspend() const noexcept { return {}; }
+	auto final_suspend() const noexcept { return final_awaiter(); }
+	void return_void() const noexcept {}
+	void unhandled_exception() { exception_ = std::current_exception(); }
+
+	// values are yielded by address, the yielded object lives until the generator is resumed
+	std::suspend_always yield_value(reference value) noexcept {
+		root_->value_ = std::addressof(value);
+		return {};
+	}
+	std::suspend_always yield_value(value_type&& value) noexcept requires (!std::is_reference_v<T>) {
+		root_->value_ = std::addressof(value);
+		return {};
+	}
+	auto yield_value(elements_of<T> nested) noexcept {
+		nested_ = std::move(nested.range);
+		nested_.started_ = true;
+		return nested_awaiter{this};
+	}
+	// generators cannot wait on anything but their nested generators
+	template<typename U>
+	std::suspend_never await_transform(U&&) = delete;
+
+	static void* operator new(std::size_t size) {
+		return detail::frame_layout<std::allocator<detail::frame_block>>::allocate(size, {});
+	}
+	template<typename Alloc, typename ...Args>
+	static void* operator new(std::size_t size, std::allocator_arg_t, const Alloc& alloc, const Args&...) {
+		return detail::frame_layout<Alloc>::allocate(size, alloc);
+	}
+	template<typename This, typename Alloc, typename ...Args>
+	static void* operator new(std::size_t size, const This&, std::allocator_arg_t, const Alloc& alloc, const Args&...) {
+		return detail::frame_layout<Alloc>::allocate(size, alloc);
+	}
+	// frames are always released through this overload, whichever operator new made them.
+	// gcc 12 matches new and delete by name, so without optimizations it flags coroutines
+	// taking an allocator with -Wmismatched-new-delete. Wrap them in a diagnostic pragma
+	// as the example does
+	static void operator delete(void* frame, std::size_t size) {
+		detail::deallocate_frame(frame, size);
+	}
+private:
+	friend class generator_range;
+	friend class iterator;
+
+	// returns to the parent generator, or to the iterator that resumed the outermost one
+	struct final_awaiter {
+		bool await_ready() const noexcept { return false; }
+		std::coroutine_handle<> await_suspend(handle_type coro) const noexcept {
+			promise_type& promise = coro.promise();
+			if (!promise.parent_)
+				return std::noop_coroutine();
+			promise.root_->leaf_ = promise.parent_;
+			return promise.parent_;
+		}
+		void await_resume() const noexcept {}
+	};
+	// hands the iterator over to the nested generator and starts it. The generator is
+	// kept in the promise so that the awaiter stays trivially copyable: gcc 12 copies the
+	// temporaries of co_yield expressions bitwise
+	struct nested_awaiter {
+		promise_type* current;
+
+		bool await_ready() const noexcept { return !current->nested_.coro_; }
+		std::coroutine_handle<> await_suspend(handle_type coro) const noexcept {
+			promise_type& nested = current->nested_.coro_.promise();
+			nested.root_ = current->root_;
+			nested.parent_ = coro;
+			current->root_->leaf_ = current->nested_.coro_;
+			return current->nested_.coro_;
+		}
+		void await_resume() const {
+			generator_range finished = std::move(current->nested_);
+			if (finished.coro_)
+				finished.coro_.promise()._rethrow();
+		}
+	};
+
+	void _rethrow() {
+		if (exception_)
+			std::rethrow_exception(std::exchange(exception_, nullptr));
+	}
+
+	// the outermost generator, which holds the current value, and the innermost
+	// running one, which the iterator resumes
+	promise_type* root_ = this;
+	handle_type leaf_ = handle_type::from_promise(*this);
+	handle_type parent_ = nullptr;
+	pointer value_ = nullptr;
+	std::exception_ptr exception_;
+	generator_range nested_;
+};
+
+template<typename T>
+class generator_range<T>::iterator {
+public:
+	using value_type        = typename generator_range::value_type;
+	using reference         = typename generator_range::reference;
+	using pointer           = typename generator_range::pointer;
+	using difference_type   = std::ptrdiff_t;
+	using iterator_category = std::input_iterator_tag;
+
+	iterator() = default;
+
+	reference operator*() const { ITERUTILS_COUNT(generator, dereference); return static_cast<reference>(*coro_.promise().value_); }
+	pointer operator->() const { return coro_.promise().value_; }
+
+	iterator& operator++() {
+		ITERUTILS_COUNT(generator, increment);
+		promise_type& root = coro_.promise();
+		root.leaf_.resume();
+		root._rethrow();
+		return *this;
+	}
+	iterator operator++(int) {
+		iterator copy = *this;
+		++(*this);
+		return copy;
+	}
+
+	// every finished iterator is equal to end()
+	bool operator==(const iterator& other) const { ITERUTILS_COUNT(generator, compare); return _done() ? other._done() : coro_ == other.coro_; }
+	bool operator!=(const iterator& other) const { return !(*this == other); }
+private:
+	friend class generator_range;
+
+	explicit iterator(handle_type coro) : coro_(coro) {
+	}
+	bool _done() const { return !coro_ or coro_.done(); }
+
+	handle_type coro_ = nullptr;
+};
+
+} // namespace iterutils
+
+#endif // __has_include(<coroutine>)
+
+#endif
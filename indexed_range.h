@@ -0,0 +1,337 @@
+#ifndef _ITERUTILS_INDEXED_RANGE_H_
+#define _ITERUTILS_INDEXED_RANGE_H_
+
+#include <algorithm>
+#include <cstddef>
+#include <iterator>
+#include <memory>
+#include <type_traits>
+#include <utility>
+#include "util.h"
+#include "simd.h"
+#include "instrument.h"
+
+namespace iterutils {
+
+namespace detail {
+
+#if ITERUTILS_X86_SIMD
+// Kernels copy out[k] = src[index[k]] for as many whole vectors as fit in n and return
+// the number of elements they copied. Elements are moved as raw float or double lanes
+// and indices are loaded as 32 or 64 bit lanes of their own type.
+// Gathers take signed indices: unsigned 32 bit indices of 2^31 or more stop the kernel
+// and are left to the scalar loop of the caller
+template<typename V, typename I>
+ITERUTILS_TARGET("avx2")
+std::size_t indexed_gather_avx2(const V* src, const I* index, std::size_t n, V* out) {
+	constexpr bool check_sign = std::is_unsigned_v<I> and sizeof(I) == 4;
+	std::size_t k = 0;
+	if constexpr (sizeof(V) == 4 and sizeof(I) == 4) {
+		const __m256 all = _mm256_castsi256_ps(_mm256_set1_epi32(-1));
+		for (; k + 8 <= n; k += 8) {
+			const __m256i i = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(index + k));
+			if (check_sign and _mm256_movemask_ps(_mm256_castsi256_ps(i)) != 0)
+				break;
+			_mm256_storeu_ps(out + k, _mm256_mask_i32gather_ps(_mm256_setzero_ps(), src, i, all, 4));
+		}
+	}
+	else if constexpr (sizeof(V) == 8 and sizeof(I) == 4) {
+		const __m256d all = _mm256_castsi256_pd(_mm256_set1_epi64x(-1));
+		for (; k + 4 <= n; k += 4) {
+			const __m128i i = _mm_loadu_si128(reinterpret_cast<const __m128i*>(index + k));
+			if (check_sign and _mm_movemask_ps(_mm_castsi128_ps(i)) != 0)
+				break;
+			_mm256_storeu_pd(out + k, _mm256_mask_i32gather_pd(_mm256_setzero_pd(), src, i, all, 8));
+		}
+	}
+	else if constexpr (sizeof(V) == 4 and sizeof(I) == 8) {
+		const __m128 all = _mm_castsi128_ps(_mm_set1_epi32(-1));
+		for (; k + 4 <= n; k += 4) {
+			const __m256i i = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(index + k));
+			_mm_storeu_ps(out + k, _mm256_mask_i64gather_ps(_mm_setzero_ps(), src, i, all, 4));
+		}
+	}
+	else {
+		const __m256d all = _mm256_castsi256_pd(_mm256_set1_epi64x(-1));
+		for (; k + 4 <= n; k += 4) {
+			const __m256i i = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(index + k));
+			_mm256_storeu_pd(out + k, _mm256_mask_i64gather_pd(_mm256_setzero_pd(), src, i, all, 8));
+		}
+	}
+	return k;
+}
+template<typename V, typename I>
+ITERUTILS_TARGET("avx512f")
+std::size_t indexed_gather_avx512(const V* src, const I* index, std::size_t n, V* out) {
+	constexpr bool check_sign = std::is_unsigned_v<I> and sizeof(I) == 4;
+	std::size_t k = 0;
+	if constexpr (sizeof(V) == 4 and sizeof(I) == 4) {
+		for (; k + 16 <= n; k += 16) {
+			const __m512i i = _mm512_loadu_si512(index + k);
+			if (check_sign and _mm512_cmplt_epi32_mask(i, _mm512_setzero_si512()) != 0)
+				break;
+			_mm512_storeu_ps(out + k, _mm512_mask_i32gather_ps(_mm512_setzero_ps(), 0xffff, i, src, 4));
+		}
+	}
+	else if constexpr (sizeof(V) == 8 and sizeof(I) == 4) {
+		for (; k + 8 <= n; k += 8) {
+			const __m256i i = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(index + k));
+			if (check_sign and _mm256_movemask_ps(_mm256_castsi256_ps(i)) != 0)
+				break;
+			_mm512_storeu_pd(out + k, _mm512_mask_i32gather_pd(_mm512_setzero_pd(), 0xff, i, src, 8));
+		}
+	}
+	else if constexpr (sizeof(V) == 4 and sizeof(I) == 8) {
+		for (; k + 8 <= n; k += 8) {
+			const __m512i i = _mm512_loadu_si512(index + k);
+			_mm256_storeu_ps(out + k, _mm512_mask_i64gather_ps(_mm256_setzero_ps(), 0xff, i, src, 4));
+		}
+	}
+	else {
+		for (; k + 8 <= n; k += 8) {
+			const __m512i i = _mm512_loadu_si512(index + k);
+			_mm512_storeu_pd(out + k, _mm512_mask_i64gather_pd(_mm512_setzero_pd(), 0xff, i, src, 8));
+		}
+	}
+	return k;
+}
+#endif
+
+// copies out[k] = src[index[k]] for k in [0, n)
+template<typename T, typename I>
+void indexed_gather(const T* src, const I* index, std::size_t n, T* out) {
+	std::size_t k = 0;
+#if ITERUTILS_X86_SIMD
+	constexpr bool lanes = std::is_arithmetic_v<T> and (sizeof(T) == 4 or sizeof(T) == 8) and
+		std::is_integral_v<I> and (sizeof(I) == 4 or sizeof(I) == 8);
+	if constexpr (lanes) {
+		using lane = std::conditional_t<sizeof(T) == 4, float, double>;
+		const lane* s = reinterpret_cast<const lane*>(src);
+		lane* o = reinterpret_cast<lane*>(out);
+		switch (current_simd_level()) {
+			case simd_level::avx512: k = indexed_gather_avx512(s, index, n, o); break;
+			case simd_level::avx2:   k = indexed_gather_avx2(s, index, n, o); break;
+			default: break;
+		}
+	}
+#endif
+	for (; k < n; ++k)
+		out[k] = src[index[k]];
+}
+
+} // namespace detail
+
+// Random access iterator over data[indices[0]], data[indices[1]]... Moves along the
+// indices and dereferences the data through them, so it can also write (scatter)
+template<typename DataIterator, typename IndexIterator>
+class indexed_iterator {
+public:
+	using value_type        = typename std::iterator_traits<DataIterator>::value_type;
+	using reference         = typename std::iterator_traits<DataIterator>::reference;
+	using pointer           = typename std::iterator_traits<DataIterator>::pointer;
+	using difference_type   = typename std::iterator_traits<IndexIterator>::difference_type;
+	using iterator_category = std::random_access_iterator_tag;
+
+	static_assert(
+		std::is_base_of_v<std::random_access_iterator_tag, typename std::iterator_traits<DataIterator>::iterator_category> and
+		std::is_base_of_v<std::random_access_iterator_tag, typename std::iterator_traits<IndexIterator>::iterator_category>,
+		"indexed_iterator requires random access data and indices"
+	);
+
+	indexed_iterator() = default;
+	indexed_iterator(DataIterator data, IndexIterator index) : data_(data), index_(index) {
+	}
+
+	reference operator*() const { ITERUTILS_COUNT(indexed, dereference); return data_[_offset(*index_)]; }
+	reference operator[](difference_type n) const { ITERUTILS_COUNT(indexed, jump); ITERUTILS_COUNT(indexed, dereference); return data_[_offset(index_[n])]; }
+
+	indexed_iterator& operator++() { ITERUTILS_COUNT(indexed, increment); ++index_; return *this; }
+	indexed_iterator& operator--() { ITERUTILS_COUNT(indexed, increment); --index_; return *this; }
+	indexed_iterator operator++(int) { ITERUTILS_COUNT(indexed, increment); auto copy = *this; ++index_; return copy; }
+	indexed_iterator operator--(int) { ITERUTILS_COUNT(indexed, increment); auto copy = *this; --index_; return copy; }
+	indexed_iterator& operator+=(difference_type n) { ITERUTILS_COUNT(indexed, jump); index_ += n; return *this; }
+	indexed_iterator& operator-=(difference_type n) { ITERUTILS_COUNT(indexed, jump); index_ -= n; return *this; }
+	indexed_iterator operator+(difference_type n) const { auto copy = *this; return copy += n; }
+	indexed_iterator operator-(difference_type n) const { auto copy = *this; return copy -= n; }
+	friend indexed_iterator operator+(difference_type n, const indexed_iterator& it) { return it + n; }
+	difference_type operator-(const indexed_iterator& other) const { ITERUTILS_COUNT(indexed, jump); return index_ - other.index_; }
+
+	bool operator==(const indexed_iterator& other) const { ITERUTILS_COUNT(indexed, compare); return index_ == other.index_; }
+	bool operator!=(const indexed_iterator& other) const { ITERUTILS_COUNT(indexed, compare); return index_ != other.index_; }
+	bool operator< (const indexed_iterator& other) const { ITERUTILS_COUNT(indexed, compare); return index_ <  other.index_; }
+	bool operator<=(const indexed_iterator& other) const { ITERUTILS_COUNT(indexed, compare); return index_ <= other.index_; }
+	bool operator> (const indexed_iterator& other) const { ITERUTILS_COUNT(indexed, compare); return index_ >  other.index_; }
+	bool operator>=(const indexed_iterator& other) const { ITERUTILS_COUNT(indexed, compare); return index_ >= other.index_; }
+
+	// the position in the indices
+	const IndexIterator& base() const { return index_; }
+
+	// iterutils::copy into contiguous storage is a batched gather when the data and the
+	// indices are contiguous too (see indexed_range::gather)
+	template<typename OutputIterator>
+	friend OutputIterator bulk_copy(const indexed_iterator& first, const indexed_iterator& last, OutputIterator out) {
+		const difference_type n = last.index_ - first.index_;
+		if constexpr (
+			detail::is_contiguous_iterator_v<DataIterator> and detail::is_contiguous_iterator_v<IndexIterator> and
+			detail::is_contiguous_iterator_v<OutputIterator> and std::is_arithmetic_v<value_type> and
+			std::is_same_v<typename std::iterator_traits<OutputIterator>::value_type, value_type>
+		) {
+			// valid indices imply that the data is not empty
+			if (n > 0)
+				detail::indexed_gather(std::addressof(*first.data_), std::addressof(*first.index_), static_cast<std::size_t>(n), std::addressof(*out));
+			return out + n;
+		}
+		else
+			return std::copy(first, last, out);
+	}
+private:
+	template<typename Index>
+	static auto _offset(Index i) { return static_cast<typename std::iterator_traits<DataIterator>::difference_type>(i); }
+
+	DataIterator data_;
+	IndexIterator index_;
+};
+
+// how indexed_range::gather reads the data
+enum class gather_mode {
+	elements,   // one element per index
+	runs,       // runs of consecutive indices are copied as blocks
+	sorted_runs // same as runs, for strictly increasing indices (ie: selection vectors)
+};
+
+// A view of data through an array of indices: data[indices[0]], data[indices[1]]...
+// for permutations, selection vectors and other irregular access patterns that
+// strided_range cannot express. Both ranges must be random access. The indices are
+// not checked against the size of the data
+template<typename Iterable, typename Indices>
+class indexed_range {
+	using data_iterator  = decltype(std::begin(std::declval<Iterable&>()));
+	using index_iterator = decltype(std::begin(std::declval<Indices&>()));
+public:
+	using iterator        = indexed_iterator<data_iterator, index_iterator>;
+	using value_type      = typename iterator::value_type;
+	using pointer         = typename iterator::pointer;
+	using reference       = typename iterator::reference;
+	using difference_type = typename iterator::difference_type;
+	using size_type       = std::size_t;
+
+	// shortest run of consecutive indices that the runs modes copy as a block
+	static constexpr std::size_t min_run = 16;
+	// number of elements handed out at once by for_each_batch
+	static constexpr std::size_t batch_size = 16;
+
+	indexed_range(Iterable&& data, Indices&& indices) : data_(std::forward<Iterable>(data)), indices_(std::forward<Indices>(indices)) {
+	}
+	iterator begin() { return {std::begin(data_), std::begin(indices_)}; }
+	iterator end() { return {std::begin(data_), std::end(indices_)}; }
+	size_type size() const { return std::size(indices_); }
+	bool empty() const { return size() == 0; }
+	reference operator[](size_type i) { return begin()[static_cast<difference_type>(i)]; }
+
+	// copies up to count elements starting from the first-th element of the range into out
+	// and returns how many were copied. Contiguous arithmetic data with contiguous 4 or 8
+	// byte indices is read with SIMD gathers when the CPU supports them.
+	// The runs modes copy runs of at least min_run consecutive indices as blocks and gather
+	// the elements between them. gather_mode::runs compares every index, min_run at a time.
+	// gather_mode::sorted_runs relies on the indices increasing: a block is a run when its
+	// endpoints are, and the end of a run is found by a binary search
+	size_type gather(size_type first, size_type count, value_type* out, gather_mode mode = gather_mode::elements) const {
+		const size_type total = size();
+		if (first >= total)
+			return 0;
+		count = std::min(count, total - first);
+		if (mode == gather_mode::elements) {
+			_gather(first, count, out);
+			return count;
+		}
+		const auto index = std::next(std::begin(indices_), first);
+		size_type pending = 0;
+		for (size_type k = 0; k + min_run <= count;) {
+			const size_type run = mode == gather_mode::sorted_runs ? _sorted_run(index + k, count - k) : _run(index + k, count - k);
+			if (run == 0) {
+				k += min_run;
+				continue;
+			}
+			_gather(first + pending, k - pending, out + pending);
+			std::copy_n(std::next(std::begin(data_), index[k]), run, out + k);
+			k += run;
+			pending = k;
+		}
+		_gather(first + pending, count - pending, out + pending);
+		return count;
+	}
+	// calls f(const value_type* batch, std::size_t n) over consecutive batches of at most batch_size elements
+	template<typename F>
+	void for_each_batch(F&& f) const {
+		value_type batch[batch_size];
+		for (size_type first = 0, n; (n = gather(first, batch_size, batch)) > 0; first += n)
+			f(static_cast<const value_type*>(batch), n);
+	}
+private:
+	// true when index[k] == index[0] + k for k in [0, n)
+	template<typename IndexIterator>
+	static bool _consecutive(IndexIterator index, size_type n) {
+		using index_type = typename std::iterator_traits<IndexIterator>::value_type;
+		return index[n - 1] == static_cast<index_type>(index[0] + static_cast<index_type>(n - 1));
+	}
+	// _consecutive(index, min_run) for any indices: the endpoints filter out most blocks,
+	// the others are checked with an or of the differences, which vectorizes
+	template<typename IndexIterator>
+	static bool _consecutive_block(IndexIterator index) {
+		using index_type = typename std::iterator_traits<IndexIterator>::value_type;
+		if (!_consecutive(index, min_run))
+			return false;
+		const index_type start = index[0];
+		index_type mismatch = 0;
+		for (size_type k = 0; k < min_run; ++k)
+			mismatch |= index[k] ^ static_cast<index_type>(start + static_cast<index_type>(k));
+		return mismatch == 0;
+	}
+	// the length of the run of consecutive indices from index, among n, or 0 when it is
+	// shorter than min_run
+	template<typename IndexIterator>
+	static size_type _run(IndexIterator index, size_type n) {
+		size_type run = 0;
+		while (run + min_run <= n and (run == 0 or _consecutive(index, run + 1)) and _consecutive_block(index + run))
+			run += min_run;
+		if (run == 0)
+			return 0;
+		while (run < n and _consecutive(index, run + 1))
+			++run;
+		return run;
+	}
+	// as _run, for increasing indices: index[k] == index[0] + k holds up to the end of
+	// the run and never after it, so the end is found by doubling steps and a bisection
+	template<typename IndexIterator>
+	static size_type _sorted_run(IndexIterator index, size_type n) {
+		if (!_consecutive(index, min_run))
+			return 0;
+		size_type run = min_run, step = min_run;
+		for (; run + step <= n and _consecutive(index, run + step); step *= 2)
+			run += step;
+		for (step /= 2; step > 0; step /= 2) {
+			if (run + step <= n and _consecutive(index, run + step))
+				run += step;
+		}
+		return run;
+	}
+	// out[k] = data[indices[first + k]] for k in [0, n)
+	void _gather(size_type first, size_type n, value_type* out) const {
+		if constexpr (detail::is_contiguous_iterable_v<Iterable> and detail::is_contiguous_iterable_v<Indices> and std::is_arithmetic_v<value_type>)
+			detail::indexed_gather(std::data(data_), std::data(indices_) + first, n, out);
+		else {
+			const auto data = std::begin(data_);
+			const auto index = std::next(std::begin(indices_), first);
+			for (size_type k = 0; k < n; ++k)
+				out[k] = data[index[k]];
+		}
+	}
+
+	Iterable data_;
+	Indices indices_;
+};
+template<typename Iterable, typename Indices> indexed_range(Iterable&&, Indices&&) -> indexed_range<Iterable, Indices>;
+
+} // namespace iterutils
+
+#endif
@@ -0,0 +1,116 @@
+#ifndef _ITERUTILS_INSTRUMENT_H_
+#define _ITERUTILS_INSTRUMENT_H_
+
+// Opt-in counters of the operations done on adapter iterators, to find out which adapters
+// are hot and how much work they add per element. Compile with -DITERUTILS_INSTRUMENT to
+// enable them. Otherwise ITERUTILS_COUNT expands to nothing and the generated code is the
+// same as without this header.
+// Counters are thread local: snapshot() and reset() apply to the calling thread
+
+#include <array>
+#include <cstddef>
+#include <cstdint>
+#include <ostream>
+
+namespace iterutils {
+namespace instrument {
+
+enum class adapter {
+	zipped, chained, dynamic_chained, strided, cycle, ncycle, alternated,
+	series, repeat, transformed, filtered, generator, prefetched, indexed, merged,
+	chunked, sliding_window
+};
+enum class operation {
+	increment,   // ++ and --
+	dereference, // * and []
+	compare,     // == != < <= > >=
+	visit,       // dispatch on the alternative of a std::variant
+	jump         // += -= [] and iterator differences
+};
+
+constexpr std::size_t adapter_count = static_cast<std::size_t>(adapter::sliding_window) + 1;
+constexpr std::size_t operation_count = static_cast<std::size_t>(operation::jump) + 1;
+
+constexpr const char* name(adapter a) {
+	constexpr const char* names[adapter_count] = {
+		"zipped", "chained", "dynamic_chained", "strided", "cycle", "ncycle", "alternated",
+		"series", "repeat", "transformed", "filtered", "generator", "prefetched", "indexed", "merged",
+		"chunked", "sliding_window"
+	};
+	return names[static_cast<std::size_t>(a)];
+}
+constexpr const char* name(operation op) {
+	constexpr const char* names[operation_count] = {"increment", "dereference", "compare", "visit", "jump"};
+	return names[static_cast<std::size_t>(op)];
+}
+
+class counters {
+public:
+	std::uint64_t operator()(adapter a, operation op) const {
+		return counts_[static_cast<std::size_t>(a)][static_cast<std::size_t>(op)];
+	}
+	std::uint64_t& operator()(adapter a, operation op) {
+		return counts_[static_cast<std::size_t>(a)][static_cast<std::size_t>(op)];
+	}
+	// every operation done on the iterators of an adapter
+	std::uint64_t total(adapter a) const {
+		std::uint64_t sum = 0;
+		for (std::uint64_t count : counts_[static_cast<std::size_t>(a)])
+			sum += count;
+		return sum;
+	}
+
+	// the operations done between two snapshots
+	friend counters operator-(const counters& after, const counters& before) {
+		counters result;
+		for (std::size_t a = 0; a < adapter_count; ++a) {
+			for (std::size_t op = 0; op < operation_count; ++op)
+				result.counts_[a][op] = after.counts_[a][op] - before.counts_[a][op];
+		}
+		return result;
+	}
+	// one line per adapter that was used
+	friend std::ostream& operator<<(std::ostream& out, const counters& c) {
+		for (std::size_t a = 0; a < adapter_count; ++a) {
+			if (c.total(adapter(a)) == 0)
+				continue;
+			out << name(adapter(a)) << ":";
+			for (std::size_t op = 0; op < operation_count; ++op)
+				out << " " << name(operation(op)) << "=" << c.counts_[a][op];
+			out << "\n";
+		}
+		return out;
+	}
+private:
+	std::array<std::array<std::uint64_t, operation_count>, adapter_count> counts_{};
+};
+
+#ifdef ITERUTILS_INSTRUMENT
+constexpr bool enabled = true;
+
+namespace detail {
+inline thread_local counters current;
+} // namespace detail
+
+inline void record(adapter a, operation op) { ++detail::current(a, op); }
+inline counters snapshot() { return detail::current; }
+inline void reset() { detail::current = counters(); }
+#else
+constexpr bool enabled = false;
+
+// always empty
+inline counters snapshot() { return counters(); }
+inline void reset() {}
+#endif
+
+} // namespace instrument
+} // namespace iterutils
+
+#ifdef ITERUTILS_INSTRUMENT
+#define ITERUTILS_COUNT(adapter_name, operation_name) \
+	::iterutils::instrument::record(::iterutils::instrument::adapter::adapter_name, ::iterutils::instrument::operation::operation_name)
+#else
+#define ITERUTILS_COUNT(adapter_name, operation_name) ((void)0)
+#endif
+
+#endif
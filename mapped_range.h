@@ -0,0 +1,192 @@
+#ifndef _ITERUTILS_MAPPED_RANGE_H_
+#define _ITERUTILS_MAPPED_RANGE_H_
+
+// Memory mapped files as ranges. Only available on POSIX systems
+
+#if __has_include(<sys/mman.h>)
+
+#include <algorithm>
+#include <cerrno>
+#include <cstddef>
+#include <iterator>
+#include <stdexcept>
+#include <string>
+#include <system_error>
+#include <type_traits>
+#include <utility>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+namespace iterutils {
+
+// Random access iterator over the elements of a mapping. This is a class rather
+// than a plain pointer because strided_iterator derives from the iterator it strides
+template<typename T>
+class mapped_iterator {
+public:
+	using value_type        = std::remove_cv_t<T>;
+	using reference         = T&;
+	using pointer           = T*;
+	using difference_type   = std::ptrdiff_t;
+	using iterator_category = std::random_access_iterator_tag;
+
+	mapped_iterator() = default;
+	explicit mapped_iterator(T* p) : p_(p) {
+	}
+	// iterators to mutable elements convert to iterators to const ones
+	operator mapped_iterator<const T>() const { return mapped_iterator<const T>(p_); }
+
+	reference operator*() const { return *p_; }
+	pointer operator->() const { return p_; }
+	reference operator[](difference_type n) const { return p_[n]; }
+	pointer base() const { return p_; }
+
+	mapped_iterator& operator++() { ++p_; return *this; }
+	mapped_iterator operator++(int) { return mapped_iterator(p_++); }
+	mapped_iterator& operator--() { --p_; return *this; }
+	mapped_iterator operator--(int) { return mapped_iterator(p_--); }
+	mapped_iterator& operator+=(difference_type n) { p_ += n; return *this; }
+	mapped_iterator& operator-=(difference_type n) { p_ -= n; return *this; }
+	mapped_iterator operator+(difference_type n) const { return mapped_iterator(p_ + n); }
+	friend mapped_iterator operator+(difference_type n, const mapped_iterator& it) { return it + n; }
+	mapped_iterator operator-(difference_type n) const { return mapped_iterator(p_ - n); }
+	difference_type operator-(const mapped_iterator& other) const { return p_ - other.p_; }
+
+	bool operator==(const mapped_iterator& other) const { return p_ == other.p_; }
+	bool operator!=(const mapped_iterator& other) const { return p_ != other.p_; }
+	bool operator< (const mapped_iterator& other) const { return p_ <  other.p_; }
+	bool operator<=(const mapped_iterator& other) const { return p_ <= other.p_; }
+	bool operator> (const mapped_iterator& other) const { return p_ >  other.p_; }
+	bool operator>=(const mapped_iterator& other) const { return p_ >= other.p_; }
+private:
+	T* p_ = nullptr;
+};
+
+// access pattern hints for the kernel, see madvise(2). dont_need drops the loaded
+// pages, and with them any modification made to the elements
+enum class mapped_access { normal, sequential, random, will_need, dont_need };
+
+namespace detail {
+
+struct file_descriptor {
+	explicit file_descriptor(const std::string& path) : fd(::open(path.c_str(), O_RDONLY | O_CLOEXEC)) {
+		if (fd < 0)
+			throw std::system_error(errno, std::generic_category(), "cannot open " + path);
+	}
+	file_descriptor(const file_descriptor&) = delete;
+	file_descriptor& operator=(const file_descriptor&) = delete;
+	~file_descriptor() { ::close(fd); }
+	int fd;
+};
+
+inline int madvise_advice(mapped_access access) {
+	switch (access) {
+		case mapped_access::sequential: return MADV_SEQUENTIAL;
+		case mapped_access::random:     return MADV_RANDOM;
+		case mapped_access::will_need:  return MADV_WILLNEED;
+		case mapped_access::dont_need:  return MADV_DONTNEED;
+		default:                        return MADV_NORMAL;
+	}
+}
+
+} // namespace detail
+
+// Exposes a file, or the byte region [offset, offset+length) of it, as a random access range of T.
+// The mapping is private: elements can be modified (ie: sorted through a zipped_range) but the
+// changes are never written back to the file. Pages are loaded on first access, so opening is
+// O(1) regardless of the file size
+template<typename T>
+class mapped_range {
+	static_assert(std::is_trivially_copyable_v<T>, "mapped_range requires a trivially copyable element type");
+public:
+	using iterator        = mapped_iterator<T>;
+	using const_iterator  = mapped_iterator<const T>;
+	using value_type      = T;
+	using reference       = T&;
+	using pointer         = T*;
+	using size_type       = std::size_t;
+	using difference_type = std::ptrdiff_t;
+
+	static constexpr size_type npos = size_type(-1);
+
+	// offset and length are in bytes. A length past the end of the file is clamped and
+	// trailing bytes that do not make up a whole element are left out
+	explicit mapped_range(const std::string& path, size_type offset = 0, size_type length = npos, mapped_access access = mapped_access::normal) {
+		if (offset % alignof(T) != 0)
+			throw std::invalid_argument("mapped_range offset is not aligned for the element type");
+		detail::file_descriptor file(path);
+		struct stat status;
+		if (::fstat(file.fd, &status) != 0)
+			throw std::system_error(errno, std::generic_category(), "cannot stat " + path);
+		const size_type file_size = static_cast<size_type>(status.st_size);
+		if (offset > file_size)
+			throw std::out_of_range("mapped_range offset is past the end of " + path);
+		size_ = std::min(length, file_size - offset) / sizeof(T);
+		if (size_ == 0)
+			return;
+		// mmap offsets must be a multiple of the page size
+		const size_type page = static_cast<size_type>(::sysconf(_SC_PAGESIZE));
+		const size_type map_offset = offset - offset % page;
+		map_length_ = offset - map_offset + size_*sizeof(T);
+		map_ = ::mmap(nullptr, map_length_, PROT_READ | PROT_WRITE, MAP_PRIVATE, file.fd, static_cast<off_t>(map_offset));
+		if (map_ == MAP_FAILED) {
+			map_ = nullptr;
+			throw std::system_error(errno, std::generic_category(), "cannot map " + path);
+		}
+		data_ = reinterpret_cast<T*>(static_cast<char*>(map_) + (offset - map_offset));
+		if (access != mapped_access::normal)
+			advise(access);
+	}
+	mapped_range(const mapped_range&) = delete;
+	mapped_range& operator=(const mapped_range&) = delete;
+	mapped_range(mapped_range&& other) noexcept
+	: map_(std::exchange(other.map_, nullptr)), map_length_(std::exchange(other.map_length_, 0)),
+	data_(std::exchange(other.data_, nullptr)), size_(std::exchange(other.size_, 0)) {
+	}
+	mapped_range& operator=(mapped_range&& other) noexcept {
+		if (this != &other) {
+			_unmap();
+			map_ = std::exchange(other.map_, nullptr);
+			map_length_ = std::exchange(other.map_length_, 0);
+			data_ = std::exchange(other.data_, nullptr);
+			size_ = std::exchange(other.size_, 0);
+		}
+		return *this;
+	}
+	~mapped_range() { _unmap(); }
+
+	// tells the kernel how the elements will be accessed (read ahead for sequential
+	// scans, no read ahead for random lookups...)
+	void advise(mapped_access access) {
+		if (map_ and ::madvise(map_, map_length_, detail::madvise_advice(access)) != 0)
+			throw std::system_error(errno, std::generic_category(), "madvise");
+	}
+
+	iterator begin() const { return iterator(data_); }
+	iterator end() const { return iterator(data_ + size_); }
+	const_iterator cbegin() const { return const_iterator(data_); }
+	const_iterator cend() const { return const_iterator(data_ + size_); }
+
+	T* data() const { return data_; }
+	size_type size() const { return size_; }
+	bool empty() const { return size_ == 0; }
+	T& operator[](size_type i) const { return data_[i]; }
+private:
+	void _unmap() {
+		if (map_)
+			::munmap(map_, map_length_);
+	}
+
+	void* map_ = nullptr;
+	size_type map_length_ = 0;
+	T* data_ = nullptr;
+	size_type size_ = 0;
+};
+
+} // namespace iterutils
+
+#endif // __has_include(<sys/mman.h>)
+
+#endif
@@ -0,0 +1,283 @@
+#ifndef _ITERUTILS_MATRIX_VIEW_H_
+#define _ITERUTILS_MATRIX_VIEW_H_
+
+#include <algorithm>
+#include <iterator>
+#include <type_traits>
+#include "util.h"
+
+namespace iterutils {
+
+// Row-major traversal of a rows x cols block whose consecutive rows start ld elements apart
+template<typename Iterator>
+class matrix_iterator {
+public:
+	using value_type        = typename std::iterator_traits<Iterator>::value_type;
+	using reference         = typename std::iterator_traits<Iterator>::reference;
+	using pointer           = typename std::iterator_traits<Iterator>::pointer;
+	using difference_type   = typename std::iterator_traits<Iterator>::difference_type;
+	using iterator_category = std::random_access_iterator_tag;
+
+	matrix_iterator() = default;
+	matrix_iterator(Iterator first, std::size_t rows, std::size_t cols, difference_type ld, std::size_t pos)
+	: first_(first), size_(rows*cols), cols_(cols), ld_(ld) {
+		_seek(pos);
+	}
+
+	reference operator*() const { return row_[col_]; }
+	reference operator[](difference_type n) const { return *(*this + n); }
+
+	matrix_iterator& operator++() {
+		++pos_;
+		if (++col_ == cols_) {
+			col_ = 0;
+			// the row after the last one may be past the end of the storage
+			if (pos_ < size_)
+				row_ += ld_;
+		}
+		return *this;
+	}
+	matrix_iterator operator++(int) {
+		auto copy = *this;
+		++(*this);
+		return copy;
+	}
+	matrix_iterator& operator--() {
+		if (col_ == 0) {
+			if (pos_ < size_)
+				row_ -= ld_;
+			col_ = cols_;
+		}
+		--col_;
+		--pos_;
+		return *this;
+	}
+	matrix_iterator operator--(int) {
+		auto copy = *this;
+		--(*this);
+		return copy;
+	}
+	matrix_iterator& operator+=(difference_type n) {
+		_seek(pos_ + n);
+		return *this;
+	}
+	matrix_iterator& operator-=(difference_type n) {
+		_seek(pos_ - n);
+		return *this;
+	}
+	matrix_iterator operator+(difference_type n) const {
+		auto copy = *this;
+		return copy += n;
+	}
+	friend matrix_iterator operator+(difference_type n, const matrix_iterator& it) {
+		return it + n;
+	}
+	matrix_iterator operator-(difference_type n) const {
+		auto copy = *this;
+		return copy -= n;
+	}
+	difference_type operator-(const matrix_iterator& other) const {
+		return static_cast<difference_type>(pos_) - static_cast<difference_type>(other.pos_);
+	}
+
+	bool operator==(const matrix_iterator& other) const { return pos_ == other.pos_; }
+	bool operator!=(const matrix_iterator& other) const { return pos_ != other.pos_; }
+	bool operator< (const matrix_iterator& other) const { return pos_ <  other.pos_; }
+	bool operator<=(const matrix_iterator& other) const { return pos_ <= other.pos_; }
+	bool operator> (const matrix_iterator& other) const { return pos_ >  other.pos_; }
+	bool operator>=(const matrix_iterator& other) const { return pos_ >= other.pos_; }
+private:
+	void _seek(std::size_t pos) {
+		pos_ = pos;
+		const std::size_t rows = cols_ ? size_ / cols_ : 0;
+		const std::size_t row = cols_ ? pos / cols_ : 0;
+		col_ = pos - row*cols_;
+		// the end position stays on the last row, see operator++
+		row_ = first_ + std::min(row, rows ? rows-1 : 0)*ld_;
+	}
+
+	Iterator first_;
+	Iterator row_;
+	std::size_t size_ = 0;
+	std::size_t cols_ = 0;
+	difference_type ld_ = 0;
+	std::size_t pos_ = 0;
+	std::size_t col_ = 0;
+};
+
+// Steps through the elements of a matrix that are step apart, ie: a column (step ld) or
+// the diagonal (step ld+1). The iterator keeps an index and computes first[index*step]
+// on dereference, so the end never forms an iterator past the end of the storage
+template<typename Iterator>
+class matrix_line_iterator {
+public:
+	using value_type        = typename std::iterator_traits<Iterator>::value_type;
+	using reference         = typename std::iterator_traits<Iterator>::reference;
+	using pointer           = typename std::iterator_traits<Iterator>::pointer;
+	using difference_type   = typename std::iterator_traits<Iterator>::difference_type;
+	using iterator_category = std::random_access_iterator_tag;
+
+	matrix_line_iterator() = default;
+	matrix_line_iterator(Iterator first, difference_type step, difference_type index)
+	: first_(first), step_(step), index_(index) {
+	}
+
+	reference operator*() const { return first_[index_*step_]; }
+	reference operator[](difference_type n) const { return first_[(index_ + n)*step_]; }
+
+	matrix_line_iterator& operator++() { ++index_; return *this; }
+	matrix_line_iterator& operator--() { --index_; return *this; }
+	matrix_line_iterator operator++(int) { auto copy = *this; ++index_; return copy; }
+	matrix_line_iterator operator--(int) { auto copy = *this; --index_; return copy; }
+	matrix_line_iterator& operator+=(difference_type n) { index_ += n; return *this; }
+	matrix_line_iterator& operator-=(difference_type n) { index_ -= n; return *this; }
+	matrix_line_iterator operator+(difference_type n) const { auto copy = *this; return copy += n; }
+	matrix_line_iterator operator-(difference_type n) const { auto copy = *this; return copy -= n; }
+	friend matrix_line_iterator operator+(difference_type n, const matrix_line_iterator& it) { return it + n; }
+	difference_type operator-(const matrix_line_iterator& other) const { return index_ - other.index_; }
+
+	bool operator==(const matrix_line_iterator& other) const { return index_ == other.index_; }
+	bool operator!=(const matrix_line_iterator& other) const { return index_ != other.index_; }
+	bool operator< (const matrix_line_iterator& other) const { return index_ <  other.index_; }
+	bool operator<=(const matrix_line_iterator& other) const { return index_ <= other.index_; }
+	bool operator> (const matrix_line_iterator& other) const { return index_ >  other.index_; }
+	bool operator>=(const matrix_line_iterator& other) const { return index_ >= other.index_; }
+
+	// distance between consecutive elements in the storage
+	difference_type step() const { return step_; }
+private:
+	Iterator first_;
+	difference_type step_ = 1;
+	difference_type index_ = 0;
+};
+
+template<typename Iterator>
+class matrix_tile_iterator;
+
+// Two dimensional view over row-major storage (ie: a vector holding rows*cols elements).
+// Rows, columns, the diagonal and rectangular tiles are ranges over the same storage.
+// Tiles are matrix views themselves, with the row stride (ld) of the whole matrix
+template<typename Iterator>
+class matrix_view {
+public:
+	using iterator        = matrix_iterator<Iterator>;
+	using value_type      = typename iterator::value_type;
+	using reference       = typename iterator::reference;
+	using pointer         = typename iterator::pointer;
+	using difference_type = typename iterator::difference_type;
+	using size_type       = std::size_t;
+	using row_type        = iterator_range<Iterator>;
+	using column_type     = iterator_range<matrix_line_iterator<Iterator>>;
+	using tile_range      = iterator_range<matrix_tile_iterator<Iterator>>;
+
+	// 32x32 tiles of doubles take 8 KiB, so a tile being read and a tile being
+	// written fit in L1 together
+	static constexpr size_type default_block = 32;
+
+	matrix_view(Iterator first, size_type rows, size_type cols, difference_type ld)
+	: first_(first), rows_(rows), cols_(cols), ld_(ld) {
+	}
+	template<typename Iterable>
+	matrix_view(Iterable& storage, size_type rows, size_type cols)
+	: matrix_view(std::begin(storage), rows, cols, cols) {
+	}
+
+	iterator begin() const { return {first_, rows_, cols_, ld_, 0}; }
+	iterator end() const { return {first_, rows_, cols_, ld_, size()}; }
+
+	size_type rows() const { return rows_; }
+	size_type cols() const { return cols_; }
+	size_type size() const { return rows_*cols_; }
+	// distance between the first elements of two consecutive rows
+	difference_type ld() const { return ld_; }
+
+	reference operator()(size_type row, size_type col) const {
+		return first_[row*ld_ + col];
+	}
+	row_type row(size_type row) const {
+		Iterator first = first_ + row*ld_;
+		return {first, first + cols_};
+	}
+	column_type column(size_type col) const {
+		const Iterator first = first_ + col;
+		return {{first, ld_, 0}, {first, ld_, static_cast<difference_type>(rows_)}};
+	}
+	column_type diagonal() const {
+		return {{first_, ld_ + 1, 0}, {first_, ld_ + 1, static_cast<difference_type>(std::min(rows_, cols_))}};
+	}
+	// the rows x cols block whose top left element is (row, col), clamped to the matrix
+	matrix_view tile(size_type row, size_type col, size_type rows, size_type cols) const {
+		return {first_ + row*ld_ + col, std::min(rows, rows_ - row), std::min(cols, cols_ - col), ld_};
+	}
+	// every rows x cols tile in row-major order. Tiles on the bottom and right edges may be smaller
+	tile_range tiles(size_type rows = default_block, size_type cols = default_block) const {
+		const size_type tile_cols = (cols_ + cols - 1) / cols;
+		const size_type count = ((rows_ + rows - 1) / rows) * tile_cols;
+		return {{*this, rows, cols, tile_cols, 0}, {*this, rows, cols, tile_cols, count}};
+	}
+private:
+	Iterator first_;
+	size_type rows_;
+	size_type cols_;
+	difference_type ld_;
+};
+template<typename Iterable>
+matrix_view(Iterable&, std::size_t, std::size_t) -> matrix_view<decltype(std::begin(std::declval<Iterable&>()))>;
+
+// Visits the tiles of a matrix_view. Tiles are built on dereference
+template<typename Iterator>
+class matrix_tile_iterator {
+public:
+	using value_type        = matrix_view<Iterator>;
+	using reference         = matrix_view<Iterator>;
+	using pointer           = void;
+	using difference_type   = std::ptrdiff_t;
+	using iterator_category = std::input_iterator_tag;
+
+	matrix_tile_iterator(const matrix_view<Iterator>& matrix, std::size_t rows, std::size_t cols, std::size_t tile_cols, std::size_t index)
+	: matrix_(matrix), rows_(rows), cols_(cols), tile_cols_(tile_cols), index_(index) {
+	}
+
+	reference operator*() const {
+		return matrix_.tile(index_ / tile_cols_ * rows_, index_ % tile_cols_ * cols_, rows_, cols_);
+	}
+	matrix_tile_iterator& operator++() {
+		++index_;
+		return *this;
+	}
+	matrix_tile_iterator operator++(int) {
+		auto copy = *this;
+		++index_;
+		return copy;
+	}
+	bool operator==(const matrix_tile_iterator& other) const { return index_ == other.index_; }
+	bool operator!=(const matrix_tile_iterator& other) const { return index_ != other.index_; }
+private:
+	matrix_view<Iterator> matrix_;
+	std::size_t rows_;
+	std::size_t cols_;
+	std::size_t tile_cols_;
+	std::size_t index_;
+};
+
+// dst = transpose(src), where dst is a src.cols() x src.rows() matrix. The copy goes one
+// block x block tile at a time, so the source rows and the destination rows of a tile
+// stay in cache until all their elements are used. A plain loop misses on every element
+// of either the source or the destination once a row is larger than the cache
+template<typename InputIterator, typename OutputIterator>
+void transpose(const matrix_view<InputIterator>& src, const matrix_view<OutputIterator>& dst, std::size_t block = matrix_view<InputIterator>::default_block) {
+	for (std::size_t row = 0; row < src.rows(); row += block) {
+		const std::size_t row_end = std::min(row + block, src.rows());
+		for (std::size_t col = 0; col < src.cols(); col += block) {
+			const std::size_t col_end = std::min(col + block, src.cols());
+			for (std::size_t r = row; r < row_end; ++r) {
+				for (std::size_t c = col; c < col_end; ++c)
+					dst(c, r) = src(r, c);
+			}
+		}
+	}
+}
+
+} // namespace iterutils
+
+#endif
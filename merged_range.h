@@ -0,0 +1,317 @@
+#ifndef _ITERUTILS_MERGED_RANGE_H_
+#define _ITERUTILS_MERGED_RANGE_H_
+
+#include <array>
+#include <functional>
+#include <iterator>
+#include <memory>
+#include <tuple>
+#include <type_traits>
+#include <utility>
+#include <variant>
+#include <vector>
+#include "util.h"
+#include "chained_range.h"
+#include "instrument.h"
+
+namespace iterutils {
+
+namespace detail {
+
+// Loser tree over k inputs: input i is the leaf at node k+i and every internal node
+// 1..k-1 keeps the input that lost the match played there. Replacing the winner only
+// replays the matches on the path from its leaf to the root, which is O(log k) comparisons.
+// beats(a, b) tells whether the next element of input a goes before the one of input b
+template<typename Tree, typename Beats>
+std::size_t loser_tree_build(Tree& tree, std::size_t k, std::size_t node, Beats& beats) {
+	if (node >= k)
+		return node - k;
+	std::size_t winner = loser_tree_build(tree, k, 2*node, beats);
+	std::size_t loser = loser_tree_build(tree, k, 2*node+1, beats);
+	if (beats(loser, winner))
+		std::swap(winner, loser);
+	tree[node] = loser;
+	return winner;
+}
+template<typename Tree, typename Beats>
+std::size_t loser_tree_replay(Tree& tree, std::size_t k, std::size_t leaf, Beats& beats) {
+	std::size_t winner = leaf;
+	for (std::size_t node = (k + leaf) / 2; node > 0; node /= 2) {
+		// selects rather than branches, the outcome of a match is hard to predict
+		const std::size_t challenger = tree[node];
+		const bool swap = beats(challenger, winner);
+		tree[node] = swap ? winner : challenger;
+		winner = swap ? challenger : winner;
+	}
+	return winner;
+}
+
+// ties go to the earlier input, so equal elements come out in input order and the merge is stable.
+// One comparison is enough: the earlier input wins unless the other element is strictly smaller
+template<typename Compare, typename Reference>
+bool merge_beats(const Compare& comp, std::size_t a, const Reference& x, std::size_t b, const Reference& y) {
+	return a < b ? !comp(y, x) : comp(x, y);
+}
+
+template<typename T>
+struct non_deduced {
+	using type = T;
+};
+
+// the reference of the inputs when they all agree, a copy of the element otherwise
+template<typename ...Iterators>
+using merged_reference = std::conditional_t<
+	std::conjunction_v<std::is_same<
+		typename std::iterator_traits<Iterators>::reference,
+		typename std::iterator_traits<std::tuple_element_t<0, std::tuple<Iterators...>>>::reference
+	>...>,
+	typename std::iterator_traits<std::tuple_element_t<0, std::tuple<Iterators...>>>::reference,
+	std::common_type_t<typename std::iterator_traits<Iterators>::value_type...>
+>;
+
+// merging reads every input once, so it is multipass only when all the inputs are
+template<typename ...Iterators>
+using merged_category = std::conditional_t<
+	std::conjunction_v<std::is_base_of<std::forward_iterator_tag, typename std::iterator_traits<Iterators>::iterator_category>...>,
+	std::forward_iterator_tag,
+	std::input_iterator_tag
+>;
+
+} // namespace detail
+
+// Iterates over the elements of sorted inputs in sorted order. The position in every
+// input is kept like in chained_iterator (plain iterators when they all have the same type,
+// variants otherwise), and a loser tree of the inputs picks the next element
+template<typename Compare, typename ...Iterators>
+class merged_iterator {
+	static_assert(sizeof...(Iterators) > 0, "merged_iterator needs at least one input");
+	static constexpr std::size_t K = sizeof...(Iterators);
+	using element_type = detail::chain_element<Iterators...>;
+public:
+	using value_type        = std::common_type_t<typename std::iterator_traits<Iterators>::value_type...>;
+	using reference         = detail::merged_reference<Iterators...>;
+	using pointer           = std::add_pointer_t<value_type>;
+	using difference_type   = std::common_type_t<typename std::iterator_traits<Iterators>::difference_type...>;
+	using iterator_category = detail::merged_category<Iterators...>;
+
+	merged_iterator() = default;
+	merged_iterator(Compare comp, Iterators... firsts, Iterators... lasts)
+		: merged_iterator(std::index_sequence_for<Iterators...>(), std::move(comp), firsts..., lasts...) {
+	}
+
+	reference operator*() const { ITERUTILS_COUNT(merged, dereference); return _deref(winner_); }
+
+	merged_iterator& operator++() {
+		ITERUTILS_COUNT(merged, increment);
+		_visit([](auto& it) { ++it; }, its_[winner_]);
+		done_[winner_] = its_[winner_] == ends_[winner_];
+		auto beats = [this](std::size_t a, std::size_t b) { return _beats(a, b); };
+		_settle(detail::loser_tree_replay(tree_, K, winner_, beats));
+		return *this;
+	}
+	merged_iterator operator++(int) {
+		auto copy = *this;
+		++(*this);
+		return copy;
+	}
+
+	// the end iterator is the one whose inputs are all exhausted
+	bool operator==(const merged_iterator& other) const {
+		ITERUTILS_COUNT(merged, compare);
+		return winner_ == other.winner_ and (winner_ == K or its_ == other.its_);
+	}
+	bool operator!=(const merged_iterator& other) const { return !(*this == other); }
+
+	// the input the current element comes from
+	std::size_t input() const { return winner_; }
+private:
+	template<std::size_t ...I>
+	merged_iterator(std::index_sequence<I...>, Compare comp, Iterators... firsts, Iterators... lasts)
+		: its_{detail::make_chain_element<element_type, I>(firsts)...},
+		ends_{detail::make_chain_element<element_type, I>(lasts)...},
+		comp_(std::move(comp)) {
+		for (std::size_t k = 0; k < K; ++k)
+			done_[k] = its_[k] == ends_[k];
+		auto beats = [this](std::size_t a, std::size_t b) { return _beats(a, b); };
+		_settle(detail::loser_tree_build(tree_, K, 1, beats));
+	}
+
+	template<typename F, typename Element>
+	static decltype(auto) _visit(F&& f, Element& element) {
+		if constexpr (detail::is_variant_v<Element>) {
+			ITERUTILS_COUNT(merged, visit);
+			return std::visit(std::forward<F>(f), element);
+		}
+		else
+			return f(element);
+	}
+	reference _deref(std::size_t k) const { return _visit([](const auto& it) -> reference { return *it; }, its_[k]); }
+	// exhausted inputs lose every match
+	bool _beats(std::size_t a, std::size_t b) const {
+		if (done_[a] or done_[b])
+			return !done_[a];
+		return detail::merge_beats<Compare, reference>(comp_.get(), a, _deref(a), b, _deref(b));
+	}
+	// the winner of the tree is exhausted only when every input is
+	void _settle(std::size_t winner) { winner_ = done_[winner] ? K : winner; }
+
+	std::array<element_type, K> its_;
+	std::array<element_type, K> ends_;
+	std::array<std::size_t, K> tree_{};
+	// whether each input is exhausted, so that matches do not compare with ends_
+	std::array<bool, K> done_{};
+	std::size_t winner_ = K;
+	detail::function_box<Compare> comp_;
+};
+
+// Lazy merge of sorted ranges, ie: sorted shards or runs. Each element costs O(log K)
+// comparisons for K ranges, and equal elements come in the order of their ranges.
+// The comparator defaults to std::less, merged_range_by takes another one
+template<typename Compare, typename ...Iterables>
+class merged_range {
+public:
+	// const inputs are common here (ie: sorted shards that are only read), so the
+	// iterators are the ones std::begin gives rather than Iterable::iterator
+	using iterator   = merged_iterator<Compare, decltype(std::begin(std::declval<std::remove_reference_t<Iterables>&>()))...>;
+	using value_type = typename iterator::value_type;
+	using reference  = typename iterator::reference;
+	using pointer    = typename iterator::pointer;
+
+	merged_range(Iterables&&... iterables) : comp_(), t(std::forward<Iterables>(iterables)...) {
+	}
+	// the comparator is not deduced, see merged_range_by
+	merged_range(typename detail::non_deduced<Compare>::type comp, Iterables&&... iterables)
+		: comp_(std::move(comp)), t(std::forward<Iterables>(iterables)...) {
+	}
+	iterator begin() { return std::apply([this](auto&... iterables) { return iterator(comp_, std::begin(iterables)..., std::end(iterables)...); }, t); }
+	iterator end() { return std::apply([this](auto&... iterables) { return iterator(comp_, std::end(iterables)..., std::end(iterables)...); }, t); }
+
+	template<typename R = merged_range>
+	std::enable_if_t<!is_infinite<R>::value and (... and detail::has_size_v<Iterables>), size_t>
+	size() const { return std::apply([](auto&... iterables) { return (std::size_t(0) + ... + std::size(iterables)); }, t); }
+private:
+	Compare comp_;
+	std::tuple<Iterables...> t;
+};
+template<typename ...Iterables>
+merged_range(Iterables&&...) -> merged_range<std::less<>, Iterables...>;
+
+// merged_range ordered by comp
+template<typename Compare, typename ...Iterables>
+merged_range<Compare, Iterables...> merged_range_by(Compare comp, Iterables&&... iterables) {
+	return {std::move(comp), std::forward<Iterables>(iterables)...};
+}
+
+template<typename Compare, typename ...T>
+struct is_infinite<merged_range<Compare, T...>> : public std::disjunction<is_infinite<T>...> {};
+
+namespace detail {
+
+// bounds of every input of a dynamic merge, shared by its iterators
+template<typename Iterator>
+struct dynamic_merge_inputs {
+	std::vector<Iterator> begins;
+	std::vector<Iterator> ends;
+	std::size_t size = 0;
+};
+
+} // namespace detail
+
+// merged_iterator over a runtime number of inputs of the same type. Copies allocate
+// (the positions and the tree are vectors), increments do not
+template<typename Iterator, typename Compare>
+class dynamic_merged_iterator {
+public:
+	using value_type        = typename std::iterator_traits<Iterator>::value_type;
+	using reference         = typename std::iterator_traits<Iterator>::reference;
+	using pointer           = typename std::iterator_traits<Iterator>::pointer;
+	using difference_type   = typename std::iterator_traits<Iterator>::difference_type;
+	using iterator_category = detail::merged_category<Iterator>;
+
+	dynamic_merged_iterator() = default;
+	dynamic_merged_iterator(const detail::dynamic_merge_inputs<Iterator>* inputs, std::vector<Iterator> its, Compare comp)
+		: inputs_(inputs), its_(std::move(its)), tree_(its_.size()), winner_(its_.size()), comp_(std::move(comp)) {
+		if (!its_.empty()) {
+			auto beats = [this](std::size_t a, std::size_t b) { return _beats(a, b); };
+			_settle(detail::loser_tree_build(tree_, its_.size(), 1, beats));
+		}
+	}
+
+	reference operator*() const { ITERUTILS_COUNT(merged, dereference); return *its_[winner_]; }
+
+	dynamic_merged_iterator& operator++() {
+		ITERUTILS_COUNT(merged, increment);
+		++its_[winner_];
+		auto beats = [this](std::size_t a, std::size_t b) { return _beats(a, b); };
+		_settle(detail::loser_tree_replay(tree_, its_.size(), winner_, beats));
+		return *this;
+	}
+	dynamic_merged_iterator operator++(int) {
+		auto copy = *this;
+		++(*this);
+		return copy;
+	}
+
+	bool operator==(const dynamic_merged_iterator& other) const {
+		ITERUTILS_COUNT(merged, compare);
+		return winner_ == other.winner_ and (winner_ == its_.size() or its_ == other.its_);
+	}
+	bool operator!=(const dynamic_merged_iterator& other) const { return !(*this == other); }
+
+	// the input the current element comes from
+	std::size_t input() const { return winner_; }
+private:
+	bool _done(std::size_t k) const { return its_[k] == inputs_->ends[k]; }
+	// exhausted inputs lose every match
+	bool _beats(std::size_t a, std::size_t b) const {
+		const bool a_done = _done(a), b_done = _done(b);
+		if (a_done or b_done)
+			return !a_done;
+		return detail::merge_beats<Compare, reference>(comp_.get(), a, *its_[a], b, *its_[b]);
+	}
+	void _settle(std::size_t winner) { winner_ = _done(winner) ? its_.size() : winner; }
+
+	const detail::dynamic_merge_inputs<Iterator>* inputs_ = nullptr;
+	std::vector<Iterator> its_;
+	std::vector<std::size_t> tree_;
+	std::size_t winner_ = 0;
+	detail::function_box<Compare> comp_;
+};
+
+// Lazy merge of a runtime sequence of sorted ranges (ie: a vector of sorted vectors)
+template<typename Iterable, typename Compare = std::less<>>
+class dynamic_merged_range {
+	using source_reference = decltype(*std::begin(std::declval<std::remove_reference_t<Iterable>&>()));
+	using source_iterator = decltype(std::begin(std::declval<source_reference>()));
+public:
+	using iterator   = dynamic_merged_iterator<source_iterator, Compare>;
+	using value_type = typename iterator::value_type;
+	using reference  = typename iterator::reference;
+	using pointer    = typename iterator::pointer;
+
+	dynamic_merged_range(Iterable&& iterable, Compare comp = Compare())
+	: iterable_(std::forward<Iterable>(iterable)), inputs_(std::make_unique<detail::dynamic_merge_inputs<source_iterator>>()), comp_(std::move(comp)) {
+		for (auto&& input : iterable_) {
+			inputs_->begins.push_back(std::begin(input));
+			inputs_->ends.push_back(std::end(input));
+			inputs_->size += std::distance(std::begin(input), std::end(input));
+		}
+	}
+	iterator begin() const { return {inputs_.get(), inputs_->begins, comp_}; }
+	iterator end() const { return {inputs_.get(), inputs_->ends, comp_}; }
+
+	std::size_t size() const { return inputs_->size; }
+	std::size_t inputs() const { return inputs_->begins.size(); }
+private:
+	Iterable iterable_;
+	std::unique_ptr<detail::dynamic_merge_inputs<source_iterator>> inputs_;
+	Compare comp_;
+};
+template<typename Iterable>
+dynamic_merged_range(Iterable&&) -> dynamic_merged_range<Iterable>;
+template<typename Iterable, typename Compare>
+dynamic_merged_range(Iterable&&, Compare) -> dynamic_merged_range<Iterable, Compare>;
+
+} // namespace iterutils
+
+#endif
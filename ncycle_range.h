@@ -1,18 +1,28 @@
 #ifndef _ITERUTILS_NCYCLE_RANGE_H_
 #define _ITERUTILS_NCYCLE_RANGE_H_
 
+#include <algorithm>
 #include <iterator>
 #include <type_traits>
+#include <vector>
 #include "util.h"
+#include "segmented.h"
+#include "instrument.h"
 
 namespace iterutils {
 
+// Marks the end of an ncycle: the end of the range on the last lap, when no wrap-around
+// is left. Iterators wrap to the begin when they reach the end with n_ > 0, so they only
+// sit on the end of their range once n_ == 0 and comparing reads their position only
+struct ncycle_sentinel {};
+
 template<typename Tag, typename Iterator>
 class ncycle_iterator {};
 
 template<typename Tag, typename Iterator>
 ncycle_iterator<Tag, Iterator>&
 operator++(ncycle_iterator<Tag, Iterator>& it) {
+	ITERUTILS_COUNT(ncycle, increment);
 	if (++it.it_ == it.end_ and it.n_ > 0) {
 		it.it_ = it.begin_;
 		--it.n_;
@@ -29,6 +39,7 @@ operator++(ncycle_iterator<Tag, Iterator>& it, int) {
 template<typename Tag, typename Iterator>
 ncycle_iterator<Tag, Iterator>&
 operator--(ncycle_iterator<Tag, Iterator>& it) {
+	ITERUTILS_COUNT(ncycle, increment);
 	if (it.it_ == it.begin_) {
 		it.it_ = it.end_;
 		++it.n_;
@@ -46,8 +57,15 @@ operator--(ncycle_iterator<Tag, Iterator>& it, int) {
 template<typename Tag, typename Iterator>
 ncycle_iterator<Tag, Iterator>&
 operator+=(ncycle_iterator<Tag, Iterator>& it, typename ncycle_iterator<Tag, Iterator>::difference_type n) {
-	it.n_ -= (n + (it.it_ - it.begin_)) / (it.end_ - it.begin_);
-	it.it_ = it.begin_ + (n + (it.it_ - it.begin_)) % (it.end_ - it.begin_);
+	ITERUTILS_COUNT(ncycle, jump);
+	if (n < 0)
+		return it -= -n;
+	// landing exactly on the end counts one lap more than there is left: stay on the last lap, at its end
+	const auto length = it.end_ - it.begin_;
+	const auto offset = n + (it.it_ - it.begin_);
+	const std::size_t laps = std::min<std::size_t>(offset / length, it.n_);
+	it.n_ -= laps;
+	it.it_ = it.begin_ + (offset - static_cast<decltype(offset)>(laps) * length);
 	return it;
 }
 template<typename Tag, typename Iterator>
@@ -59,8 +77,11 @@ operator+(const ncycle_iterator<Tag, Iterator>& it, typename ncycle_iterator<Tag
 template<typename Tag, typename Iterator>
 ncycle_iterator<Tag, Iterator>&
 operator-=(ncycle_iterator<Tag, Iterator>& it, typename ncycle_iterator<Tag, Iterator>::difference_type n) {
-	it.n_ += ((it.end_ - it.it_) + n) / (it.end_ - it.begin_);
-	it.it_ = it.end_ - 1 -  ((it.end_ - it.it_) + n) % (it.end_ - it.begin_);
+	ITERUTILS_COUNT(ncycle, jump);
+	if (n < 0)
+		return it += -n;
+	it.n_ += ((it.end_ - it.it_) - 1 + n) / (it.end_ - it.begin_);
+	it.it_ = it.end_ - 1 - ((it.end_ - it.it_) - 1 + n) % (it.end_ - it.begin_);
 	return it;
 }
 template<typename Tag, typename Iterator>
@@ -86,12 +107,17 @@ public:
 	ncycle_iterator() = default;
 	ncycle_iterator(Iterator begin, Iterator end, Iterator it, std::size_t n) : begin_(begin), end_(end), it_(it), n_(n) {}
 
-	reference operator*() const { return *it_; }
-	bool operator==(const ncycle_iterator& other) const { return n_ == other.n_ and it_ == other.it_; }
-	bool operator!=(const ncycle_iterator& other) const { return n_ != other.n_ or it_ != other.it_; }
+	reference operator*() const { ITERUTILS_COUNT(ncycle, dereference); return *it_; }
+	bool operator==(const ncycle_iterator& other) const { ITERUTILS_COUNT(ncycle, compare); return n_ == other.n_ and it_ == other.it_; }
+	bool operator!=(const ncycle_iterator& other) const { ITERUTILS_COUNT(ncycle, compare); return n_ != other.n_ or it_ != other.it_; }
+	friend bool operator==(const ncycle_iterator& it, ncycle_sentinel) { ITERUTILS_COUNT(ncycle, compare); return it.it_ == it.end_; }
+	friend bool operator!=(const ncycle_iterator& it, ncycle_sentinel) { ITERUTILS_COUNT(ncycle, compare); return it.it_ != it.end_; }
+	friend bool operator==(ncycle_sentinel, const ncycle_iterator& it) { return it == ncycle_sentinel(); }
+	friend bool operator!=(ncycle_sentinel, const ncycle_iterator& it) { return it != ncycle_sentinel(); }
 
 	friend ncycle_iterator& operator++<std::forward_iterator_tag, Iterator>(ncycle_iterator&);
 	friend ncycle_iterator  operator++<std::forward_iterator_tag, Iterator>(ncycle_iterator&, int);
+	template<typename, typename> friend struct segmented_iterator_traits;
 protected:
 	Iterator begin_;
 	Iterator end_;
@@ -131,30 +157,56 @@ public:
 	friend ncycle_iterator& operator-=<iterator_category, Iterator>(ncycle_iterator&,       difference_type);
 	friend ncycle_iterator  operator- <iterator_category, Iterator>(const ncycle_iterator&, difference_type);
 
+	difference_type operator-(const ncycle_iterator& other) const {
+		ITERUTILS_COUNT(ncycle, jump);
+		const difference_type laps = static_cast<difference_type>(other.n_) - static_cast<difference_type>(this->n_);
+		return laps * (this->end_ - this->begin_) + (this->it_ - other.it_);
+	}
 	bool operator< (const ncycle_iterator& other) const {
+		ITERUTILS_COUNT(ncycle, compare);
 		return (this->n_ > other.n_) or (this->n_ == other.n_ and this->it_ < other.it_);
 	}
 	bool operator<=(const ncycle_iterator& other) const {
+		ITERUTILS_COUNT(ncycle, compare);
 		return (this->n_ > other.n_) or (this->n_ == other.n_ and this->it_ <= other.it_);
 	}
 	bool operator>(const ncycle_iterator& other) const {
+		ITERUTILS_COUNT(ncycle, compare);
 		return (this->n_ < other.n_) or (this->n_ == other.n_ and this->it_ > other.it_);
 	}
 	bool operator>=(const ncycle_iterator& other) const {
+		ITERUTILS_COUNT(ncycle, compare);
 		return (this->n_ < other.n_) or (this->n_ == other.n_ and this->it_ >= other.it_);
 	}
 };
 template<typename Iterator>
 ncycle_iterator(Iterator, Iterator, Iterator) -> ncycle_iterator<typename Iterator::iterator_category, Iterator>;
 
-template<typename Iterable>
-detail::specialize_iterator_from_iterables<ncycle_iterator, Iterable> ncycle_begin(Iterable& iterable, std::size_t n) {
-	return {std::begin(iterable), std::end(iterable), std::begin(iterable), n};
-}
 template<typename Iterable>
 detail::specialize_iterator_from_iterables<ncycle_iterator, Iterable> ncycle_end(Iterable& iterable) {
 	return {std::begin(iterable), std::end(iterable), std::end(iterable), 0};
 }
+template<typename Iterable>
+detail::specialize_iterator_from_iterables<ncycle_iterator, Iterable> ncycle_begin(Iterable& iterable, std::size_t n) {
+	// n_ counts the remaining wrap-arounds, so the last lap starts with n_ == 0
+	if (n == 0 or std::begin(iterable) == std::end(iterable))
+		return ncycle_end(iterable);
+	return {std::begin(iterable), std::end(iterable), std::begin(iterable), n-1};
+}
+
+template<typename Iterable>
+class ncycle_range;
+
+namespace detail {
+
+template<typename T>
+struct is_ncycle_range : public std::false_type {};
+template<typename Iterable>
+struct is_ncycle_range<ncycle_range<Iterable>> : public std::true_type {};
+template<typename T>
+constexpr bool is_ncycle_range_v = is_ncycle_range<T>::value;
+
+} // namespace detail
 
 template<typename Iterable>
 class ncycle_range {
@@ -166,20 +218,224 @@ public:
 
 	ncycle_range(Iterable&& iterable, std::size_t n) : iterable_(std::forward<Iterable>(iterable)), n_(n) {
 	}
+	// n laps over an ncycle_range of m laps are n*m laps over its range, which
+	// is cheaper than checking both wrap-arounds on every increment
+	template<typename Other, typename = std::enable_if_t<detail::is_ncycle_range_v<std::remove_reference_t<Other>>>>
+	ncycle_range(Other&& other, std::size_t n) : iterable_(std::forward<Other>(other).iterable_), n_(other.n_*n) {
+	}
 	iterator begin() { return ncycle_begin(iterable_, n_); }
 	iterator end() { return ncycle_end(iterable_); }
+	ncycle_sentinel sentinel() const { return {}; }
 
-	std::enable_if_t<!is_infinite<ncycle_range>::value, size_t>
-	size() const { return iterable_.size()*n_; }
+	template<typename R = ncycle_range>
+	std::enable_if_t<!is_infinite<R>::value and detail::has_size_v<Iterable>, size_t>
+	size() const { return std::size(iterable_)*n_; }
+
+	// cuts fall at lap boundaries when there are at least as many laps as parts,
+	// otherwise inside laps. Only the lap containing a cut is advanced through
+	friend std::vector<iterator_range<iterator>> split(ncycle_range& range, std::size_t parts) {
+		const std::size_t length = std::distance(std::begin(range.iterable_), std::end(range.iterable_));
+		const std::size_t laps = length ? range.n_ : 0;
+		std::vector<iterator_range<iterator>> result;
+		result.reserve(parts);
+		iterator first = range.begin();
+		for (std::size_t i = 0; i < parts; ++i) {
+			std::size_t lap, offset;
+			if (parts <= laps) {
+				lap = (i+1) * laps / parts;
+				offset = 0;
+			}
+			else {
+				const std::size_t pos = (i+1) * length * laps / parts;
+				lap = length ? pos / length : laps;
+				offset = length ? pos % length : 0;
+			}
+			iterator last = lap >= laps ? range.end() : iterator(
+				std::begin(range.iterable_), std::end(range.iterable_),
+				std::next(std::begin(range.iterable_), offset), range.n_ - 1 - lap
+			);
+			result.emplace_back(first, last);
+			first = last;
+		}
+		return result;
+	}
 private:
+	template<typename> friend class ncycle_range;
+
 	Iterable iterable_;
 	std::size_t n_;
 };
 template<typename Iterable> ncycle_range(Iterable&& iterable, std::size_t) -> ncycle_range<Iterable>;
+// nested ncycle_ranges are flattened. The result refers to the range of an lvalue
+// ncycle_range and takes over the one of an rvalue
+template<typename Iterable> ncycle_range(ncycle_range<Iterable>&, std::size_t) -> ncycle_range<std::remove_reference_t<Iterable>&>;
+template<typename Iterable> ncycle_range(ncycle_range<Iterable>&&, std::size_t) -> ncycle_range<Iterable>;
 
 template<typename T>
 struct is_infinite<ncycle_range<T>> : public is_infinite<T> {};
 
+// Ncycle iterator that points to the bounds kept by its compact_ncycle_range instead of
+// holding its own copy of them, so it carries a pointer, its position and the remaining laps.
+// It is only valid while its range is alive
+template<typename Iterator>
+class compact_ncycle_iterator {
+public:
+	using value_type        = typename std::iterator_traits<Iterator>::value_type;
+	using reference         = typename std::iterator_traits<Iterator>::reference;
+	using pointer           = typename std::iterator_traits<Iterator>::pointer;
+	using difference_type   = typename std::iterator_traits<Iterator>::difference_type;
+	using iterator_category = typename std::iterator_traits<Iterator>::iterator_category;
+	using bounds_type       = detail::lap_bounds<Iterator>;
+
+	static_assert(std::is_base_of_v<std::forward_iterator_tag, iterator_category>, "cycling needs a multipass iterator");
+
+	compact_ncycle_iterator() = default;
+	compact_ncycle_iterator(const bounds_type* bounds, Iterator it, std::size_t n) : bounds_(bounds), it_(it), n_(n) {}
+
+	reference operator*() const { ITERUTILS_COUNT(ncycle, dereference); return *it_; }
+	reference operator[](difference_type n) const { return *(*this + n); }
+
+	compact_ncycle_iterator& operator++() {
+		ITERUTILS_COUNT(ncycle, increment);
+		if (++it_ == bounds_->end and n_ > 0) {
+			it_ = bounds_->begin;
+			--n_;
+		}
+		return *this;
+	}
+	compact_ncycle_iterator operator++(int) { auto copy = *this; ++(*this); return copy; }
+	compact_ncycle_iterator& operator--() {
+		ITERUTILS_COUNT(ncycle, increment);
+		if (it_ == bounds_->begin) {
+			it_ = bounds_->end;
+			++n_;
+		}
+		--it_;
+		return *this;
+	}
+	compact_ncycle_iterator operator--(int) { auto copy = *this; --(*this); return copy; }
+	compact_ncycle_iterator& operator+=(difference_type n) {
+		ITERUTILS_COUNT(ncycle, jump);
+		if (n < 0)
+			return *this -= -n;
+		const difference_type length = bounds_->end - bounds_->begin;
+		const difference_type offset = n + (it_ - bounds_->begin);
+		const std::size_t laps = std::min<std::size_t>(offset / length, n_);
+		n_ -= laps;
+		it_ = bounds_->begin + (offset - static_cast<difference_type>(laps) * length);
+		return *this;
+	}
+	compact_ncycle_iterator& operator-=(difference_type n) {
+		ITERUTILS_COUNT(ncycle, jump);
+		if (n < 0)
+			return *this += -n;
+		n_ += ((bounds_->end - it_) - 1 + n) / (bounds_->end - bounds_->begin);
+		it_ = bounds_->end - 1 - ((bounds_->end - it_) - 1 + n) % (bounds_->end - bounds_->begin);
+		return *this;
+	}
+	compact_ncycle_iterator operator+(difference_type n) const { auto copy = *this; return copy += n; }
+	compact_ncycle_iterator operator-(difference_type n) const { auto copy = *this; return copy -= n; }
+	difference_type operator-(const compact_ncycle_iterator& other) const {
+		ITERUTILS_COUNT(ncycle, jump);
+		const difference_type laps = static_cast<difference_type>(other.n_) - static_cast<difference_type>(n_);
+		return laps * (bounds_->end - bounds_->begin) + (it_ - other.it_);
+	}
+
+	bool operator==(const compact_ncycle_iterator& other) const { ITERUTILS_COUNT(ncycle, compare); return n_ == other.n_ and it_ == other.it_; }
+	bool operator!=(const compact_ncycle_iterator& other) const { ITERUTILS_COUNT(ncycle, compare); return n_ != other.n_ or it_ != other.it_; }
+	friend bool operator==(const compact_ncycle_iterator& it, ncycle_sentinel) { ITERUTILS_COUNT(ncycle, compare); return it.it_ == it.bounds_->end; }
+	friend bool operator!=(const compact_ncycle_iterator& it, ncycle_sentinel) { ITERUTILS_COUNT(ncycle, compare); return it.it_ != it.bounds_->end; }
+	friend bool operator==(ncycle_sentinel, const compact_ncycle_iterator& it) { return it == ncycle_sentinel(); }
+	friend bool operator!=(ncycle_sentinel, const compact_ncycle_iterator& it) { return it != ncycle_sentinel(); }
+	bool operator< (const compact_ncycle_iterator& other) const { ITERUTILS_COUNT(ncycle, compare); return (n_ > other.n_) or (n_ == other.n_ and it_ <  other.it_); }
+	bool operator<=(const compact_ncycle_iterator& other) const { ITERUTILS_COUNT(ncycle, compare); return (n_ > other.n_) or (n_ == other.n_ and it_ <= other.it_); }
+	bool operator> (const compact_ncycle_iterator& other) const { ITERUTILS_COUNT(ncycle, compare); return (n_ < other.n_) or (n_ == other.n_ and it_ >  other.it_); }
+	bool operator>=(const compact_ncycle_iterator& other) const { ITERUTILS_COUNT(ncycle, compare); return (n_ < other.n_) or (n_ == other.n_ and it_ >= other.it_); }
+private:
+	const bounds_type* bounds_ = nullptr;
+	Iterator it_;
+	std::size_t n_ = 0;
+};
+
+// ncycle_range whose iterators share the bounds of the range stored here, read at
+// construction. refresh() reads them again after the range reallocates or changes size,
+// which invalidates the iterators taken before
+template<typename Iterable>
+class compact_ncycle_range {
+public:
+	using iterator = compact_ncycle_iterator<typename std::remove_reference_t<Iterable>::iterator>;
+	using value_type = typename iterator::value_type;
+	using pointer = typename iterator::pointer;
+	using reference = typename iterator::reference;
+
+	compact_ncycle_range(Iterable&& iterable, std::size_t n) : iterable_(std::forward<Iterable>(iterable)), n_(n) {
+		refresh();
+	}
+	// the bounds of a copy point to the range of the copy
+	compact_ncycle_range(const compact_ncycle_range& other) : iterable_(other.iterable_), n_(other.n_) {
+		refresh();
+	}
+	compact_ncycle_range(compact_ncycle_range&& other) : iterable_(std::forward<Iterable>(other.iterable_)), n_(other.n_) {
+		refresh();
+	}
+	compact_ncycle_range& operator=(const compact_ncycle_range& other) {
+		iterable_ = other.iterable_;
+		n_ = other.n_;
+		refresh();
+		return *this;
+	}
+	compact_ncycle_range& operator=(compact_ncycle_range&& other) {
+		iterable_ = std::forward<Iterable>(other.iterable_);
+		n_ = other.n_;
+		refresh();
+		return *this;
+	}
+	iterator begin() const {
+		// n_ counts the remaining wrap-arounds, as in ncycle_begin
+		if (n_ == 0 or bounds_.begin == bounds_.end)
+			return {&bounds_, bounds_.end, 0};
+		return {&bounds_, bounds_.begin, n_-1};
+	}
+	iterator end() const {
+		return {&bounds_, bounds_.end, 0};
+	}
+	ncycle_sentinel sentinel() const { return {}; }
+
+	void refresh() { bounds_ = {std::begin(iterable_), std::end(iterable_)}; }
+
+	template<typename R = compact_ncycle_range>
+	std::enable_if_t<!is_infinite<R>::value and detail::has_size_v<Iterable>, size_t>
+	size() const { return std::size(iterable_)*n_; }
+private:
+	Iterable iterable_;
+	std::size_t n_;
+	typename iterator::bounds_type bounds_;
+};
+template<typename Iterable> compact_ncycle_range(Iterable&& iterable, std::size_t) -> compact_ncycle_range<Iterable>;
+
+template<typename T>
+struct is_infinite<compact_ncycle_range<T>> : public is_infinite<T> {};
+
+// every lap over the underlying range is a segment
+template<typename Tag, typename Iterator>
+struct segmented_iterator_traits<ncycle_iterator<Tag, Iterator>> {
+	static constexpr bool is_segmented = true;
+
+	template<typename F>
+	static ncycle_iterator<Tag, Iterator> for_each_segment(const ncycle_iterator<Tag, Iterator>& first, const ncycle_iterator<Tag, Iterator>& last, F&& f) {
+		Iterator local_first = first.it_;
+		for (std::size_t n = first.n_; ; --n) {
+			Iterator local_last = n == last.n_ ? last.it_ : first.end_;
+			Iterator local = f(local_first, local_last);
+			if (local != local_last)
+				return {first.begin_, first.end_, local, n};
+			if (n == last.n_)
+				return last;
+			local_first = first.begin_;
+		}
+	}
+};
+
 } // namespace iterutils
 
 #endif
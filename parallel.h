@@ -0,0 +1,220 @@
+#ifndef _ITERUTILS_PARALLEL_H_
+#define _ITERUTILS_PARALLEL_H_
+
+#include <algorithm>
+#include <atomic>
+#include <condition_variable>
+#include <deque>
+#include <exception>
+#include <functional>
+#include <iterator>
+#include <mutex>
+#include <optional>
+#include <thread>
+#include <vector>
+#include "util.h"
+#include "segmented.h"
+
+namespace iterutils {
+
+// Work-stealing thread pool. Every worker owns a task queue: it pops the most
+// recently pushed task from its own queue and, when that is empty, steals the
+// oldest task from the other queues. Tasks submitted from a worker go to its own queue.
+class thread_pool {
+public:
+	explicit thread_pool(std::size_t threads = std::max(1u, std::thread::hardware_concurrency()))
+	: queues_(threads) {
+		workers_.reserve(threads);
+		for (std::size_t i = 0; i < threads; ++i)
+			workers_.emplace_back([this, i] { _work(i); });
+	}
+	thread_pool(const thread_pool&) = delete;
+	thread_pool& operator=(const thread_pool&) = delete;
+	~thread_pool() {
+		{
+			std::lock_guard<std::mutex> lock(mutex_);
+			stop_ = true;
+		}
+		wake_.notify_all();
+		for (std::thread& worker : workers_)
+			worker.join();
+	}
+
+	std::size_t size() const { return workers_.size(); }
+
+	void submit(std::function<void()> task) {
+		std::size_t i = _worker_index();
+		if (i == npos)
+			i = next_queue_++ % queues_.size();
+		// counted before it is queued, else a worker could take it and decrement first
+		{
+			std::lock_guard<std::mutex> lock(mutex_);
+			++pending_;
+		}
+		{
+			std::lock_guard<std::mutex> lock(queues_[i].mutex);
+			queues_[i].tasks.push_back(std::move(task));
+		}
+		wake_.notify_one();
+	}
+	// runs one queued task on the calling thread. Returns false if there was none.
+	// Threads waiting for their tasks call this so that they help instead of blocking
+	bool run_one() {
+		std::size_t i = _worker_index();
+		return _run_one(i == npos ? 0 : i);
+	}
+
+private:
+	static constexpr std::size_t npos = std::size_t(-1);
+
+	struct queue {
+		std::mutex mutex;
+		std::deque<std::function<void()>> tasks;
+	};
+
+	std::size_t _worker_index() const {
+		return current_pool() == this ? current_index() : npos;
+	}
+	static const thread_pool*& current_pool() {
+		static thread_local const thread_pool* pool = nullptr;
+		return pool;
+	}
+	static std::size_t& current_index() {
+		static thread_local std::size_t index = npos;
+		return index;
+	}
+
+	bool _run_one(std::size_t own) {
+		std::function<void()> task;
+		for (std::size_t k = 0; k < queues_.size() and !task; ++k) {
+			queue& q = queues_[(own + k) % queues_.size()];
+			std::lock_guard<std::mutex> lock(q.mutex);
+			if (q.tasks.empty())
+				continue;
+			if (k == 0) {
+				task = std::move(q.tasks.back());
+				q.tasks.pop_back();
+			}
+			else {
+				task = std::move(q.tasks.front());
+				q.tasks.pop_front();
+			}
+		}
+		if (!task)
+			return false;
+		{
+			std::lock_guard<std::mutex> lock(mutex_);
+			--pending_;
+		}
+		task();
+		return true;
+	}
+	void _work(std::size_t i) {
+		current_pool() = this;
+		current_index() = i;
+		while (true) {
+			if (_run_one(i))
+				continue;
+			std::unique_lock<std::mutex> lock(mutex_);
+			wake_.wait(lock, [this] { return stop_ or pending_ > 0; });
+			if (stop_ and pending_ == 0)
+				return;
+		}
+	}
+
+	std::vector<queue> queues_;
+	std::vector<std::thread> workers_;
+	std::atomic<std::size_t> next_queue_{0};
+	std::mutex mutex_;
+	std::condition_variable wake_;
+	std::size_t pending_ = 0;
+	bool stop_ = false;
+};
+
+inline thread_pool& default_thread_pool() {
+	static thread_pool pool;
+	return pool;
+}
+
+namespace detail {
+
+// every worker gets a few parts so that uneven parts can be stolen
+constexpr std::size_t parts_per_thread = 4;
+
+// runs f(0) ... f(n-1) on the pool and waits for all of them, helping while tasks are
+// queued and sleeping until the last one finishes otherwise.
+// The first exception thrown by a task is rethrown here
+template<typename F>
+void parallel_invoke(thread_pool& pool, std::size_t n, F& f) {
+	std::size_t remaining = n;
+	std::exception_ptr error;
+	std::mutex mutex;
+	std::condition_variable done;
+	for (std::size_t i = 0; i < n; ++i) {
+		pool.submit([&, i] {
+			std::exception_ptr e;
+			try {
+				f(i);
+			}
+			catch (...) {
+				e = std::current_exception();
+			}
+			// notified under the lock, so the waiting caller cannot return and destroy done before
+			std::lock_guard<std::mutex> lock(mutex);
+			if (e and !error)
+				error = e;
+			if (--remaining == 0)
+				done.notify_all();
+		});
+	}
+	std::unique_lock<std::mutex> lock(mutex);
+	while (remaining > 0) {
+		lock.unlock();
+		const bool ran = pool.run_one();
+		lock.lock();
+		if (!ran)
+			done.wait(lock, [&] { return remaining == 0; });
+	}
+	if (error)
+		std::rethrow_exception(error);
+}
+
+} // namespace detail
+
+// applies f to every element of range from the threads of pool.
+// The range is divided with split(), so f must be safe to call concurrently
+template<typename Range, typename UnaryFunction>
+void parallel_for_each(Range&& range, UnaryFunction f, thread_pool& pool = default_thread_pool()) {
+	auto parts = split(range, pool.size() * detail::parts_per_thread);
+	auto task = [&parts, &f](std::size_t i) {
+		iterutils::for_each(parts[i].begin(), parts[i].end(), std::ref(f));
+	};
+	detail::parallel_invoke(pool, parts.size(), task);
+}
+
+// returns reduce(init, transform(x)) over every element x of range, computed from the threads of pool.
+// reduce must be associative. Partial results are combined in order, so it need not be commutative
+template<typename Range, typename T, typename BinaryReduction, typename UnaryTransform>
+T parallel_transform_reduce(Range&& range, T init, BinaryReduction reduce, UnaryTransform transform, thread_pool& pool = default_thread_pool()) {
+	auto parts = split(range, pool.size() * detail::parts_per_thread);
+	std::vector<std::optional<T>> partials(parts.size());
+	auto task = [&](std::size_t i) {
+		auto first = parts[i].begin(), last = parts[i].end();
+		if (first == last)
+			return;
+		T acc = transform(*first);
+		partials[i] = iterutils::accumulate(std::next(first), last, std::move(acc), [&](T a, auto&& x) {
+			return reduce(std::move(a), transform(std::forward<decltype(x)>(x)));
+		});
+	};
+	detail::parallel_invoke(pool, parts.size(), task);
+	for (std::optional<T>& partial : partials) {
+		if (partial)
+			init = reduce(std::move(init), std::move(*partial));
+	}
+	return init;
+}
+
+} // namespace iterutils
+
+#endif
@@ -0,0 +1,174 @@
+#ifndef _ITERUTILS_PREFETCHED_RANGE_H_
+#define _ITERUTILS_PREFETCHED_RANGE_H_
+
+#include <algorithm>
+#include <cstddef>
+#include <iterator>
+#include <memory>
+#include <type_traits>
+#include <utility>
+#include "util.h"
+#include "strided_range.h"
+#include "instrument.h"
+
+namespace iterutils {
+
+namespace detail {
+
+constexpr std::size_t cache_line_size = 64;
+
+// bytes between the addresses of consecutive elements, which sets how many
+// elements a cache line holds
+template<typename Iterator>
+struct prefetch_step {
+	static std::size_t bytes(const Iterator&) { return sizeof(typename std::iterator_traits<Iterator>::value_type); }
+};
+template<typename Iterator>
+struct prefetch_step<strided_iterator<Iterator>> {
+	static std::size_t bytes(const strided_iterator<Iterator>& it) {
+		const auto stride = it.step();
+		return sizeof(typename std::iterator_traits<Iterator>::value_type) * static_cast<std::size_t>(stride < 0 ? -stride : stride);
+	}
+};
+
+inline void prefetch(const void* address) {
+#if defined(__GNUC__) or defined(__clang__)
+	__builtin_prefetch(address, 0, 3);
+#else
+	(void)address;
+#endif
+}
+
+} // namespace detail
+
+// Forward iterator that keeps a second iterator distance elements ahead of the current
+// one and prefetches the element it points to. The lookahead hops period elements at a
+// time, period being the number of elements per cache line (1 for strides of a line or
+// more), so a contiguous range issues one prefetch per line and a strided one one per
+// element. The lookahead goes through the underlying iterator, so it moves on to the next
+// subrange of a chained_iterator before the current one is finished.
+// Iterators without an addressable reference (ie: transformed_iterator) are not prefetched
+template<typename Iterator>
+class prefetched_iterator {
+public:
+	using value_type        = typename std::iterator_traits<Iterator>::value_type;
+	using reference         = typename std::iterator_traits<Iterator>::reference;
+	using pointer           = typename std::iterator_traits<Iterator>::pointer;
+	using difference_type   = typename std::iterator_traits<Iterator>::difference_type;
+	using iterator_category = std::forward_iterator_tag;
+
+	static_assert(
+		std::is_base_of_v<std::forward_iterator_tag, typename std::iterator_traits<Iterator>::iterator_category>,
+		"prefetched_iterator needs a multipass iterator to look ahead"
+	);
+
+	prefetched_iterator() = default;
+	prefetched_iterator(Iterator it, Iterator end, std::size_t distance, std::size_t period)
+		: it_(it), ahead_(it), end_(end), period_(static_cast<difference_type>(std::max<std::size_t>(1, period))), countdown_(period_) {
+		for (std::size_t k = 0; k < distance and ahead_ != end_; k += period_) {
+			_prefetch();
+			_advance();
+		}
+	}
+
+	reference operator*() const { ITERUTILS_COUNT(prefetched, dereference); return *it_; }
+	prefetched_iterator& operator++() {
+		ITERUTILS_COUNT(prefetched, increment);
+		++it_;
+		if (--countdown_ == 0) {
+			countdown_ = period_;
+			if (ahead_ != end_) {
+				_prefetch();
+				_advance();
+			}
+		}
+		return *this;
+	}
+	prefetched_iterator operator++(int) {
+		auto copy = *this;
+		++(*this);
+		return copy;
+	}
+	bool operator==(const prefetched_iterator& other) const { ITERUTILS_COUNT(prefetched, compare); return it_ == other.it_; }
+	bool operator!=(const prefetched_iterator& other) const { ITERUTILS_COUNT(prefetched, compare); return it_ != other.it_; }
+
+	// the underlying iterator
+	const Iterator& base() const { return it_; }
+private:
+	void _prefetch() const {
+		if constexpr (std::is_lvalue_reference_v<reference>)
+			detail::prefetch(std::addressof(*ahead_));
+	}
+	// period elements further, or to the end
+	void _advance() {
+		if (period_ == 1)
+			++ahead_;
+		else if constexpr (std::is_base_of_v<std::random_access_iterator_tag, typename std::iterator_traits<Iterator>::iterator_category>)
+			ahead_ += std::min(period_, static_cast<difference_type>(end_ - ahead_));
+		else {
+			for (difference_type k = 0; k < period_ and ahead_ != end_; ++k)
+				++ahead_;
+		}
+	}
+
+	Iterator it_;
+	Iterator ahead_;
+	Iterator end_;
+	difference_type period_ = 1;
+	difference_type countdown_ = 1;
+};
+
+// Prefetches the elements of a range ahead of the iteration. distance is counted in
+// elements; by default it covers prefetch_lines cache misses, which is prefetch_lines
+// elements when every element sits on its own line (large strides) and more otherwise.
+// Helps scans whose addresses the hardware prefetchers cannot follow, ie: strides of a
+// page or more. Sequential scans are already prefetched by the hardware
+template<typename Iterable>
+class prefetched_range {
+	using base_iterator = decltype(std::begin(std::declval<Iterable&>()));
+public:
+	using iterator        = prefetched_iterator<base_iterator>;
+	using value_type      = typename iterator::value_type;
+	using pointer         = typename iterator::pointer;
+	using reference       = typename iterator::reference;
+	using difference_type = typename iterator::difference_type;
+	using size_type       = std::size_t;
+
+	static constexpr std::size_t prefetch_lines = 32;
+
+	prefetched_range(Iterable&& iterable, std::size_t distance = 0) : iterable_(std::forward<Iterable>(iterable)), distance_(distance) {
+	}
+	iterator begin() {
+		base_iterator first = std::begin(iterable_);
+		const std::size_t period = _period(first);
+		return {first, std::end(iterable_), distance_ ? distance_ : prefetch_lines * period, period};
+	}
+	iterator end() {
+		base_iterator last = std::end(iterable_);
+		return {last, last, 0, 1};
+	}
+
+	// only when the underlying range knows its size
+	template<typename I = std::remove_reference_t<Iterable>>
+	auto size() const -> decltype(std::size(std::declval<const I&>())) {
+		return std::size(iterable_);
+	}
+private:
+	// elements per cache line
+	static std::size_t _period(const base_iterator& first) {
+		const std::size_t step = std::max<std::size_t>(1, detail::prefetch_step<base_iterator>::bytes(first));
+		return std::max<std::size_t>(1, detail::cache_line_size / step);
+	}
+
+	Iterable iterable_;
+	std::size_t distance_;
+};
+template<typename Iterable> prefetched_range(Iterable&&) -> prefetched_range<Iterable>;
+template<typename Iterable> prefetched_range(Iterable&&, std::size_t) -> prefetched_range<Iterable>;
+
+template<typename Iterable>
+struct is_infinite<prefetched_range<Iterable>> : public is_infinite<std::remove_reference_t<Iterable>> {};
+
+} // namespace iterutils
+
+#endif
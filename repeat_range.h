@@ -1,7 +1,14 @@
 #ifndef _ITERUTILS_REPEAT_RANGE_H_
 #define _ITERUTILS_REPEAT_RANGE_H_
 
+#include <algorithm>
+#include <cstddef>
+#include <cstring>
+#include <iterator>
+#include <memory>
 #include <type_traits>
+#include "util.h"
+#include "instrument.h"
 
 namespace iterutils {
 
@@ -11,32 +18,35 @@ public:
 	using value_type = std::remove_reference_t<T>;
 	using pointer = std::add_pointer_t<std::remove_reference_t<T>>;
 	using reference = std::add_lvalue_reference_t<T>;
-	using difference_type = int;
+	using difference_type = std::ptrdiff_t;
 	using iterator_category = std::random_access_iterator_tag;
 
 	repeat_iterator(T&& e) : element(std::forward<T>(e)) {
 	}
 	reference operator*() {
+		ITERUTILS_COUNT(repeat, dereference);
 		return element;
 	}
-	reference operator[](int) {
+	reference operator[](difference_type) {
+		ITERUTILS_COUNT(repeat, jump);
+		ITERUTILS_COUNT(repeat, dereference);
 		return element;
 	}
-	repeat_iterator& operator++()    { return *this; }
-	repeat_iterator operator++(int)  { return *this; }
-	repeat_iterator& operator--()    { return *this; }
-	repeat_iterator operator--(int)  { return *this; }
-	repeat_iterator& operator+=(int) { return *this; }
-	repeat_iterator operator+(int)   { return *this; }
-	repeat_iterator& operator-=(int) { return *this; }
-	repeat_iterator operator-(int)   { return *this; }
-
-	bool operator!=(const repeat_iterator& other) const { return true;  }
-	bool operator==(const repeat_iterator& other) const { return false; }
-	bool operator< (const repeat_iterator& other) const { return false; }
-	bool operator<=(const repeat_iterator& other) const { return false; }
-	bool operator> (const repeat_iterator& other) const { return false; }
-	bool operator>=(const repeat_iterator& other) const { return false; }
+	repeat_iterator& operator++()    { ITERUTILS_COUNT(repeat, increment); return *this; }
+	repeat_iterator operator++(int)  { ITERUTILS_COUNT(repeat, increment); return *this; }
+	repeat_iterator& operator--()    { ITERUTILS_COUNT(repeat, increment); return *this; }
+	repeat_iterator operator--(int)  { ITERUTILS_COUNT(repeat, increment); return *this; }
+	repeat_iterator& operator+=(difference_type) { ITERUTILS_COUNT(repeat, jump); return *this; }
+	repeat_iterator operator+(difference_type)   { ITERUTILS_COUNT(repeat, jump); return *this; }
+	repeat_iterator& operator-=(difference_type) { ITERUTILS_COUNT(repeat, jump); return *this; }
+	repeat_iterator operator-(difference_type)   { ITERUTILS_COUNT(repeat, jump); return *this; }
+
+	bool operator!=(const repeat_iterator& other) const { ITERUTILS_COUNT(repeat, compare); return true;  }
+	bool operator==(const repeat_iterator& other) const { ITERUTILS_COUNT(repeat, compare); return false; }
+	bool operator< (const repeat_iterator& other) const { ITERUTILS_COUNT(repeat, compare); return false; }
+	bool operator<=(const repeat_iterator& other) const { ITERUTILS_COUNT(repeat, compare); return false; }
+	bool operator> (const repeat_iterator& other) const { ITERUTILS_COUNT(repeat, compare); return false; }
+	bool operator>=(const repeat_iterator& other) const { ITERUTILS_COUNT(repeat, compare); return false; }
 
 protected:
 	T element;
@@ -52,8 +62,9 @@ public:
 
 	repeat_range(T&& e) : element(std::forward<T>(e)) {
 	}
-	iterator begin() { return {std::forward<T>(element)}; }
-	iterator end()   { return {std::forward<T>(element)}; }
+	// every iterator holds its own copy, the element of an rvalue range must not be moved out
+	iterator begin() { return {value_type(element)}; }
+	iterator end()   { return {value_type(element)}; }
 protected:
 	T element;
 };
@@ -61,6 +72,122 @@ protected:
 template<typename T>
 struct is_infinite<repeat_range<T>> : public std::true_type {};
 
+namespace detail {
+
+// writes n copies of value at out. Values whose bytes are all equal (ie: zero) are a
+// memset. Small values are copied once and then doubled with memcpy up to a block that
+// stays in L1, which is then copied over the rest of the output. Values of a vector
+// register or more are stored from registers by a plain loop, which is faster
+template<typename T>
+void broadcast_n(T* out, std::size_t n, const T& value) {
+	static_assert(std::is_trivially_copyable_v<T>);
+	if (n == 0)
+		return;
+	unsigned char bytes[sizeof(T)];
+	std::memcpy(bytes, std::addressof(value), sizeof(T));
+	if (std::all_of(bytes, bytes + sizeof(T), [&bytes](unsigned char b) { return b == bytes[0]; })) {
+		std::memset(static_cast<void*>(out), bytes[0], n * sizeof(T));
+		return;
+	}
+	if constexpr (sizeof(T) > 16) {
+		std::fill_n(out, n, value);
+		return;
+	}
+	constexpr std::size_t block = 4096 / sizeof(T);
+	std::memcpy(static_cast<void*>(out), bytes, sizeof(T));
+	std::size_t done = 1;
+	while (done < n) {
+		const std::size_t k = std::min({done, block, n - done});
+		std::memcpy(static_cast<void*>(out + done), static_cast<const void*>(out), k * sizeof(T));
+		done += k;
+	}
+}
+
+} // namespace detail
+
+// Random access iterator over n copies of an element, which is owned by its repeat_n_range
+template<typename T>
+class repeat_n_iterator {
+public:
+	using value_type        = T;
+	using reference         = const T&;
+	using pointer           = const T*;
+	using difference_type   = std::ptrdiff_t;
+	using iterator_category = std::random_access_iterator_tag;
+
+	repeat_n_iterator() = default;
+	repeat_n_iterator(const T* element, difference_type i) : element_(element), i_(i) {
+	}
+
+	reference operator*() const { ITERUTILS_COUNT(repeat, dereference); return *element_; }
+	pointer operator->() const { return element_; }
+	reference operator[](difference_type) const { ITERUTILS_COUNT(repeat, jump); ITERUTILS_COUNT(repeat, dereference); return *element_; }
+
+	repeat_n_iterator& operator++() { ITERUTILS_COUNT(repeat, increment); ++i_; return *this; }
+	repeat_n_iterator& operator--() { ITERUTILS_COUNT(repeat, increment); --i_; return *this; }
+	repeat_n_iterator operator++(int) { ITERUTILS_COUNT(repeat, increment); auto copy = *this; ++i_; return copy; }
+	repeat_n_iterator operator--(int) { ITERUTILS_COUNT(repeat, increment); auto copy = *this; --i_; return copy; }
+	repeat_n_iterator& operator+=(difference_type n) { ITERUTILS_COUNT(repeat, jump); i_ += n; return *this; }
+	repeat_n_iterator& operator-=(difference_type n) { ITERUTILS_COUNT(repeat, jump); i_ -= n; return *this; }
+	repeat_n_iterator operator+(difference_type n) const { auto copy = *this; return copy += n; }
+	repeat_n_iterator operator-(difference_type n) const { auto copy = *this; return copy -= n; }
+	friend repeat_n_iterator operator+(difference_type n, const repeat_n_iterator& it) { return it + n; }
+	difference_type operator-(const repeat_n_iterator& other) const { ITERUTILS_COUNT(repeat, jump); return i_ - other.i_; }
+
+	bool operator==(const repeat_n_iterator& other) const { ITERUTILS_COUNT(repeat, compare); return i_ == other.i_; }
+	bool operator!=(const repeat_n_iterator& other) const { ITERUTILS_COUNT(repeat, compare); return i_ != other.i_; }
+	bool operator< (const repeat_n_iterator& other) const { ITERUTILS_COUNT(repeat, compare); return i_ <  other.i_; }
+	bool operator<=(const repeat_n_iterator& other) const { ITERUTILS_COUNT(repeat, compare); return i_ <= other.i_; }
+	bool operator> (const repeat_n_iterator& other) const { ITERUTILS_COUNT(repeat, compare); return i_ >  other.i_; }
+	bool operator>=(const repeat_n_iterator& other) const { ITERUTILS_COUNT(repeat, compare); return i_ >= other.i_; }
+
+	// iterutils::copy of a repeated element is a fill, or a broadcast into contiguous
+	// storage of trivially copyable elements
+	template<typename OutputIterator>
+	friend OutputIterator bulk_copy(const repeat_n_iterator& first, const repeat_n_iterator& last, OutputIterator out) {
+		const difference_type n = last.i_ - first.i_;
+		if constexpr (detail::is_contiguous_iterator_v<OutputIterator> and std::is_trivially_copyable_v<T> and
+			std::is_same_v<typename std::iterator_traits<OutputIterator>::value_type, T>) {
+			if (n > 0)
+				detail::broadcast_n(std::addressof(*out), static_cast<std::size_t>(n), *first.element_);
+			return out + n;
+		}
+		else
+			return std::fill_n(out, n, *first.element_);
+	}
+private:
+	const T* element_ = nullptr;
+	difference_type i_ = 0;
+};
+
+// The element repeated n times. Unlike repeat_range it has a size, so it can be copied
+// from, zipped with finite ranges and split. Iterators refer to the element stored in
+// the range, which must outlive them
+template<typename T>
+class repeat_n_range {
+public:
+	using value_type      = std::remove_cv_t<std::remove_reference_t<T>>;
+	using iterator        = repeat_n_iterator<value_type>;
+	using const_iterator  = iterator;
+	using reference       = typename iterator::reference;
+	using pointer         = typename iterator::pointer;
+	using difference_type = std::ptrdiff_t;
+	using size_type       = std::size_t;
+
+	repeat_n_range(T&& e, std::size_t n) : element_(std::forward<T>(e)), n_(n) {
+	}
+	iterator begin() const { return {std::addressof(element_), 0}; }
+	iterator end() const { return {std::addressof(element_), static_cast<difference_type>(n_)}; }
+
+	size_type size() const { return n_; }
+	bool empty() const { return n_ == 0; }
+	reference operator[](size_type) const { return element_; }
+private:
+	T element_;
+	std::size_t n_;
+};
+template<typename T> repeat_n_range(T&&, std::size_t) -> repeat_n_range<T>;
+
 } // namespace iterutils
 
 #endif
@@ -0,0 +1,173 @@
+#ifndef _ITERUTILS_SEGMENTED_H_
+#define _ITERUTILS_SEGMENTED_H_
+
+#include <algorithm>
+#include <functional>
+#include <iterator>
+#include <numeric>
+#include <utility>
+#include <type_traits>
+#include "util.h"
+
+namespace iterutils {
+
+// Segmented iterators (M. Austern, "Segmented Iterators and Hierarchical Algorithms")
+// iterate over a sequence of contiguous subranges. Adapters that are segmented
+// specialize this template and provide:
+//   static constexpr bool is_segmented = true;
+//   template<typename F> static Iterator for_each_segment(const Iterator& first, const Iterator& last, F&& f);
+// for_each_segment calls f(local_first, local_last) once for every segment of [first, last).
+// f returns the local iterator where it stopped processing. If that is not local_last,
+// the traversal stops and the corresponding iterator is returned. Otherwise last is returned.
+template<typename Iterator, typename = void>
+struct segmented_iterator_traits {
+	static constexpr bool is_segmented = false;
+};
+
+namespace detail {
+
+// Iterators that can write a whole range faster than element by element (ie: a repeated
+// value is a fill) declare a function found by argument dependent lookup:
+//   OutputIterator bulk_copy(Iterator first, Iterator last, OutputIterator out);
+// iterutils::copy calls it when it exists for the output iterator
+template<typename InputIterator, typename OutputIterator, typename = void>
+struct has_bulk_copy : public std::false_type {};
+template<typename InputIterator, typename OutputIterator>
+struct has_bulk_copy<InputIterator, OutputIterator, std::void_t<
+	decltype(bulk_copy(std::declval<InputIterator>(), std::declval<InputIterator>(), std::declval<OutputIterator>()))
+>> : public std::true_type {};
+template<typename InputIterator, typename OutputIterator>
+constexpr bool has_bulk_copy_v = has_bulk_copy<InputIterator, OutputIterator>::value;
+
+} // namespace detail
+
+// The following algorithms have the same semantics as their std:: counterparts
+// but run one tight loop per segment when given segmented iterators.
+// Segments may be segmented themselves (ie: a chained_range of chained_ranges)
+
+template<typename InputIterator, typename OutputIterator>
+OutputIterator copy(InputIterator first, InputIterator last, OutputIterator out) {
+	using traits = segmented_iterator_traits<InputIterator>;
+	if constexpr (detail::has_bulk_copy_v<InputIterator, OutputIterator>)
+		return bulk_copy(first, last, out);
+	else if constexpr (traits::is_segmented) {
+		traits::for_each_segment(first, last, [&out](auto local_first, auto local_last) {
+			out = iterutils::copy(local_first, local_last, out);
+			return local_last;
+		});
+		return out;
+	}
+	else
+		return std::copy(first, last, out);
+}
+
+template<typename ForwardIterator, typename T>
+void fill(ForwardIterator first, ForwardIterator last, const T& value) {
+	using traits = segmented_iterator_traits<ForwardIterator>;
+	if constexpr (traits::is_segmented) {
+		traits::for_each_segment(first, last, [&value](auto local_first, auto local_last) {
+			iterutils::fill(local_first, local_last, value);
+			return local_last;
+		});
+	}
+	else
+		std::fill(first, last, value);
+}
+
+template<typename InputIterator, typename T>
+InputIterator find(InputIterator first, InputIterator last, const T& value) {
+	using traits = segmented_iterator_traits<InputIterator>;
+	if constexpr (traits::is_segmented) {
+		return traits::for_each_segment(first, last, [&value](auto local_first, auto local_last) {
+			return iterutils::find(local_first, local_last, value);
+		});
+	}
+	else
+		return std::find(first, last, value);
+}
+
+template<typename InputIterator, typename T, typename BinaryOperation>
+T accumulate(InputIterator first, InputIterator last, T init, BinaryOperation op) {
+	using traits = segmented_iterator_traits<InputIterator>;
+	if constexpr (traits::is_segmented) {
+		traits::for_each_segment(first, last, [&init, &op](auto local_first, auto local_last) {
+			init = iterutils::accumulate(local_first, local_last, std::move(init), op);
+			return local_last;
+		});
+		return init;
+	}
+	else
+		return std::accumulate(first, last, std::move(init), op);
+}
+template<typename InputIterator, typename T>
+T accumulate(InputIterator first, InputIterator last, T init) {
+	return iterutils::accumulate(first, last, std::move(init), std::plus<>());
+}
+
+template<typename InputIterator, typename UnaryFunction>
+UnaryFunction for_each(InputIterator first, InputIterator last, UnaryFunction f) {
+	using traits = segmented_iterator_traits<InputIterator>;
+	if constexpr (traits::is_segmented) {
+		traits::for_each_segment(first, last, [&f](auto local_first, auto local_last) {
+			iterutils::for_each(local_first, local_last, std::ref(f));
+			return local_last;
+		});
+		return f;
+	}
+	else
+		return std::for_each(first, last, std::move(f));
+}
+
+namespace detail {
+
+template<typename Container, typename = void>
+struct has_reserve : public std::false_type {};
+template<typename Container>
+struct has_reserve<Container, std::void_t<decltype(std::declval<Container&>().reserve(std::size_t()))>> : public std::true_type {};
+
+template<typename Container, typename = void>
+struct has_push_back : public std::false_type {};
+template<typename Container>
+struct has_push_back<Container, std::void_t<decltype(std::declval<Container&>().push_back(std::declval<typename Container::value_type>()))>>
+: public std::true_type {};
+
+} // namespace detail
+
+// Builds a Container out of the elements of a finite range. The storage is allocated once
+// when the size of the range is known without walking it (it has a size() or random access
+// iterators). Contiguous containers of trivially copyable elements are then resized and
+// written with iterutils::copy, which copies contiguous subranges with memmove and uses
+// the bulk copies of the adapters. Other containers are appended to, or inserted into
+template<typename Container, typename Range>
+Container to(Range&& range) {
+	static_assert(!is_infinite_v<Range>, "Range is infinite");
+	using value_type = typename Container::value_type;
+	using category = typename std::iterator_traits<decltype(std::begin(range))>::iterator_category;
+	Container result;
+	if constexpr (detail::has_size_v<Range> or std::is_base_of_v<std::random_access_iterator_tag, category>) {
+		std::size_t n;
+		if constexpr (detail::has_size_v<Range>)
+			n = std::size(range);
+		else
+			n = std::distance(std::begin(range), std::end(range));
+		if constexpr (
+			detail::is_contiguous_iterator_v<typename Container::iterator> and
+			std::is_trivially_copyable_v<value_type> and std::is_default_constructible_v<value_type>
+		) {
+			result.resize(n);
+			iterutils::copy(std::begin(range), std::end(range), result.begin());
+			return result;
+		}
+		else if constexpr (detail::has_reserve<Container>::value)
+			result.reserve(n);
+	}
+	if constexpr (detail::has_push_back<Container>::value)
+		iterutils::copy(std::begin(range), std::end(range), std::back_inserter(result));
+	else
+		iterutils::copy(std::begin(range), std::end(range), std::inserter(result, result.end()));
+	return result;
+}
+
+} // namespace iterutils
+
+#endif
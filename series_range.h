@@ -1,82 +1,262 @@
 #ifndef _ITERUTILS_SERIES_RANGE_H_
 #define _ITERUTILS_SERIES_RANGE_H_
 
+#include <algorithm>
+#include <cmath>
+#include <cstddef>
+#include <cstring>
+#include <iterator>
 #include <type_traits>
+#include "util.h"
+#include "simd.h"
+#include "instrument.h"
 
 namespace iterutils {
 
+namespace detail {
+
+// start + i*step. Integers are computed unsigned, so that i*step may overflow
+// when the element itself does not
+template<typename T, typename Index>
+T series_element(T start, T step, Index i) {
+	if constexpr (std::is_integral_v<T> and !std::is_same_v<T, bool>) {
+		using U = std::make_unsigned_t<std::common_type_t<T, unsigned>>;
+		return static_cast<T>(U(start) + U(i) * U(step));
+	}
+	else
+		return start + static_cast<T>(i) * step;
+}
+
+} // namespace detail
+
+// Random access iterator over start, start+step, start+2*step... Elements are computed
+// as start + i*step from their index i, so floating point errors do not accumulate
+// and jumping anywhere costs the same as incrementing
 template<typename T>
 class series_iterator {
 public:
-	using value_type = T;
-	using pointer = std::add_pointer_t<T>;
-	using reference = std::add_lvalue_reference_t<T>;
-	using difference_type = T;
+	using value_type        = T;
+	using reference         = T;
+	using pointer           = void;
+	using difference_type   = std::ptrdiff_t;
 	using iterator_category = std::random_access_iterator_tag;
-	series_iterator(T i, T b) : i_(i), b_(b) {}
-	series_iterator& operator++() {
-		i_ += b_;
-		return *this;
-	}
-	series_iterator operator++(int) {
-		series_iterator copy = *this;
-		++(*this);
-		return copy;
-	}
-	series_iterator& operator--() {
-		i_ -= b_;
-		return *this;
+
+	series_iterator() = default;
+	series_iterator(T start, T step, difference_type i) : start_(start), step_(step), i_(i) {
 	}
-	series_iterator operator--(int) {
-		series_iterator copy = *this;
-		--(*this);
-		return copy;
+
+	reference operator*() const { ITERUTILS_COUNT(series, dereference); return detail::series_element(start_, step_, i_); }
+	reference operator[](difference_type n) const { ITERUTILS_COUNT(series, jump); ITERUTILS_COUNT(series, dereference); return detail::series_element(start_, step_, i_ + n); }
+
+	series_iterator& operator++() { ITERUTILS_COUNT(series, increment); ++i_; return *this; }
+	series_iterator& operator--() { ITERUTILS_COUNT(series, increment); --i_; return *this; }
+	series_iterator operator++(int) { ITERUTILS_COUNT(series, increment); auto copy = *this; ++i_; return copy; }
+	series_iterator operator--(int) { ITERUTILS_COUNT(series, increment); auto copy = *this; --i_; return copy; }
+	series_iterator& operator+=(difference_type n) { ITERUTILS_COUNT(series, jump); i_ += n; return *this; }
+	series_iterator& operator-=(difference_type n) { ITERUTILS_COUNT(series, jump); i_ -= n; return *this; }
+	series_iterator operator+(difference_type n) const { auto copy = *this; return copy += n; }
+	series_iterator operator-(difference_type n) const { auto copy = *this; return copy -= n; }
+	friend series_iterator operator+(difference_type n, const series_iterator& it) { return it + n; }
+	difference_type operator-(const series_iterator& other) const { ITERUTILS_COUNT(series, jump); return i_ - other.i_; }
+
+	bool operator==(const series_iterator& other) const { ITERUTILS_COUNT(series, compare); return i_ == other.i_; }
+	bool operator!=(const series_iterator& other) const { ITERUTILS_COUNT(series, compare); return i_ != other.i_; }
+	bool operator< (const series_iterator& other) const { ITERUTILS_COUNT(series, compare); return i_ <  other.i_; }
+	bool operator<=(const series_iterator& other) const { ITERUTILS_COUNT(series, compare); return i_ <= other.i_; }
+	bool operator> (const series_iterator& other) const { ITERUTILS_COUNT(series, compare); return i_ >  other.i_; }
+	bool operator>=(const series_iterator& other) const { ITERUTILS_COUNT(series, compare); return i_ >= other.i_; }
+private:
+	T start_ = T();
+	T step_ = T();
+	difference_type i_ = 0;
+};
+
+namespace detail {
+
+#if ITERUTILS_X86_SIMD
+// out[k] = start + (first+k)*step for as many whole vectors of Bytes as fit in n,
+// returns the number of elements written. Written with the gcc/clang vector extensions,
+// which are compiled for the instruction set of the calling kernel.
+// Floating point indices are exact below 2^24 (float) and 2^53 (double), which the
+// caller guarantees, so the results are the same as the scalar ones
+template<std::size_t Bytes, typename T>
+inline __attribute__((always_inline)) std::size_t series_fill_vector(T start, T step, std::size_t first, std::size_t n, T* out) {
+	// integers are computed unsigned, as in series_element
+	using E = typename std::conditional_t<std::is_integral_v<T>, std::make_unsigned<T>, std::common_type<T>>::type;
+	typedef E vector __attribute__((vector_size(Bytes)));
+	constexpr std::size_t lanes = Bytes / sizeof(T);
+	vector index;
+	for (std::size_t lane = 0; lane < lanes; ++lane)
+		index[lane] = static_cast<E>(first + lane);
+	std::size_t k = 0;
+	if constexpr (std::is_floating_point_v<T>) {
+		for (; k + lanes <= n; k += lanes, index += static_cast<T>(lanes)) {
+			const vector v = start + index * step;
+			std::memcpy(out + k, &v, sizeof(v));
+		}
 	}
-	series_iterator& operator+=(difference_type n) {
-		i_ += b_ * n;
-		return *this;
+	else {
+		// adding lanes*step is exact modulo 2^bits
+		vector v = static_cast<E>(start) + index * static_cast<E>(step);
+		const E increment = static_cast<E>(lanes * static_cast<E>(step));
+		for (; k + lanes <= n; k += lanes, v += increment)
+			std::memcpy(out + k, &v, sizeof(v));
 	}
-	series_iterator& operator-=(difference_type n) {
-		i_ -= b_ * n;
-		return *this;
+	return k;
+}
+
+template<typename T>
+ITERUTILS_TARGET("sse4.2")
+std::size_t series_fill_sse42(T start, T step, std::size_t first, std::size_t n, T* out) {
+	return series_fill_vector<16>(start, step, first, n, out);
+}
+template<typename T>
+ITERUTILS_TARGET("avx2")
+std::size_t series_fill_avx2(T start, T step, std::size_t first, std::size_t n, T* out) {
+	return series_fill_vector<32>(start, step, first, n, out);
+}
+template<typename T>
+ITERUTILS_TARGET("avx512f")
+std::size_t series_fill_avx512(T start, T step, std::size_t first, std::size_t n, T* out) {
+	return series_fill_vector<64>(start, step, first, n, out);
+}
+#endif
+
+// out[k] = start + (first+k)*step for k in [0, n)
+template<typename T>
+void series_fill(T start, T step, std::size_t first, std::size_t n, T* out) {
+	std::size_t k = 0;
+#if ITERUTILS_X86_SIMD
+	constexpr bool lanes = std::is_arithmetic_v<T> and !std::is_same_v<T, bool> and (sizeof(T) == 4 or sizeof(T) == 8);
+	if constexpr (lanes) {
+		std::size_t vectorizable = n;
+		if constexpr (std::is_floating_point_v<T>) {
+			// indices past this are not exactly representable as T
+			constexpr std::size_t exact = std::size_t(1) << (sizeof(T) == 4 ? 24 : 53);
+			vectorizable = first >= exact ? 0 : std::min(n, exact - first);
+		}
+		simd_level level = current_simd_level();
+#if !defined(__FMA__)
+		// avx512f brings fma, which the compiler may contract start + i*step into:
+		// the rounding would differ from the scalar elements, which cannot be contracted
+		if (std::is_floating_point_v<T> and level == simd_level::avx512)
+			level = simd_level::avx2;
+#endif
+		switch (level) {
+			case simd_level::avx512: k = series_fill_avx512(start, step, first, vectorizable, out); break;
+			case simd_level::avx2:   k = series_fill_avx2(start, step, first, vectorizable, out); break;
+			case simd_level::sse42:  k = series_fill_sse42(start, step, first, vectorizable, out); break;
+			default: break;
+		}
 	}
-	series_iterator operator+(difference_type n) {
-		series_iterator copy = *this;
-		return copy += n;
+#endif
+	for (; k < n; ++k)
+		out[k] = series_element(start, step, first + k);
+}
+
+} // namespace detail
+
+// Arithmetic progression start, start+step, start+2*step... up to stop, excluded.
+// step may be negative but not zero. Size, sum, membership and lookups are O(1)
+template<typename T>
+class series_range {
+	static_assert(std::is_arithmetic_v<T>, "series_range requires an arithmetic type");
+public:
+	using iterator        = series_iterator<T>;
+	using const_iterator  = series_iterator<T>;
+	using value_type      = T;
+	using reference       = T;
+	using pointer         = void;
+	using difference_type = std::ptrdiff_t;
+	using size_type       = std::size_t;
+
+	static constexpr size_type npos = size_type(-1);
+
+	series_range(T start, T stop, T step = T(1)) : start_(start), stop_(stop), step_(step) {
 	}
-	series_iterator operator-(difference_type n) {
-		series_iterator copy = *this;
-		return copy -= n;
+
+	iterator begin() const { return {start_, step_, 0}; }
+	iterator end() const { return {start_, step_, static_cast<difference_type>(size())}; }
+
+	T start() const { return start_; }
+	T stop() const { return stop_; }
+	T step() const { return step_; }
+
+	size_type size() const {
+		if constexpr (std::is_integral_v<T>) {
+			if (step_ > 0 ? !(start_ < stop_) : !(stop_ < start_))
+				return 0;
+			const unsigned_type distance = _distance(start_, stop_);
+			const unsigned_type stride = _stride();
+			return distance / stride + (distance % stride != 0);
+		}
+		else {
+			const T n = std::ceil((stop_ - start_) / step_);
+			return n > 0 ? static_cast<size_type>(n) : 0;
+		}
 	}
-	difference_type operator-(const series_iterator& other) const {
-		return (i_ - other.i_) / b_;
+	bool empty() const { return size() == 0; }
+	T operator[](size_type i) const { return detail::series_element(start_, step_, i); }
+
+	// n*start + step*n*(n-1)/2. Integer sums wrap around instead of overflowing
+	T sum() const {
+		const size_type n = size();
+		const size_type triangle = n % 2 == 0 ? n / 2 * (n - 1) : (n - 1) / 2 * n;
+		if constexpr (std::is_integral_v<T>) {
+			using U = std::make_unsigned_t<std::common_type_t<T, unsigned>>;
+			return static_cast<T>(U(n) * U(start_) + U(triangle) * U(step_));
+		}
+		else
+			return static_cast<T>(n) * start_ + static_cast<T>(triangle) * step_;
 	}
-	T& operator*() const {
-		return i_;
+	// the position of x in the series, or npos
+	size_type index_of(T x) const {
+		const size_type n = size();
+		if constexpr (std::is_integral_v<T>) {
+			if (step_ > 0 ? x < start_ : start_ < x)
+				return npos;
+			const unsigned_type distance = _distance(start_, x);
+			const unsigned_type stride = _stride();
+			if (distance % stride != 0 or distance / stride >= n)
+				return npos;
+			return distance / stride;
+		}
+		else {
+			// the nearest index, whose element must be x exactly: 0.7 is not in series_range(0.0, 1.0, 0.1)
+			// because 0.0 + 7*0.1 rounds to 0.7000000000000001
+			const T i = std::round((x - start_) / step_);
+			if (!(i >= 0 and i < static_cast<T>(n)))
+				return npos;
+			return (*this)[static_cast<size_type>(i)] == x ? static_cast<size_type>(i) : npos;
+		}
 	}
-	T operator[](int x) const {
-		return i_ + b_ * x;
+	bool contains(T x) const { return index_of(x) != npos; }
+
+	// writes count elements starting from the first-th into out and returns how many were
+	// written. 4 and 8 byte arithmetic types are written with SIMD stores when the CPU supports them
+	size_type copy_to(size_type first, size_type count, T* out) const {
+		const size_type n = size();
+		if (first >= n)
+			return 0;
+		count = std::min(count, n - first);
+		detail::series_fill(start_, step_, first, count, out);
+		return count;
 	}
-	bool operator!=(const series_iterator& other) const { return i_ != other._i; }
-	bool operator==(const series_iterator& other) const { return i_ == other._i; }
-	bool operator< (const series_iterator& other) const { return i_ <  other._i; }
-	bool operator<=(const series_iterator& other) const { return i_ <= other._i; }
-	bool operator> (const series_iterator& other) const { return i_ >  other._i; }
-	bool operator>=(const series_iterator& other) const { return i_ >= other._i; }
+	size_type copy_to(T* out) const { return copy_to(0, size(), out); }
 private:
-	T i_;
-	const T b_;
-};
+	using unsigned_type = std::make_unsigned_t<std::conditional_t<std::is_integral_v<T>, T, int>>;
 
-template<typename T>
-class series_range {
-public:
-	series_range(T start, T stop, T step) {
+	// |to - from| when to lies in the direction of the steps, without overflowing T
+	unsigned_type _distance(T from, T to) const {
+		return step_ > 0 ? unsigned_type(unsigned_type(to) - unsigned_type(from)) : unsigned_type(unsigned_type(from) - unsigned_type(to));
 	}
-	series_iterator<T> begin() const { return {start, step}; }
-	series_iterator<T> end()   const { return begin() + (stop-start+1) / step; }
-private:
-	T start, stop, step;
+	unsigned_type _stride() const {
+		return step_ > 0 ? unsigned_type(step_) : unsigned_type(unsigned_type(0) - unsigned_type(step_));
+	}
+
+	T start_;
+	T stop_;
+	T step_;
 };
 
 } // namespace iterutils
@@ -0,0 +1,45 @@
+#ifndef _ITERUTILS_SIMD_H_
+#define _ITERUTILS_SIMD_H_
+
+// Runtime CPU dispatch for the vectorized kernels used by some adapters.
+// Kernels are compiled for a specific instruction set with ITERUTILS_TARGET and
+// only called when current_simd_level() reports that the CPU supports it, so
+// the library does not require any -m flags. Other compilers and architectures
+// only get the scalar fallbacks.
+
+#if (defined(__GNUC__) || defined(__clang__)) && defined(__x86_64__)
+#define ITERUTILS_X86_SIMD 1
+#define ITERUTILS_TARGET(isa) __attribute__((target(isa)))
+#include <immintrin.h>
+#else
+#define ITERUTILS_X86_SIMD 0
+#define ITERUTILS_TARGET(isa)
+#endif
+
+namespace iterutils {
+namespace detail {
+
+enum class simd_level { scalar, sse42, avx2, avx512 };
+
+inline simd_level detect_simd_level() {
+#if ITERUTILS_X86_SIMD
+	__builtin_cpu_init();
+	if (__builtin_cpu_supports("avx512f"))
+		return simd_level::avx512;
+	if (__builtin_cpu_supports("avx2"))
+		return simd_level::avx2;
+	if (__builtin_cpu_supports("sse4.2"))
+		return simd_level::sse42;
+#endif
+	return simd_level::scalar;
+}
+
+inline simd_level current_simd_level() {
+	static const simd_level level = detect_simd_level();
+	return level;
+}
+
+} // namespace detail
+} // namespace iterutils
+
+#endif
@@ -0,0 +1,126 @@
+#ifndef _ITERUTILS_SLIDING_WINDOW_RANGE_H_
+#define _ITERUTILS_SLIDING_WINDOW_RANGE_H_
+
+#include <algorithm>
+#include <cstddef>
+#include <iterator>
+#include <type_traits>
+#include <utility>
+#include "util.h"
+#include "instrument.h"
+
+namespace iterutils {
+
+// Iterates over the windows of n consecutive elements of a range as iterator_ranges:
+// [0, n), [1, n+1)... The iterator keeps the first and the last element of its window and
+// moves both, so it has the category of the range and random access jumps are O(1).
+// The end iterator has its last element at the end of the range, and iterators are
+// compared by their last element
+template<typename Iterator>
+class sliding_window_iterator {
+public:
+	using value_type        = iterator_range<Iterator>;
+	using reference         = iterator_range<Iterator>;
+	using pointer           = void;
+	using difference_type   = typename std::iterator_traits<Iterator>::difference_type;
+	using iterator_category = std::conditional_t<
+		std::is_base_of_v<std::random_access_iterator_tag, typename std::iterator_traits<Iterator>::iterator_category>,
+		std::random_access_iterator_tag,
+		typename std::iterator_traits<Iterator>::iterator_category
+	>;
+
+	sliding_window_iterator() = default;
+	sliding_window_iterator(Iterator first, Iterator last) : first_(first), last_(last) {
+	}
+
+	reference operator*() const { ITERUTILS_COUNT(sliding_window, dereference); return {first_, std::next(last_)}; }
+	reference operator[](difference_type k) const { ITERUTILS_COUNT(sliding_window, jump); ITERUTILS_COUNT(sliding_window, dereference); return {first_ + k, last_ + k + 1}; }
+
+	sliding_window_iterator& operator++() { ITERUTILS_COUNT(sliding_window, increment); ++first_; ++last_; return *this; }
+	sliding_window_iterator& operator--() { ITERUTILS_COUNT(sliding_window, increment); --first_; --last_; return *this; }
+	sliding_window_iterator operator++(int) { auto copy = *this; ++(*this); return copy; }
+	sliding_window_iterator operator--(int) { auto copy = *this; --(*this); return copy; }
+	sliding_window_iterator& operator+=(difference_type k) { ITERUTILS_COUNT(sliding_window, jump); first_ += k; last_ += k; return *this; }
+	sliding_window_iterator& operator-=(difference_type k) { ITERUTILS_COUNT(sliding_window, jump); first_ -= k; last_ -= k; return *this; }
+	sliding_window_iterator operator+(difference_type k) const { auto copy = *this; return copy += k; }
+	sliding_window_iterator operator-(difference_type k) const { auto copy = *this; return copy -= k; }
+	friend sliding_window_iterator operator+(difference_type k, const sliding_window_iterator& it) { return it + k; }
+	difference_type operator-(const sliding_window_iterator& other) const { ITERUTILS_COUNT(sliding_window, jump); return last_ - other.last_; }
+
+	bool operator==(const sliding_window_iterator& other) const { ITERUTILS_COUNT(sliding_window, compare); return last_ == other.last_; }
+	bool operator!=(const sliding_window_iterator& other) const { ITERUTILS_COUNT(sliding_window, compare); return last_ != other.last_; }
+	bool operator< (const sliding_window_iterator& other) const { ITERUTILS_COUNT(sliding_window, compare); return last_ <  other.last_; }
+	bool operator<=(const sliding_window_iterator& other) const { ITERUTILS_COUNT(sliding_window, compare); return last_ <= other.last_; }
+	bool operator> (const sliding_window_iterator& other) const { ITERUTILS_COUNT(sliding_window, compare); return last_ >  other.last_; }
+	bool operator>=(const sliding_window_iterator& other) const { ITERUTILS_COUNT(sliding_window, compare); return last_ >= other.last_; }
+private:
+	Iterator first_;
+	Iterator last_;
+};
+
+// Windows of n consecutive elements of a range, ie: for moving averages or stencils.
+// There are size - n + 1 of them, none when the range has fewer than n elements
+template<typename Iterable>
+class sliding_window_range {
+	using base_iterator = decltype(std::begin(std::declval<Iterable&>()));
+	static_assert(std::is_base_of_v<std::forward_iterator_tag, typename std::iterator_traits<base_iterator>::iterator_category>,
+		"windows are views, so the range must be multipass");
+public:
+	using iterator        = sliding_window_iterator<base_iterator>;
+	using value_type      = typename iterator::value_type;
+	using pointer         = typename iterator::pointer;
+	using reference       = typename iterator::reference;
+	using difference_type = typename iterator::difference_type;
+	using size_type       = std::size_t;
+
+	// n must be positive
+	sliding_window_range(Iterable&& iterable, std::size_t n) : iterable_(std::forward<Iterable>(iterable)), n_(static_cast<difference_type>(n)) {
+	}
+	// the last element of the first window is found in O(1) over random access ranges
+	// and in n steps otherwise. Too short a range gives begin() == end()
+	iterator begin() {
+		const base_iterator first = std::begin(iterable_), end = std::end(iterable_);
+		base_iterator last;
+		if constexpr (std::is_same_v<typename iterator::iterator_category, std::random_access_iterator_tag> and !is_infinite_v<Iterable>)
+			last = first + std::min(n_ - 1, end - first);
+		else {
+			last = first;
+			for (difference_type k = 1; k < n_ and last != end; ++k)
+				++last;
+		}
+		return {first, last};
+	}
+	// the first element of the end iterator is only used to step back from it, which
+	// bidirectional ranges do in n steps
+	iterator end() {
+		const base_iterator end = std::end(iterable_);
+		base_iterator first = end;
+		if constexpr (std::is_same_v<typename iterator::iterator_category, std::random_access_iterator_tag> and !is_infinite_v<Iterable>)
+			first = end - std::min(n_ - 1, end - std::begin(iterable_));
+		else if constexpr (std::is_base_of_v<std::bidirectional_iterator_tag, typename iterator::iterator_category> and !is_infinite_v<Iterable>) {
+			const base_iterator begin = std::begin(iterable_);
+			for (difference_type k = 1; k < n_ and first != begin; ++k)
+				--first;
+		}
+		return {first, end};
+	}
+
+	// the number of windows, when the underlying range knows its size
+	template<typename R = sliding_window_range>
+	std::enable_if_t<!is_infinite<R>::value and detail::has_size_v<Iterable>, size_t>
+	size() const {
+		const std::size_t size = std::size(iterable_), n = static_cast<std::size_t>(n_);
+		return size < n ? 0 : size - n + 1;
+	}
+private:
+	Iterable iterable_;
+	difference_type n_;
+};
+template<typename Iterable> sliding_window_range(Iterable&&, std::size_t) -> sliding_window_range<Iterable>;
+
+template<typename Iterable>
+struct is_infinite<sliding_window_range<Iterable>> : public is_infinite<std::remove_reference_t<Iterable>> {};
+
+} // namespace iterutils
+
+#endif
@@ -1,7 +1,14 @@
 #ifndef _ITERUTILS_STRIDED_RANGE_H_
 #define _ITERUTILS_STRIDED_RANGE_H_
 
+#include <algorithm>
 #include <type_traits>
+#include <cstdint>
+#include <iterator>
+#include <limits>
+#include "util.h"
+#include "simd.h"
+#include "instrument.h"
 
 namespace iterutils {
 
@@ -11,24 +18,29 @@ public:
 	explicit strided_iterator(Iterator _it, typename Iterator::difference_type _stride) : Iterator(_it), stride(_stride) {
 	}
 	strided_iterator& operator++() {
+		ITERUTILS_COUNT(strided, increment);
 		Iterator::operator+=(stride);
 		return *this;
 	}
 	strided_iterator operator++(int) {
+		ITERUTILS_COUNT(strided, increment);
 		strided_iterator retval = *this;
 		Iterator::operator+=(stride);
 		return retval;
 	}
 	strided_iterator& operator--() {
+		ITERUTILS_COUNT(strided, increment);
 		Iterator::operator-=(stride);
 		return *this;
 	}
 	strided_iterator operator--(int) {
+		ITERUTILS_COUNT(strided, increment);
 		strided_iterator retval = *this;
 		Iterator::operator-=(stride);
 		return retval;
 	}
 	strided_iterator& operator+=(typename Iterator::difference_type n) {
+		ITERUTILS_COUNT(strided, jump);
 		Iterator::operator+=(stride*n);
 		return *this;
 	}
@@ -37,6 +49,7 @@ public:
 		return retval += n;
 	}
 	strided_iterator& operator-=(typename Iterator::difference_type n) {
+		ITERUTILS_COUNT(strided, jump);
 		Iterator::operator-=(stride*n);
 		return *this;
 	}
@@ -45,35 +58,195 @@ public:
 		return retval -= n;
 	}
 	typename Iterator::difference_type operator-(const strided_iterator& other) const {
+		ITERUTILS_COUNT(strided, jump);
 		return (static_cast<const Iterator&>(*this)-static_cast<const Iterator&>(other))/stride;
 	}
 	typename Iterator::reference operator[](typename Iterator::difference_type n) const {
+		ITERUTILS_COUNT(strided, jump);
+		ITERUTILS_COUNT(strided, dereference);
 		return Iterator::operator[](n*stride);
 	}
+#ifdef ITERUTILS_INSTRUMENT
+	// dereferences and comparisons are otherwise inherited from Iterator
+	typename Iterator::reference operator*() const {
+		ITERUTILS_COUNT(strided, dereference);
+		return Iterator::operator*();
+	}
+	bool operator==(const strided_iterator& other) const { ITERUTILS_COUNT(strided, compare); return _base() == other._base(); }
+	bool operator!=(const strided_iterator& other) const { ITERUTILS_COUNT(strided, compare); return _base() != other._base(); }
+	bool operator< (const strided_iterator& other) const { ITERUTILS_COUNT(strided, compare); return _base() <  other._base(); }
+	bool operator<=(const strided_iterator& other) const { ITERUTILS_COUNT(strided, compare); return _base() <= other._base(); }
+	bool operator> (const strided_iterator& other) const { ITERUTILS_COUNT(strided, compare); return _base() >  other._base(); }
+	bool operator>=(const strided_iterator& other) const { ITERUTILS_COUNT(strided, compare); return _base() >= other._base(); }
+#endif
+	// distance between consecutive elements in the underlying range
+	typename Iterator::difference_type step() const { return stride; }
 private:
+	const Iterator& _base() const { return *this; }
+
 	typename Iterator::difference_type stride;
 };
 
+namespace detail {
+
+// the number of elements from offset on, rounded up: the last stride may be incomplete.
+// An offset past the end gives none
+template<typename Size>
+Size strided_count(Size size, Size offset, Size stride) {
+	return offset < size ? (size - offset + stride - 1) / stride : 0;
+}
+
+} // namespace detail
+
+// an offset past the end starts the range at the end
 template<typename Iterable>
 auto strided_begin(Iterable& x, typename Iterable::size_type offset, typename Iterable::size_type stride) {
-	return strided_iterator<typename Iterable::iterator>(x.begin() + offset, stride);
+	return strided_iterator<typename Iterable::iterator>(x.begin() + std::min(offset, x.size()), stride);
 }
 template<typename Iterable>
 auto strided_cbegin(const Iterable& x, typename Iterable::size_type offset, typename Iterable::size_type stride) {
-	return strided_iterator<typename Iterable::const_iterator>(x.cbegin() + offset, stride);
+	return strided_iterator<typename Iterable::const_iterator>(x.cbegin() + std::min(offset, x.size()), stride);
 }
 // strided_(c)end iterators need to calculate an offset from the true end of
 // the iterable. This should be the first past-the-end position that the
 // corresponding strided_(c)begin iterator will find through successive increments
 template<typename Iterable>
 auto strided_end(Iterable& x, typename Iterable::size_type offset, typename Iterable::size_type stride) {
-	return strided_begin(x, offset, stride) += (x.size() - offset + stride - 1)/stride;
+	return strided_begin(x, offset, stride) += detail::strided_count(x.size(), offset, stride);
 }
 template<typename Iterable>
 auto strided_cend(const Iterable& x, typename Iterable::size_type offset, typename Iterable::size_type stride) {
-	return strided_cbegin(x, offset, stride) += (x.size() - offset + stride - 1)/stride;
+	return strided_cbegin(x, offset, stride) += detail::strided_count(x.size(), offset, stride);
 }
 
+namespace detail {
+
+#if ITERUTILS_X86_SIMD
+// Kernels copy out[k] = src[k*stride] for as many whole vectors as they can and
+// return the number of elements they copied. Shuffle kernels load every element
+// between two strided elements, so they may only read src[0, available).
+// Elements are moved as raw 4 or 8 byte lanes, the type does not matter.
+
+ITERUTILS_TARGET("sse4.2")
+inline std::size_t strided_shuffle_4(const float* src, std::size_t stride, std::size_t n, std::size_t available, float* out) {
+	std::size_t k = 0;
+	if (stride == 2) {
+		for (; k + 4 <= n and (k + 4) * 2 <= available; k += 4) {
+			__m128 a = _mm_loadu_ps(src + 2*k), b = _mm_loadu_ps(src + 2*k + 4);
+			_mm_storeu_ps(out + k, _mm_shuffle_ps(a, b, _MM_SHUFFLE(2, 0, 2, 0)));
+		}
+	}
+	else if (stride == 3) {
+		for (; k + 4 <= n and (k + 4) * 3 <= available; k += 4) {
+			__m128 v0 = _mm_loadu_ps(src + 3*k), v1 = _mm_loadu_ps(src + 3*k + 4), v2 = _mm_loadu_ps(src + 3*k + 8);
+			__m128 lo = _mm_shuffle_ps(v0, v0, _MM_SHUFFLE(3, 0, 3, 0)); // 0 3 0 3
+			__m128 hi = _mm_shuffle_ps(v1, v2, _MM_SHUFFLE(1, 1, 2, 2)); // 6 6 9 9
+			_mm_storeu_ps(out + k, _mm_shuffle_ps(lo, hi, _MM_SHUFFLE(2, 0, 1, 0)));
+		}
+	}
+	else if (stride == 4) {
+		for (; k + 4 <= n and (k + 4) * 4 <= available; k += 4) {
+			__m128 v0 = _mm_loadu_ps(src + 4*k), v1 = _mm_loadu_ps(src + 4*k + 4);
+			__m128 v2 = _mm_loadu_ps(src + 4*k + 8), v3 = _mm_loadu_ps(src + 4*k + 12);
+			_mm_storeu_ps(out + k, _mm_movelh_ps(_mm_unpacklo_ps(v0, v1), _mm_unpacklo_ps(v2, v3)));
+		}
+	}
+	return k;
+}
+ITERUTILS_TARGET("sse4.2")
+inline std::size_t strided_shuffle_8(const double* src, std::size_t stride, std::size_t n, std::size_t available, double* out) {
+	std::size_t k = 0;
+	if (stride == 2) {
+		for (; k + 2 <= n and (k + 2) * 2 <= available; k += 2) {
+			__m128d a = _mm_loadu_pd(src + 2*k), b = _mm_loadu_pd(src + 2*k + 2);
+			_mm_storeu_pd(out + k, _mm_unpacklo_pd(a, b));
+		}
+	}
+	return k;
+}
+ITERUTILS_TARGET("avx2")
+inline std::size_t strided_gather_avx2_4(const float* src, std::size_t stride, std::size_t n, float* out) {
+	const __m256i index = _mm256_mullo_epi32(_mm256_setr_epi32(0, 1, 2, 3, 4, 5, 6, 7), _mm256_set1_epi32(static_cast<int>(stride)));
+	// the masked gathers start from a defined value, the unmasked ones trip -Wmaybe-uninitialized
+	const __m256 all = _mm256_castsi256_ps(_mm256_set1_epi32(-1));
+	std::size_t k = 0;
+	for (; k + 8 <= n; k += 8)
+		_mm256_storeu_ps(out + k, _mm256_mask_i32gather_ps(_mm256_setzero_ps(), src + k*stride, index, all, 4));
+	return k;
+}
+ITERUTILS_TARGET("avx2")
+inline std::size_t strided_gather_avx2_8(const double* src, std::size_t stride, std::size_t n, double* out) {
+	const __m128i index = _mm_mullo_epi32(_mm_setr_epi32(0, 1, 2, 3), _mm_set1_epi32(static_cast<int>(stride)));
+	const __m256d all = _mm256_castsi256_pd(_mm256_set1_epi64x(-1));
+	std::size_t k = 0;
+	for (; k + 4 <= n; k += 4)
+		_mm256_storeu_pd(out + k, _mm256_mask_i32gather_pd(_mm256_setzero_pd(), src + k*stride, index, all, 8));
+	return k;
+}
+ITERUTILS_TARGET("avx512f")
+inline std::size_t strided_gather_avx512_4(const float* src, std::size_t stride, std::size_t n, float* out) {
+	const __m512i index = _mm512_mullo_epi32(
+		_mm512_setr_epi32(0, 1, 2, 3, 4, 5, 6, 7, 8, 9, 10, 11, 12, 13, 14, 15),
+		_mm512_set1_epi32(static_cast<int>(stride))
+	);
+	std::size_t k = 0;
+	for (; k + 16 <= n; k += 16)
+		_mm512_storeu_ps(out + k, _mm512_mask_i32gather_ps(_mm512_setzero_ps(), 0xffff, index, src + k*stride, 4));
+	return k;
+}
+ITERUTILS_TARGET("avx512f")
+inline std::size_t strided_gather_avx512_8(const double* src, std::size_t stride, std::size_t n, double* out) {
+	const __m256i index = _mm256_mullo_epi32(_mm256_setr_epi32(0, 1, 2, 3, 4, 5, 6, 7), _mm256_set1_epi32(static_cast<int>(stride)));
+	std::size_t k = 0;
+	for (; k + 8 <= n; k += 8)
+		_mm512_storeu_pd(out + k, _mm512_mask_i32gather_pd(_mm512_setzero_pd(), 0xff, index, src + k*stride, 8));
+	return k;
+}
+#endif
+
+// copies out[k] = src[k*stride] for k in [0, n). Only src[0, available) may be read
+template<typename T>
+void strided_gather(const T* src, std::size_t stride, std::size_t n, std::size_t available, T* out) {
+	std::size_t k = 0;
+#if ITERUTILS_X86_SIMD
+	constexpr bool lanes = std::is_arithmetic_v<T> and (sizeof(T) == 4 or sizeof(T) == 8);
+	if constexpr (lanes) {
+		using lane = std::conditional_t<sizeof(T) == 4, float, double>;
+		const lane* s = reinterpret_cast<const lane*>(src);
+		lane* o = reinterpret_cast<lane*>(out);
+		const simd_level level = current_simd_level();
+		if (stride <= 4) {
+			if (level != simd_level::scalar) {
+				if constexpr (sizeof(T) == 4)
+					k = strided_shuffle_4(s, stride, n, available, o);
+				else
+					k = strided_shuffle_8(s, stride, n, available, o);
+			}
+		}
+		// 32 bit gather indices must not overflow
+		else if (stride <= std::size_t(std::numeric_limits<std::int32_t>::max()) / 16) {
+			if (level == simd_level::avx512) {
+				if constexpr (sizeof(T) == 4)
+					k = strided_gather_avx512_4(s, stride, n, o);
+				else
+					k = strided_gather_avx512_8(s, stride, n, o);
+			}
+			else if (level == simd_level::avx2) {
+				if constexpr (sizeof(T) == 4)
+					k = strided_gather_avx2_4(s, stride, n, o);
+				else
+					k = strided_gather_avx2_8(s, stride, n, o);
+			}
+		}
+	}
+#endif
+	(void)available;
+	for (; k < n; ++k)
+		out[k] = src[k*stride];
+}
+
+} // namespace detail
+
 template<typename Iterable>
 class strided_range_impl {
 public:
@@ -87,19 +260,72 @@ public:
 	strided_range_impl (
 		std::add_rvalue_reference_t<Iterable> iter,
 		size_type offset, size_type stride
-	) : _iter(iter), _offset(offset), _stride(stride) {
+	) : _iter(std::forward<Iterable>(iter)), _offset(offset), _stride(stride) {
 	}
+	// the underlying range, taken over when the strided range is an rvalue
+	Iterable& base() & { return _iter; }
+	Iterable&& base() && { return std::forward<Iterable>(_iter); }
+	size_type offset() const { return _offset; }
+	size_type stride() const { return _stride; }
+
 	iterator begin() { return strided_begin(_iter, _offset, _stride); }
 	iterator end() { return strided_end(_iter, _offset, _stride); }
-	std::size_t size() const { return (_iter.size()-_offset) / _stride; }
+	// the same count end() - begin() gives
+	std::size_t size() const {
+		return detail::strided_count<std::size_t>(std::size(_iter), _offset, _stride);
+	}
+
+	// number of elements handed out at once by for_each_batch
+	static constexpr std::size_t batch_size = 16;
+
+	// copies up to count elements starting from the first-th element of the range into out
+	// and returns how many were copied. Contiguous arithmetic ranges use SIMD shuffles
+	// (small strides) or gathers (large strides) when the CPU supports them
+	std::size_t gather(std::size_t first, std::size_t count, value_type* out) const {
+		const std::size_t total = size();
+		if (first >= total)
+			return 0;
+		count = std::min(count, total - first);
+		const std::size_t start = _offset + first*_stride;
+		if constexpr (detail::is_contiguous_iterable_v<Iterable> and std::is_arithmetic_v<value_type>)
+			detail::strided_gather(std::data(_iter) + start, _stride, count, _iter.size() - start, out);
+		else {
+			auto it = std::next(std::begin(_iter), start);
+			for (std::size_t k = 0; k < count; ++k, std::advance(it, k < count ? _stride : 0))
+				out[k] = *it;
+		}
+		return count;
+	}
+	// calls f(const value_type* batch, std::size_t n) over consecutive batches of at most batch_size elements
+	template<typename F>
+	void for_each_batch(F&& f) const {
+		value_type batch[batch_size];
+		for (std::size_t first = 0, n; (n = gather(first, batch_size, batch)) > 0; first += n)
+			f(static_cast<const value_type*>(batch), n);
+	}
 private:
 	Iterable _iter;
 	size_type _offset;
 	size_type _stride;
 };
+
+namespace detail {
+
+template<typename T>
+struct is_strided_range : public std::false_type {};
+template<typename Iterable>
+struct is_strided_range<strided_range_impl<Iterable>> : public std::true_type {};
+
+} // namespace detail
+
+// a strided range of a strided range is a strided range of the inner range, with the
+// strides multiplied: one multiplication per step instead of one per level
 template<typename Iterable>
 auto strided_range(Iterable&& i, typename std::remove_reference_t<Iterable>::size_type offset, typename std::remove_reference_t<Iterable>::size_type stride) {
-	return strided_range_impl<Iterable>(std::forward<Iterable>(i), offset, stride);
+	if constexpr (detail::is_strided_range<std::remove_reference_t<Iterable>>::value)
+		return strided_range(std::forward<Iterable>(i).base(), i.offset() + offset*i.stride(), stride*i.stride());
+	else
+		return strided_range_impl<Iterable>(std::forward<Iterable>(i), offset, stride);
 }
 
 } // namespace iterutils
@@ -0,0 +1,239 @@
+#ifndef _ITERUTILS_TRANSFORMED_RANGE_H_
+#define _ITERUTILS_TRANSFORMED_RANGE_H_
+
+#include <functional>
+#include <iterator>
+#include <type_traits>
+#include <utility>
+#include "util.h"
+#include "segmented.h"
+#include "instrument.h"
+
+namespace iterutils {
+
+namespace detail {
+
+// void when the function cannot be called on the elements. The operator templates
+// below are candidates for the friend declarations of every other adapter, so
+// transformed_iterator must be instantiable with any template arguments
+template<typename Function, typename Iterator, typename = void>
+struct transformed_reference {
+	using type = void;
+};
+template<typename Function, typename Iterator>
+struct transformed_reference<Function, Iterator, std::void_t<std::invoke_result_t<const Function&, typename std::iterator_traits<Iterator>::reference>>> {
+	using type = std::invoke_result_t<const Function&, typename std::iterator_traits<Iterator>::reference>;
+};
+
+} // namespace detail
+
+template<typename Tag, typename Iterator, typename Function>
+class transformed_iterator {};
+
+template<typename Tag, typename Iterator, typename Function>
+transformed_iterator<Tag, Iterator, Function>& operator++(transformed_iterator<Tag, Iterator, Function>& it) {
+	ITERUTILS_COUNT(transformed, increment);
+	++it.it_;
+	return it;
+}
+template<typename Tag, typename Iterator, typename Function>
+transformed_iterator<Tag, Iterator, Function> operator++(transformed_iterator<Tag, Iterator, Function>& it, int) {
+	ITERUTILS_COUNT(transformed, increment);
+	auto copy = it;
+	++it.it_;
+	return copy;
+}
+template<typename Tag, typename Iterator, typename Function>
+transformed_iterator<Tag, Iterator, Function>& operator--(transformed_iterator<Tag, Iterator, Function>& it) {
+	ITERUTILS_COUNT(transformed, increment);
+	--it.it_;
+	return it;
+}
+template<typename Tag, typename Iterator, typename Function>
+transformed_iterator<Tag, Iterator, Function> operator--(transformed_iterator<Tag, Iterator, Function>& it, int) {
+	ITERUTILS_COUNT(transformed, increment);
+	auto copy = it;
+	--it.it_;
+	return copy;
+}
+template<typename Tag, typename Iterator, typename Function>
+transformed_iterator<Tag, Iterator, Function>&
+operator+=(transformed_iterator<Tag, Iterator, Function>& it, typename transformed_iterator<Tag, Iterator, Function>::difference_type n) {
+	ITERUTILS_COUNT(transformed, jump);
+	it.it_ += n;
+	return it;
+}
+template<typename Tag, typename Iterator, typename Function>
+transformed_iterator<Tag, Iterator, Function>
+operator+(const transformed_iterator<Tag, Iterator, Function>& it, typename transformed_iterator<Tag, Iterator, Function>::difference_type n) {
+	auto copy = it;
+	return copy += n;
+}
+template<typename Tag, typename Iterator, typename Function>
+transformed_iterator<Tag, Iterator, Function>
+operator+(typename transformed_iterator<Tag, Iterator, Function>::difference_type n, const transformed_iterator<Tag, Iterator, Function>& it) {
+	auto copy = it;
+	return copy += n;
+}
+template<typename Tag, typename Iterator, typename Function>
+transformed_iterator<Tag, Iterator, Function>&
+operator-=(transformed_iterator<Tag, Iterator, Function>& it, typename transformed_iterator<Tag, Iterator, Function>::difference_type n) {
+	ITERUTILS_COUNT(transformed, jump);
+	it.it_ -= n;
+	return it;
+}
+template<typename Tag, typename Iterator, typename Function>
+transformed_iterator<Tag, Iterator, Function>
+operator-(const transformed_iterator<Tag, Iterator, Function>& it, typename transformed_iterator<Tag, Iterator, Function>::difference_type n) {
+	auto copy = it;
+	return copy -= n;
+}
+template<typename Tag, typename Iterator, typename Function>
+typename transformed_iterator<Tag, Iterator, Function>::difference_type
+operator-(const transformed_iterator<Tag, Iterator, Function>& a, const transformed_iterator<Tag, Iterator, Function>& b) {
+	ITERUTILS_COUNT(transformed, jump);
+	return a.it_ - b.it_;
+}
+
+// Applies a function to the elements of the underlying iterator on dereference.
+// The function is stored in the iterator itself, so a stateless lambda takes no
+// space and the call is inlined into the loop
+template<typename Iterator, typename Function>
+class transformed_iterator<std::input_iterator_tag, Iterator, Function> {
+public:
+	using reference         = typename detail::transformed_reference<Function, Iterator>::type;
+	using value_type        = std::remove_cv_t<std::remove_reference_t<reference>>;
+	using pointer           = void;
+	using difference_type   = typename std::iterator_traits<Iterator>::difference_type;
+	using iterator_category = std::input_iterator_tag;
+
+	transformed_iterator() = default;
+	transformed_iterator(Iterator it, Function f) : it_(it), f_(std::move(f)) {
+	}
+
+	friend transformed_iterator& operator++<iterator_category, Iterator, Function>(transformed_iterator&);
+	friend transformed_iterator  operator++<iterator_category, Iterator, Function>(transformed_iterator&, int);
+	template<typename, typename> friend struct segmented_iterator_traits;
+
+	reference operator*() const { ITERUTILS_COUNT(transformed, dereference); return std::invoke(f_.get(), *it_); }
+	bool operator==(const transformed_iterator& other) const { ITERUTILS_COUNT(transformed, compare); return it_ == other.it_; }
+	bool operator!=(const transformed_iterator& other) const { ITERUTILS_COUNT(transformed, compare); return it_ != other.it_; }
+
+	// the underlying iterator
+	const Iterator& base() const { return it_; }
+protected:
+	Iterator it_;
+	detail::function_box<Function> f_;
+};
+
+template<typename Iterator, typename Function>
+class transformed_iterator<std::forward_iterator_tag, Iterator, Function>
+: public transformed_iterator<std::input_iterator_tag, Iterator, Function> {
+public:
+	using iterator_category = std::forward_iterator_tag;
+
+	using transformed_iterator<std::input_iterator_tag, Iterator, Function>::transformed_iterator;
+
+	friend transformed_iterator& operator++<iterator_category, Iterator, Function>(transformed_iterator&);
+	friend transformed_iterator  operator++<iterator_category, Iterator, Function>(transformed_iterator&, int);
+};
+
+template<typename Iterator, typename Function>
+class transformed_iterator<std::bidirectional_iterator_tag, Iterator, Function>
+: public transformed_iterator<std::forward_iterator_tag, Iterator, Function> {
+public:
+	using iterator_category = std::bidirectional_iterator_tag;
+
+	using transformed_iterator<std::forward_iterator_tag, Iterator, Function>::transformed_iterator;
+
+	friend transformed_iterator& operator++<iterator_category, Iterator, Function>(transformed_iterator&);
+	friend transformed_iterator  operator++<iterator_category, Iterator, Function>(transformed_iterator&, int);
+	friend transformed_iterator& operator--<iterator_category, Iterator, Function>(transformed_iterator&);
+	friend transformed_iterator  operator--<iterator_category, Iterator, Function>(transformed_iterator&, int);
+};
+
+template<typename Iterator, typename Function>
+class transformed_iterator<std::random_access_iterator_tag, Iterator, Function>
+: public transformed_iterator<std::bidirectional_iterator_tag, Iterator, Function> {
+public:
+	using reference         = typename transformed_iterator<std::bidirectional_iterator_tag, Iterator, Function>::reference;
+	using difference_type   = typename transformed_iterator<std::bidirectional_iterator_tag, Iterator, Function>::difference_type;
+	using iterator_category = std::random_access_iterator_tag;
+
+	using transformed_iterator<std::bidirectional_iterator_tag, Iterator, Function>::transformed_iterator;
+
+	friend transformed_iterator& operator++<iterator_category, Iterator, Function>(transformed_iterator&);
+	friend transformed_iterator  operator++<iterator_category, Iterator, Function>(transformed_iterator&,       int);
+	friend transformed_iterator& operator--<iterator_category, Iterator, Function>(transformed_iterator&);
+	friend transformed_iterator  operator--<iterator_category, Iterator, Function>(transformed_iterator&,       int);
+	friend transformed_iterator& operator+=<iterator_category, Iterator, Function>(transformed_iterator&,       difference_type);
+	friend transformed_iterator  operator+ <iterator_category, Iterator, Function>(const transformed_iterator&, difference_type);
+	friend transformed_iterator  operator+ <iterator_category, Iterator, Function>(difference_type,             const transformed_iterator&);
+	friend transformed_iterator& operator-=<iterator_category, Iterator, Function>(transformed_iterator&,       difference_type);
+	friend transformed_iterator  operator- <iterator_category, Iterator, Function>(const transformed_iterator&, difference_type);
+	friend difference_type       operator- <iterator_category, Iterator, Function>(const transformed_iterator&, const transformed_iterator&);
+
+	reference operator[](difference_type n) const { ITERUTILS_COUNT(transformed, jump); ITERUTILS_COUNT(transformed, dereference); return std::invoke(this->f_.get(), this->it_[n]); }
+
+	bool operator< (const transformed_iterator& other) const { ITERUTILS_COUNT(transformed, compare); return this->it_ <  other.it_; }
+	bool operator<=(const transformed_iterator& other) const { ITERUTILS_COUNT(transformed, compare); return this->it_ <= other.it_; }
+	bool operator> (const transformed_iterator& other) const { ITERUTILS_COUNT(transformed, compare); return this->it_ >  other.it_; }
+	bool operator>=(const transformed_iterator& other) const { ITERUTILS_COUNT(transformed, compare); return this->it_ >= other.it_; }
+};
+
+template<typename Iterator, typename Function>
+transformed_iterator<std::common_type_t<typename std::iterator_traits<Iterator>::iterator_category>, Iterator, Function>
+make_transformed_iterator(Iterator it, Function f) {
+	return {it, std::move(f)};
+}
+
+// Lazily applies f to every element of a range. The range has the iterator category
+// of the underlying one, so transformed random access ranges can be zipped by index
+template<typename Iterable, typename Function>
+class transformed_range {
+public:
+	using iterator        = decltype(make_transformed_iterator(std::begin(std::declval<Iterable&>()), std::declval<Function>()));
+	using value_type      = typename iterator::value_type;
+	using pointer         = typename iterator::pointer;
+	using reference       = typename iterator::reference;
+	using difference_type = typename iterator::difference_type;
+	using size_type       = std::size_t;
+
+	transformed_range(Iterable&& iterable, Function f) : iterable_(std::forward<Iterable>(iterable)), f_(std::move(f)) {
+	}
+	iterator begin() { return make_transformed_iterator(std::begin(iterable_), f_); }
+	iterator end() { return make_transformed_iterator(std::end(iterable_), f_); }
+
+	// only when the underlying range knows its size
+	template<typename I = std::remove_reference_t<Iterable>>
+	auto size() const -> decltype(std::size(std::declval<const I&>())) {
+		return std::size(iterable_);
+	}
+private:
+	Iterable iterable_;
+	Function f_;
+};
+template<typename Iterable, typename Function> transformed_range(Iterable&&, Function) -> transformed_range<Iterable, Function>;
+
+template<typename Iterable, typename Function>
+struct is_infinite<transformed_range<Iterable, Function>> : public is_infinite<std::remove_reference_t<Iterable>> {};
+
+// transformed segmented iterators are segmented too: every segment is
+// transformed on its own, so the segmented algorithms keep their per segment loops
+template<typename Tag, typename Iterator, typename Function>
+struct segmented_iterator_traits<transformed_iterator<Tag, Iterator, Function>, std::enable_if_t<segmented_iterator_traits<Iterator>::is_segmented>> {
+	static constexpr bool is_segmented = true;
+
+	template<typename F>
+	static transformed_iterator<Tag, Iterator, Function> for_each_segment(const transformed_iterator<Tag, Iterator, Function>& first, const transformed_iterator<Tag, Iterator, Function>& last, F&& f) {
+		const Function& function = first.f_.get();
+		Iterator local = segmented_iterator_traits<Iterator>::for_each_segment(first.it_, last.it_, [&f, &function](auto local_first, auto local_last) {
+			return f(make_transformed_iterator(local_first, function), make_transformed_iterator(local_last, function)).base();
+		});
+		return {local, function};
+	}
+};
+
+} // namespace iterutils
+
+#endif
@@ -3,16 +3,112 @@
 
 #include <type_traits>
 #include <iterator>
+#include <optional>
+#include <utility>
+#include <vector>
 
 namespace iterutils {
 
 template<typename T>
 struct is_infinite : public std::false_type { };
+// adapters hold their subranges as references or values, either says the same
 template<typename T>
-using is_infinite_v = typename is_infinite<T>::value;
+struct is_infinite<T&> : public is_infinite<T> {};
+template<typename T>
+struct is_infinite<T&&> : public is_infinite<T> {};
+template<typename T>
+struct is_infinite<const T> : public is_infinite<T> {};
+template<typename T>
+constexpr bool is_infinite_v = is_infinite<T>::value;
 
 namespace detail{
 
+// true when std::size works on Iterable, ie: it has a size() member
+template<typename Iterable, typename = void>
+struct has_size : public std::false_type {};
+template<typename Iterable>
+struct has_size<Iterable, std::void_t<decltype(std::size(std::declval<const std::remove_reference_t<Iterable>&>()))>>
+: public std::true_type {};
+template<typename Iterable>
+constexpr bool has_size_v = has_size<Iterable>::value;
+
+// the subranges of a zip or an alternation are either infinite or know their size,
+// in which case so does the adapter (see shortest_iterable)
+template<typename ...Iterables>
+constexpr bool sized_or_infinite_v = (... and (has_size_v<Iterables> or is_infinite_v<Iterables>));
+
+// true when Iterable stores its elements contiguously, ie: std::data() returns a pointer to them
+template<typename Iterable, typename = void>
+struct is_contiguous_iterable : public std::false_type {};
+template<typename Iterable>
+struct is_contiguous_iterable<Iterable, std::enable_if_t<std::is_pointer_v<decltype(std::data(std::declval<Iterable&>()))>>>
+: public std::true_type {};
+template<typename Iterable>
+constexpr bool is_contiguous_iterable_v = is_contiguous_iterable<std::remove_reference_t<Iterable>>::value;
+
+// true for pointers and std::vector iterators, whose elements can be written through a pointer
+template<typename Iterator, typename = void>
+struct is_contiguous_iterator : public std::is_pointer<Iterator> {};
+template<typename Iterator>
+struct is_contiguous_iterator<Iterator, std::enable_if_t<
+	!std::is_pointer_v<Iterator> and
+	std::is_object_v<typename std::iterator_traits<Iterator>::value_type> and
+	!std::is_same_v<typename std::iterator_traits<Iterator>::value_type, bool>
+>> : public std::is_same<Iterator, typename std::vector<typename std::iterator_traits<Iterator>::value_type>::iterator> {};
+template<typename Iterator>
+constexpr bool is_contiguous_iterator_v = is_contiguous_iterator<Iterator>::value;
+
+// Holds the callable of transformed and filtered iterators. Iterators must be default
+// constructible and assignable but lambdas are neither, so those live in an optional
+// that is reconstructed on assignment
+template<typename F, bool = std::is_default_constructible_v<F> and std::is_copy_assignable_v<F>>
+class function_box {
+public:
+	function_box() = default;
+	explicit function_box(F f) : f_(std::move(f)) {
+	}
+	const F& get() const { return f_; }
+private:
+	F f_;
+};
+template<typename F>
+class function_box<F, false> {
+public:
+	function_box() = default;
+	explicit function_box(F f) : f_(std::move(f)) {
+	}
+	function_box(const function_box& other) = default;
+	function_box(function_box&& other) = default;
+	function_box& operator=(const function_box& other) {
+		if (this != &other)
+			_assign(other.f_);
+		return *this;
+	}
+	function_box& operator=(function_box&& other) {
+		if (this != &other)
+			_assign(std::move(other.f_));
+		return *this;
+	}
+	const F& get() const { return *f_; }
+private:
+	template<typename Optional>
+	void _assign(Optional&& other) {
+		if (other)
+			f_.emplace(*std::forward<Optional>(other));
+		else
+			f_.reset();
+	}
+
+	std::optional<F> f_;
+};
+
+// begin and end of the range under a cycle or an ncycle, shared by their compact iterators
+template<typename Iterator>
+struct lap_bounds {
+	Iterator begin;
+	Iterator end;
+};
+
 template<template<typename ...TArgs> class TemplateName, typename ...Iterators>
 using specialize_iterator_from_iterators = TemplateName<
 	std::common_type_t<typename std::iterator_traits<Iterators>::iterator_category...>,
@@ -44,6 +140,63 @@ auto shortest_iterable(const Iterables& ...iterables) {
 	return detail::shortest_iterable_impl<0, Iterables...>(iterables...);
 }
 
+// Non-owning view over [begin, end)
+template<typename Iterator>
+class iterator_range {
+public:
+	using iterator        = Iterator;
+	using value_type      = typename std::iterator_traits<Iterator>::value_type;
+	using reference       = typename std::iterator_traits<Iterator>::reference;
+	using pointer         = typename std::iterator_traits<Iterator>::pointer;
+	using difference_type = typename std::iterator_traits<Iterator>::difference_type;
+	using size_type       = std::size_t;
+
+	iterator_range() = default;
+	iterator_range(Iterator begin, Iterator end) : begin_(begin), end_(end) {
+	}
+	Iterator begin() const { return begin_; }
+	Iterator end() const { return end_; }
+	std::size_t size() const { return std::distance(begin_, end_); }
+	bool empty() const { return begin_ == end_; }
+private:
+	Iterator begin_;
+	Iterator end_;
+};
+
+// The begin() of a range and its sentinel() as a range, for range-for loops over adapters
+// whose end is cheaper to test through a sentinel than through their end() iterator.
+// C++17 range-for allows begin and end of different types, std algorithms do not:
+//   for (int x : sentinel_range(chained_range(v1, v2)))
+template<typename Range>
+class sentinel_range {
+public:
+	sentinel_range(Range&& range) : range_(std::forward<Range>(range)) {
+	}
+	auto begin() { return range_.begin(); }
+	auto end() { return range_.sentinel(); }
+private:
+	Range range_;
+};
+template<typename Range> sentinel_range(Range&&) -> sentinel_range<Range>;
+
+// Splits a range into `parts` consecutive, disjoint subranges whose sizes differ
+// by at most one element. Adapters overload this (as hidden friends found through ADL)
+// when they can place the cuts more cheaply or on better boundaries.
+template<typename Range>
+auto split(Range& range, std::size_t parts) {
+	using iterator = decltype(std::begin(range));
+	std::vector<iterator_range<iterator>> result;
+	result.reserve(parts);
+	const std::size_t n = std::distance(std::begin(range), std::end(range));
+	iterator first = std::begin(range);
+	for (std::size_t i = 0; i < parts; ++i) {
+		iterator last = std::next(first, n / parts + (i < n % parts ? 1 : 0));
+		result.emplace_back(first, last);
+		first = last;
+	}
+	return result;
+}
+
 } // namespace iterutils
 
 #endif
@@ -2,14 +2,118 @@
 #define _ITERUTILS_ZIPPED_RANGE_H_
 
 #include <tuple>
+#include <functional>
+#include <iterator>
 #include <type_traits>
 #include "util.h"
+#include "instrument.h"
 
 namespace iterutils {
 
+// Proxy reference yielded by zipped iterators. Copying it copies the references,
+// while assigning to it or swapping it assigns through them, so that permuting
+// algorithms (std::sort, std::rotate...) permute the underlying elements.
+// Swaps move the elements, but algorithms that set an element aside (the insertion
+// steps of std::sort, std::nth_element...) copy it through operator value_type() and
+// copy assignment: a proxy moved from with std::move(*it) cannot be told apart from
+// the one *it returns, so moving out of it would also empty the subranges on a plain
+// value_type v = *it. The elements must therefore be copyable
+template<typename ...Iterators>
+class zipped_reference {
+public:
+	using value_type = std::tuple<typename std::iterator_traits<Iterators>::value_type...>;
+	using tuple_type = std::tuple<typename std::iterator_traits<Iterators>::reference...>;
+
+	zipped_reference(typename std::iterator_traits<Iterators>::reference... refs)
+	: t(std::forward<typename std::iterator_traits<Iterators>::reference>(refs)...) {
+	}
+	zipped_reference(const zipped_reference& other) = default;
+
+	zipped_reference& operator=(const zipped_reference& other) {
+		t = other.t;
+		return *this;
+	}
+	zipped_reference& operator=(const value_type& value) {
+		t = value;
+		return *this;
+	}
+	zipped_reference& operator=(value_type&& value) {
+		t = std::move(value);
+		return *this;
+	}
+	operator value_type() const {
+		return value_type(t);
+	}
+
+	template<std::size_t I>
+	std::tuple_element_t<I, tuple_type> get() const { return std::get<I>(t); }
+	const tuple_type& as_tuple() const { return t; }
+
+	friend void swap(zipped_reference a, zipped_reference b) {
+		a._swap(b, std::index_sequence_for<Iterators...>());
+	}
+
+	friend bool operator==(const zipped_reference& a, const zipped_reference& b) { return a.t == b.t; }
+	friend bool operator!=(const zipped_reference& a, const zipped_reference& b) { return a.t != b.t; }
+	friend bool operator< (const zipped_reference& a, const zipped_reference& b) { return a.t <  b.t; }
+	friend bool operator<=(const zipped_reference& a, const zipped_reference& b) { return a.t <= b.t; }
+	friend bool operator> (const zipped_reference& a, const zipped_reference& b) { return a.t >  b.t; }
+	friend bool operator>=(const zipped_reference& a, const zipped_reference& b) { return a.t >= b.t; }
+	friend bool operator==(const zipped_reference& a, const value_type& b) { return a.t == b; }
+	friend bool operator!=(const zipped_reference& a, const value_type& b) { return a.t != b; }
+	friend bool operator< (const zipped_reference& a, const value_type& b) { return a.t <  b; }
+	friend bool operator<=(const zipped_reference& a, const value_type& b) { return a.t <= b; }
+	friend bool operator> (const zipped_reference& a, const value_type& b) { return a.t >  b; }
+	friend bool operator>=(const zipped_reference& a, const value_type& b) { return a.t >= b; }
+	friend bool operator==(const value_type& a, const zipped_reference& b) { return a == b.t; }
+	friend bool operator!=(const value_type& a, const zipped_reference& b) { return a != b.t; }
+	friend bool operator< (const value_type& a, const zipped_reference& b) { return a <  b.t; }
+	friend bool operator<=(const value_type& a, const zipped_reference& b) { return a <= b.t; }
+	friend bool operator> (const value_type& a, const zipped_reference& b) { return a >  b.t; }
+	friend bool operator>=(const value_type& a, const zipped_reference& b) { return a >= b.t; }
+protected:
+	template<std::size_t ...I>
+	void _swap(zipped_reference& other, std::index_sequence<I...>) {
+		using std::swap;
+		(... , swap(std::get<I>(t), std::get<I>(other.t)));
+	}
+
+	tuple_type t;
+};
+
+// compares zipped elements (values or references) by their I-th component only.
+// ie: std::sort(z.begin(), z.end(), compare_element<0>()) sorts by the first range
+template<std::size_t I, typename Compare = std::less<>>
+struct compare_element {
+	Compare comp;
+
+	template<typename A, typename B>
+	bool operator()(const A& a, const B& b) const {
+		return comp(_get(a), _get(b));
+	}
+private:
+	template<typename ...Iterators>
+	static decltype(auto) _get(const zipped_reference<Iterators...>& x) { return x.template get<I>(); }
+	template<typename ...T>
+	static decltype(auto) _get(const std::tuple<T...>& x) { return std::get<I>(x); }
+};
+
 template<typename Tag, typename ...Iterators>
 class zipped_iterator {};
 
+// The end iterators of the subranges, read once when the sentinel is made.
+// Iterators compare against it like against zipped_end, stopping on the shortest range
+template<typename ...Iterators>
+struct zipped_sentinel {
+	std::tuple<Iterators...> ends;
+};
+
+// The length of the shortest subrange, for zipped_index_iterator
+template<typename Difference>
+struct zipped_index_sentinel {
+	Difference size;
+};
+
 template<typename Tag, typename ...Iterators>
 zipped_iterator<Tag, Iterators...>& operator++(zipped_iterator<Tag, Iterators...>& it) {
 	it._prefix_inc(std::index_sequence_for<Iterators...>());
@@ -59,19 +163,34 @@ operator-(const zipped_iterator<Tag, Iterators...>& it, typename zipped_iterator
 	return copy;
 }
 
+// moves the elements out of the underlying ranges
+template<typename Tag, typename ...Iterators>
+auto iter_move(const zipped_iterator<Tag, Iterators...>& it) {
+	return it._iter_move(std::index_sequence_for<Iterators...>());
+}
+template<typename Tag, typename ...Iterators>
+void iter_swap(const zipped_iterator<Tag, Iterators...>& a, const zipped_iterator<Tag, Iterators...>& b) {
+	swap(*a, *b);
+}
+
+template<typename Tag, typename ...Iterators>
+typename zipped_iterator<Tag, Iterators...>::difference_type
+operator-(const zipped_iterator<Tag, Iterators...>& a, const zipped_iterator<Tag, Iterators...>& b) {
+	return a._distance(b, std::index_sequence_for<Iterators...>());
+}
+
 template<typename ...Iterators>
 class zipped_iterator<std::input_iterator_tag, Iterators...> {
 public:
 	using value_type        = std::tuple<typename std::iterator_traits<Iterators>::value_type...>;
-	using reference         = std::tuple<typename std::iterator_traits<Iterators>::reference...>;
+	using reference         = zipped_reference<Iterators...>;
 	using pointer           = std::tuple<typename std::iterator_traits<Iterators>::pointer...>;
 	using difference_type   = std::common_type_t<typename std::iterator_traits<Iterators>::difference_type...>;
 	using iterator_category = std::input_iterator_tag;
 
 	zipped_iterator(Iterators... args) : t(args...) {
 	}
-	zipped_iterator(const zipped_iterator& other) = delete;
-	zipped_iterator() = delete;
+	zipped_iterator(const zipped_iterator& other) = default;
 
 	// input iterator operators
 	friend zipped_iterator& operator++<iterator_category, Iterators...>(zipped_iterator&);
@@ -85,19 +204,35 @@ public:
 	bool operator==(const zipped_iterator& other) const {
 		return !_logical_neq(other, std::index_sequence_for<Iterators...>());
 	}
+	friend bool operator!=(const zipped_iterator& it, const zipped_sentinel<Iterators...>& s) { return it._logical_neq(s.ends, std::index_sequence_for<Iterators...>()); }
+	friend bool operator==(const zipped_iterator& it, const zipped_sentinel<Iterators...>& s) { return !(it != s); }
+	friend bool operator!=(const zipped_sentinel<Iterators...>& s, const zipped_iterator& it) { return it != s; }
+	friend bool operator==(const zipped_sentinel<Iterators...>& s, const zipped_iterator& it) { return !(it != s); }
 
 	template<std::size_t I>
 	auto& get() const { return std::get<I>(t); }
+
+	template<typename Tag, typename ...Its>
+	friend auto iter_move(const zipped_iterator<Tag, Its...>&);
 protected:
+	zipped_iterator() = default;
+
 	std::tuple<Iterators...> t;
 
+	template<std::size_t ...I>
+	auto _iter_move(std::index_sequence<I...>) const {
+		return std::tuple<decltype(std::move(*std::get<I>(t)))...>(std::move(*std::get<I>(t))...);
+	}
+
 	template<std::size_t ...I>
 	void _prefix_inc(std::index_sequence<I...>) {
+		ITERUTILS_COUNT(zipped, increment);
 		(... , ++std::get<I>(t));
 	}
 
 	template<std::size_t ...I>
 	reference _deref(std::index_sequence<I...>) const {
+		ITERUTILS_COUNT(zipped, dereference);
 		return reference(*std::get<I>(t)...);
 	}
 
@@ -105,7 +240,12 @@ protected:
 	// this ensures that iteration will stop on the shortest range
 	template<std::size_t ...I>
 	bool _logical_neq(const zipped_iterator& other, std::index_sequence<I...>) const {
-		return (... && (std::get<I>(t) != std::get<I>(other.t)));
+		return _logical_neq(other.t, std::index_sequence<I...>());
+	}
+	template<std::size_t ...I>
+	bool _logical_neq(const std::tuple<Iterators...>& other, std::index_sequence<I...>) const {
+		ITERUTILS_COUNT(zipped, compare);
+		return (... && (std::get<I>(t) != std::get<I>(other)));
 	}
 };
 
@@ -117,10 +257,9 @@ public:
 
 	zipped_iterator(Iterators... args) : zipped_iterator<std::input_iterator_tag, Iterators...>(args...) {
 	}
-	zipped_iterator(const zipped_iterator& other) : zipped_iterator<std::input_iterator_tag, Iterators...>(other.t) {
-	}
-	zipped_iterator() {
-	}
+	zipped_iterator(const zipped_iterator& other) = default;
+	zipped_iterator& operator=(const zipped_iterator& other) = default;
+	zipped_iterator() = default;
 	// methods copied over from base iterators
 	friend zipped_iterator& operator++<iterator_category, Iterators...>(zipped_iterator&);
 	// forward iterator operators
@@ -128,6 +267,7 @@ public:
 protected:
 	template<std::size_t ...I>
 	void _suffix_inc(std::index_sequence<I...>) {
+		ITERUTILS_COUNT(zipped, increment);
 		(... , (std::get<I>(this->t)++));
 	}
 };
@@ -149,10 +289,12 @@ protected:
 	// use a fold expression to decrement all the inner iterators
 	template<std::size_t ...I>
 	void _prefix_dec(std::index_sequence<I...>) {
+		ITERUTILS_COUNT(zipped, increment);
 		(... , --std::get<I>(this->t));
 	}
 	template<std::size_t ...I>
 	void _suffix_dec(std::index_sequence<I...>) {
+		ITERUTILS_COUNT(zipped, increment);
 		(... , (std::get<I>(this->t)--));
 	}
 };
@@ -175,33 +317,129 @@ public:
 	friend zipped_iterator  operator+<iterator_category, Iterators...> (const zipped_iterator&, difference_type);
 	friend zipped_iterator& operator-=<iterator_category, Iterators...>(zipped_iterator&,       difference_type);
 	friend zipped_iterator  operator-<iterator_category, Iterators...> (const zipped_iterator&, difference_type);
+	friend difference_type  operator-<iterator_category, Iterators...> (const zipped_iterator&, const zipped_iterator&);
 
 	bool operator<(const zipped_iterator& other) const {
+		ITERUTILS_COUNT(zipped, compare);
 		return this->t < other.t;
 	}
 	bool operator<=(const zipped_iterator& other) const {
+		ITERUTILS_COUNT(zipped, compare);
 		return this->t <= other.t;
 	}
 	bool operator>(const zipped_iterator& other) const {
+		ITERUTILS_COUNT(zipped, compare);
 		return this->t > other.t;
 	}
 	bool operator>=(const zipped_iterator& other) const {
+		ITERUTILS_COUNT(zipped, compare);
 		return this->t >= other.t;
 	}
 protected:
 	template<std::size_t ...I>
 	void _inplace_add(difference_type n, std::index_sequence<I...>) {
+		ITERUTILS_COUNT(zipped, jump);
 		(... , (std::get<I>(this->t)+=n));
 	}
 	template<std::size_t ...I>
 	void _inplace_sub(difference_type n, std::index_sequence<I...>) {
+		ITERUTILS_COUNT(zipped, jump);
 		(... , (std::get<I>(this->t)-=n));
 	}
+	// the subranges may have different lengths (ie: when other is an end iterator)
+	// so the distance is the one of the shortest subrange
+	template<std::size_t ...I>
+	difference_type _distance(const zipped_iterator& other, std::index_sequence<I...>) const {
+		ITERUTILS_COUNT(zipped, jump);
+		difference_type result = std::get<0>(this->t) - std::get<0>(other.t);
+		(... , _closer_to_zero(result, std::get<I>(this->t) - std::get<I>(other.t)));
+		return result;
+	}
+	static void _closer_to_zero(difference_type& result, difference_type d) {
+		if ((d < 0 ? -d : d) < (result < 0 ? -result : result))
+			result = d;
+	}
 };
 
 template<typename ...Iterators>
 zipped_iterator(Iterators...) -> zipped_iterator<std::common_type_t<typename Iterators::iterator_category...>, Iterators...>;
 
+// Random access zipped iterator that keeps the begin iterators of the subranges
+// and a single shared index. Incrementing and comparing touch one counter only,
+// so loops over it compile like a hand-written `for (i = 0; i < n; ++i)` loop
+template<typename ...Iterators>
+class zipped_index_iterator {
+public:
+	using value_type        = std::tuple<typename std::iterator_traits<Iterators>::value_type...>;
+	using reference         = zipped_reference<Iterators...>;
+	using pointer           = std::tuple<typename std::iterator_traits<Iterators>::pointer...>;
+	using difference_type   = std::common_type_t<typename std::iterator_traits<Iterators>::difference_type...>;
+	using iterator_category = std::random_access_iterator_tag;
+
+	zipped_index_iterator() = default;
+	zipped_index_iterator(Iterators... args, difference_type i) : t(args...), i_(i) {
+	}
+
+	reference operator*() const { return _deref(i_, std::index_sequence_for<Iterators...>()); }
+	reference operator[](difference_type n) const { ITERUTILS_COUNT(zipped, jump); return _deref(i_ + n, std::index_sequence_for<Iterators...>()); }
+
+	zipped_index_iterator& operator++() { ITERUTILS_COUNT(zipped, increment); ++i_; return *this; }
+	zipped_index_iterator& operator--() { ITERUTILS_COUNT(zipped, increment); --i_; return *this; }
+	zipped_index_iterator operator++(int) { ITERUTILS_COUNT(zipped, increment); auto copy = *this; ++i_; return copy; }
+	zipped_index_iterator operator--(int) { ITERUTILS_COUNT(zipped, increment); auto copy = *this; --i_; return copy; }
+	zipped_index_iterator& operator+=(difference_type n) { ITERUTILS_COUNT(zipped, jump); i_ += n; return *this; }
+	zipped_index_iterator& operator-=(difference_type n) { ITERUTILS_COUNT(zipped, jump); i_ -= n; return *this; }
+	zipped_index_iterator operator+(difference_type n) const { auto copy = *this; return copy += n; }
+	zipped_index_iterator operator-(difference_type n) const { auto copy = *this; return copy -= n; }
+	friend zipped_index_iterator operator+(difference_type n, const zipped_index_iterator& it) { return it + n; }
+	difference_type operator-(const zipped_index_iterator& other) const { ITERUTILS_COUNT(zipped, jump); return i_ - other.i_; }
+
+	bool operator==(const zipped_index_iterator& other) const { ITERUTILS_COUNT(zipped, compare); return i_ == other.i_; }
+	bool operator!=(const zipped_index_iterator& other) const { ITERUTILS_COUNT(zipped, compare); return i_ != other.i_; }
+	bool operator< (const zipped_index_iterator& other) const { ITERUTILS_COUNT(zipped, compare); return i_ <  other.i_; }
+	bool operator<=(const zipped_index_iterator& other) const { ITERUTILS_COUNT(zipped, compare); return i_ <= other.i_; }
+	bool operator> (const zipped_index_iterator& other) const { ITERUTILS_COUNT(zipped, compare); return i_ >  other.i_; }
+	bool operator>=(const zipped_index_iterator& other) const { ITERUTILS_COUNT(zipped, compare); return i_ >= other.i_; }
+	friend bool operator==(const zipped_index_iterator& it, zipped_index_sentinel<difference_type> s) { ITERUTILS_COUNT(zipped, compare); return it.i_ == s.size; }
+	friend bool operator!=(const zipped_index_iterator& it, zipped_index_sentinel<difference_type> s) { ITERUTILS_COUNT(zipped, compare); return it.i_ != s.size; }
+	friend bool operator==(zipped_index_sentinel<difference_type> s, const zipped_index_iterator& it) { return it == s; }
+	friend bool operator!=(zipped_index_sentinel<difference_type> s, const zipped_index_iterator& it) { return it != s; }
+
+	template<std::size_t I>
+	auto get() const { return std::get<I>(t) + i_; }
+
+	friend auto iter_move(const zipped_index_iterator& it) {
+		return it._iter_move(std::index_sequence_for<Iterators...>());
+	}
+	friend void iter_swap(const zipped_index_iterator& a, const zipped_index_iterator& b) {
+		swap(*a, *b);
+	}
+protected:
+	template<std::size_t ...I>
+	reference _deref(difference_type i, std::index_sequence<I...>) const {
+		ITERUTILS_COUNT(zipped, dereference);
+		return reference(std::get<I>(t)[i]...);
+	}
+	template<std::size_t ...I>
+	auto _iter_move(std::index_sequence<I...>) const {
+		return std::tuple<decltype(std::move(std::get<I>(t)[i_]))...>(std::move(std::get<I>(t)[i_])...);
+	}
+
+	std::tuple<Iterators...> t;
+	difference_type i_ = 0;
+};
+
+namespace detail {
+
+// zipped_range switches to zipped_index_iterator when every subrange is finite and random access
+template<typename ...Iterables>
+constexpr bool zip_by_index_v = std::conjunction_v<
+	std::is_base_of<std::random_access_iterator_tag, typename std::iterator_traits<typename std::remove_reference_t<Iterables>::iterator>::iterator_category>...,
+	std::negation<is_infinite<std::remove_reference_t<Iterables>>>...
+>;
+
+} // namespace detail
+
 template<typename ...Iterables>
 detail::specialize_iterator_from_iterables<zipped_iterator, Iterables...>
 zipped_begin(Iterables&... args) {
@@ -229,24 +467,53 @@ zipped_cend(const Iterables&... args) {
 template<typename ...Iterables>
 class zipped_range {
 public:
-	using iterator   = detail::specialize_iterator_from_iterables<zipped_iterator, Iterables...>;
+	using iterator   = std::conditional_t<
+		detail::zip_by_index_v<Iterables...>,
+		zipped_index_iterator<typename std::remove_reference_t<Iterables>::iterator...>,
+		detail::specialize_iterator_from_iterables<zipped_iterator, Iterables...>
+	>;
 	using value_type = typename iterator::value_type;
 	using pointer    = typename iterator::pointer;
 	using reference  = typename iterator::reference;
+	using sentinel_type = std::conditional_t<
+		detail::zip_by_index_v<Iterables...>,
+		zipped_index_sentinel<typename iterator::difference_type>,
+		zipped_sentinel<typename std::remove_reference_t<Iterables>::iterator...>
+	>;
 
 	zipped_range(Iterables&&... iterables) : t(std::forward<Iterables>(iterables)...) {
 	}
 	iterator begin() {
-		return std::apply(zipped_begin<std::remove_reference_t<Iterables>...>, t);
+		if constexpr (detail::zip_by_index_v<Iterables...>)
+			return _index_iterator(0, std::index_sequence_for<Iterables...>());
+		else
+			return std::apply(zipped_begin<std::remove_reference_t<Iterables>...>, t);
 	}
 	iterator end() {
-		return std::apply(zipped_end<std::remove_reference_t<Iterables>...>, t);
+		if constexpr (detail::zip_by_index_v<Iterables...>)
+			return _index_iterator(size(), std::index_sequence_for<Iterables...>());
+		else
+			return std::apply(zipped_end<std::remove_reference_t<Iterables>...>, t);
+	}
+	// the end as a sentinel: the shortest length for index iterators, else the subrange ends
+	sentinel_type sentinel() {
+		if constexpr (detail::zip_by_index_v<Iterables...>)
+			return {static_cast<typename iterator::difference_type>(size())};
+		else
+			return {std::apply([](auto&... iterables) { return std::make_tuple(std::end(iterables)...); }, t)};
 	}
 
-	std::enable_if_t<!is_infinite<zipped_range>::value, size_t> size() const {
-		return std::apply(shortest_iterable<Iterables...>, t);
+	// the size of the shortest finite subrange
+	template<typename R = zipped_range>
+	std::enable_if_t<!is_infinite<R>::value and detail::sized_or_infinite_v<Iterables...>, size_t> size() const {
+		return std::apply(shortest_iterable<Iterables...>, t).first;
 	}
 private:
+	template<std::size_t ...I>
+	iterator _index_iterator(std::size_t i, std::index_sequence<I...>) {
+		return {std::begin(std::get<I>(t))..., static_cast<typename iterator::difference_type>(i)};
+	}
+
 	std::tuple<Iterables...> t;
 };
 template<typename ...Iterables> zipped_range(Iterables&&...) -> zipped_range<Iterables...>;
@@ -256,5 +523,13 @@ struct is_infinite<zipped_range<T...>> : public std::conjunction<is_infinite<T>.
 
 } // namespace iterutils
 
+// allow structured bindings on zipped_reference
+template<typename ...Iterators>
+struct std::tuple_size<iterutils::zipped_reference<Iterators...>>
+: public std::integral_constant<std::size_t, sizeof...(Iterators)> {};
+template<std::size_t I, typename ...Iterators>
+struct std::tuple_element<I, iterutils::zipped_reference<Iterators...>>
+: public std::tuple_element<I, typename iterutils::zipped_reference<Iterators...>::tuple_type> {};
+
 #endif
 